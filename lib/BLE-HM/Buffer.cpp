@@ -27,6 +27,18 @@ Buffer <T>::Buffer ( uint32_t size )
 {
     _buf = new T [ size ];
     _size = size;
+    _owns_buf = true;
+    clear ();
+
+    return;
+}
+
+template <class T>
+Buffer <T>::Buffer ( T *storage, uint32_t size )
+{
+    _buf = storage;
+    _size = size;
+    _owns_buf = false;
     clear ();
 
     return;
@@ -35,7 +47,10 @@ Buffer <T>::Buffer ( uint32_t size )
 template <class T>
 Buffer <T>::~Buffer ()
 {
-    delete [] _buf;
+    if ( _owns_buf )
+    {
+        delete [] _buf;
+    }
 
     return;
 }
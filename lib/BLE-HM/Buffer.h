@@ -64,6 +64,7 @@ class Buffer
         volatile uint32_t _wloc;
         volatile uint32_t _rloc;
         uint32_t _size;
+        bool _owns_buf;
 
     public:
         /** Create a Buffer and allocate memory for it
@@ -71,6 +72,12 @@ class Buffer
          */
         Buffer ( uint32_t size = 0x100 );
 
+        /** Create a Buffer over caller owned memory, nothing is allocated
+         *  @param storage At least size elements that outlive the Buffer
+         *  @param size The size of the buffer
+         */
+        Buffer ( T *storage, uint32_t size );
+
         /** Get the size of the ring buffer
          * @return the size of the ring buffer
          */
@@ -22,6 +22,7 @@
 
 #include "BufferedSerial.h"
 #include <stdarg.h>
+#include "Format.h"
 
 BufferedSerial::BufferedSerial ( PinName tx, PinName rx, uint32_t buf_size, uint32_t tx_multiple, const char* name )
         : RawSerial ( tx, rx ), rxbuf ( buf_size ), txbuf ( (uint32_t) ( tx_multiple * buf_size ) )
@@ -32,6 +33,15 @@ BufferedSerial::BufferedSerial ( PinName tx, PinName rx, uint32_t buf_size, uint
     return;
 }
 
+BufferedSerial::BufferedSerial ( PinName tx, PinName rx, char *rx_storage, char *tx_storage, uint32_t buf_size, uint32_t tx_multiple )
+        : RawSerial ( tx, rx ), rxbuf ( rx_storage, buf_size ), txbuf ( tx_storage, (uint32_t) ( tx_multiple * buf_size ) )
+{
+    RawSerial::attach ( this, &BufferedSerial::rxIrq, Serial::RxIrq );
+    this->buf_size = buf_size;
+    this->tx_multiple = tx_multiple;
+    return;
+}
+
 BufferedSerial::~BufferedSerial ( void )
 {
     RawSerial::attach ( NULL, RawSerial::RxIrq );
@@ -84,20 +94,17 @@ int BufferedSerial::puts ( const char *s )
 int BufferedSerial::printf ( const char* format, ... )
 {
     char buffer [ this->buf_size ];
-    memset ( buffer, 0, this->buf_size );
     unsigned int r = 0;
 
     va_list arg;
     va_start( arg, format );
-    r = vsprintf ( buffer, format, arg );
-    // this may not hit the heap but should alert the user anyways
-    if ( r > this->buf_size )
+    r = Format::vprint ( buffer, this->buf_size, format, arg );
+    va_end( arg );
+    // Format never writes past buf_size, longer output is cut off
+    if ( r >= this->buf_size )
     {
-        error ( "%s %d buffer overwrite (max_buf_size: %d exceeded: %d)!\r\n", __FILE__, __LINE__, this->buf_size, r );
-        va_end( arg );
-        return 0;
+        r = this->buf_size - 1;
     }
-    va_end( arg );
     r = BufferedSerial::write ( buffer, r );
 
     return r;
@@ -123,6 +130,7 @@ ssize_t BufferedSerial::write ( const void *s, size_t length )
 
 void BufferedSerial::rxIrq ( void )
 {
+    PROFILE_SCOPE ( "rxIrq" );
     // read from the peripheral and make sure something is available
     if ( serial_readable ( &_serial ) )
     {
@@ -134,6 +142,7 @@ void BufferedSerial::rxIrq ( void )
 
 void BufferedSerial::txIrq ( void )
 {
+    PROFILE_SCOPE ( "txIrq" );
     // see if there is room in the hardware fifo and if something is in the software fifo
     while ( serial_writable ( &_serial ) )
     {
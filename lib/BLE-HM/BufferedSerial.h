@@ -25,6 +25,7 @@
 
 #include "mbed.h"
 #include "Buffer.h"
+#include "Profile.h"
 
 /** A serial port (UART) for communication with other serial devices
  *
@@ -90,6 +91,12 @@ class BufferedSerial : public RawSerial
          */
         BufferedSerial ( PinName tx, PinName rx, uint32_t buf_size = 256, uint32_t tx_multiple = 4, const char* name = NULL );
 
+        /** Create a BufferedSerial port whose ring buffers live in caller owned memory
+         *  @param rx_storage buf_size bytes for the rx ring buffer
+         *  @param tx_storage ( tx_multiple * buf_size ) bytes for the tx ring buffer
+         */
+        BufferedSerial ( PinName tx, PinName rx, char *rx_storage, char *tx_storage, uint32_t buf_size = 256, uint32_t tx_multiple = 4 );
+
         /** Destroy a BufferedSerial port
          */
         virtual ~BufferedSerial ( void );
@@ -11,6 +11,13 @@ HM11::HM11 ( PinName uartTx, PinName uartRx )
     mSerial.baud ( HM11_SERIAL_DEFAULT_BAUD );
 }
 
+HM11::HM11 ( PinName uartTx, PinName uartRx, char * rxStorage, char * txStorage )
+        : mSerial ( uartTx, uartRx, rxStorage, txStorage, HM11_RX_BUFFER_SIZE, HM11_TX_BUFFER_MULTIPLE )
+{
+
+    mSerial.baud ( HM11_SERIAL_DEFAULT_BAUD );
+}
+
 bool HM11::waitForData ( int timeoutMs )
 {
     int endTime;
@@ -88,6 +88,8 @@
 #define HM11_SERIAL_DEFAULT_BAUD       9600
 #define HM11_SERIAL_TIMEOUT            10000
 #define HM11_SERIAL_EOL                "\r\n"
+#define HM11_RX_BUFFER_SIZE            256
+#define HM11_TX_BUFFER_MULTIPLE        4
 
 class HM11
 {
@@ -100,6 +102,11 @@ class HM11
          * @param uartRx
          */
         HM11 ( PinName uartTx, PinName uartRx );
+        /**
+         * @param rxStorage HM11_RX_BUFFER_SIZE bytes
+         * @param txStorage ( HM11_RX_BUFFER_SIZE * HM11_TX_BUFFER_MULTIPLE ) bytes
+         */
+        HM11 ( PinName uartTx, PinName uartRx, char * rxStorage, char * txStorage );
         HM11 ( const BufferedSerial & serial );
 
         int sendDataToDevice ( const char* data );
@@ -120,6 +127,25 @@ class HM11
         inline static uint32_t strToHex ( char* const str, uint8_t len );
 };
 
+/**
+ * HM11 with its serial ring buffers inside the object instead of on the heap
+ */
+class HM11Storage
+{
+    protected:
+        char rxStorage [ HM11_RX_BUFFER_SIZE ];
+        char txStorage [ HM11_RX_BUFFER_SIZE * HM11_TX_BUFFER_MULTIPLE ];
+};
+
+class StaticHM11 : private HM11Storage, public HM11
+{
+    public:
+        StaticHM11 ( PinName uartTx, PinName uartRx )
+                : HM11 ( uartTx, uartRx, rxStorage, txStorage )
+        {
+        }
+};
+
 inline uint8_t HM11::getDataFromRx ()
 {
     return mSerial.getc ();
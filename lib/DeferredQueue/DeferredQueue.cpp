@@ -0,0 +1,66 @@
+#include "DeferredQueue.h"
+
+DeferredQueue::DeferredQueue ()
+{
+    head = 0;
+    tail = 0;
+    droppedCount = 0;
+    highWaterMark = 0;
+}
+
+DeferredQueue::DeferredQueue ( const DeferredQueue &other )
+{
+    head = 0;
+    tail = 0;
+    droppedCount = 0;
+    highWaterMark = 0;
+}
+
+bool DeferredQueue::post ( DeferredHandler * handler, const int event, const uint32_t arg )
+{
+    // Several interrupt priorities may post, claim the slot with interrupts off
+    __disable_irq ();
+    unsigned int used = tail - head;
+    if ( used >= DEFERRED_QUEUE_CAPACITY )
+    {
+        droppedCount++;
+        __enable_irq ();
+        return false;
+    }
+
+    Event &slot = events [ tail & ( DEFERRED_QUEUE_CAPACITY - 1 ) ];
+    slot.handler = handler;
+    slot.event = event;
+    slot.arg = arg;
+    tail++;
+
+    if ( ( used + 1 ) > highWaterMark )
+    {
+        highWaterMark = used + 1;
+    }
+    __enable_irq ();
+    return true;
+}
+
+int DeferredQueue::dispatch ()
+{
+    unsigned int end = tail;
+    int count = 0;
+    while ( head != end )
+    {
+        Event event = events [ head & ( DEFERRED_QUEUE_CAPACITY - 1 ) ];
+        head++; // free the slot before running the handler, it may post again
+        event.handler->handleDeferred ( event.event, event.arg );
+        count++;
+    }
+    return count;
+}
+
+void DeferredQueue::dispatchFor ( const unsigned int microSeconds )
+{
+    uint32_t start = us_ticker_read ();
+    do
+    {
+        dispatch ();
+    } while ( ( us_ticker_read () - start ) < microSeconds );
+}
@@ -0,0 +1,155 @@
+#ifndef DEFERRED_QUEUE_H
+#define DEFERRED_QUEUE_H
+
+#include "mbed.h"
+
+#define DEFERRED_QUEUE_CAPACITY     16 // power of two
+
+class DeferredHandler
+{
+    public:
+        virtual ~DeferredHandler ()
+        {
+        }
+        /**
+         * Called from main context by DeferredQueue::dispatch for every
+         * event posted to this handler, in posting order.
+         */
+        virtual void handleDeferred ( const int event, const uint32_t arg ) = 0;
+};
+
+/**
+ * Moves work out of interrupt context.  Ticker and InterruptIn handlers
+ * post a small fixed size event, the main loop drains the queue with
+ * dispatch () and runs the handlers there.  post () may be called from any
+ * context, dispatch () only from the main loop.
+ */
+class DeferredQueue
+{
+    private:
+        struct Event
+        {
+                DeferredHandler * handler;
+                int event;
+                uint32_t arg;
+        };
+
+        Event events [ DEFERRED_QUEUE_CAPACITY ];
+        volatile unsigned int head; // next event to dispatch
+        volatile unsigned int tail; // next free slot
+
+        volatile unsigned int droppedCount;
+        volatile unsigned int highWaterMark;
+
+        DeferredQueue ( const DeferredQueue &other ); // Don't allow copying at all
+
+    public:
+        DeferredQueue ();
+
+        /**
+         * @return false if the queue was full and the event is dropped
+         */
+        bool post ( DeferredHandler * handler, const int event, const uint32_t arg = 0 );
+
+        /**
+         * Runs every event queued so far, events posted by the handlers
+         * themselves wait for the next call.
+         * @return number of events run
+         */
+        int dispatch ();
+
+        /**
+         * Replaces wait_us in the main loop: keeps dispatching until
+         * microSeconds have passed.
+         */
+        void dispatchFor ( const unsigned int microSeconds );
+
+        inline unsigned int size () const;
+        inline unsigned int getDroppedCount () const;
+        inline unsigned int getHighWaterMark () const;
+};
+
+inline unsigned int DeferredQueue::size () const
+{
+    return tail - head;
+}
+
+inline unsigned int DeferredQueue::getDroppedCount () const
+{
+    return droppedCount;
+}
+
+/**
+ * Most events that were ever waiting at once
+ */
+inline unsigned int DeferredQueue::getHighWaterMark () const
+{
+    return highWaterMark;
+}
+
+/**
+ * Worst case and count of the runs of one interrupt handler, in micro seconds
+ */
+class IsrDuration
+{
+    private:
+        volatile uint32_t worstCase;
+        volatile uint32_t count;
+
+    public:
+        IsrDuration ()
+        {
+            reset ();
+        }
+
+        inline void record ( const uint32_t microSeconds )
+        {
+            count++;
+            if ( microSeconds > worstCase )
+            {
+                worstCase = microSeconds;
+            }
+        }
+
+        inline void reset ()
+        {
+            worstCase = 0;
+            count = 0;
+        }
+
+        inline uint32_t getWorstCase () const
+        {
+            return worstCase;
+        }
+
+        inline uint32_t getCount () const
+        {
+            return count;
+        }
+};
+
+/**
+ * Put one on the stack at the top of an interrupt handler, it records the
+ * time until the handler returns into an IsrDuration.
+ */
+class IsrDurationScope
+{
+    private:
+        IsrDuration & duration;
+        const uint32_t start;
+
+        IsrDurationScope ( const IsrDurationScope &other );
+
+    public:
+        IsrDurationScope ( IsrDuration & _duration )
+                : duration ( _duration ), start ( us_ticker_read () )
+        {
+        }
+
+        ~IsrDurationScope ()
+        {
+            duration.record ( us_ticker_read () - start );
+        }
+};
+
+#endif
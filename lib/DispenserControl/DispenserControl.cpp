@@ -1,10 +1,10 @@
 #include "DispenserControl.h"
 
 #define NUMBER_OF_STEPS_PER_REV         200
-#define STEPPER_MOTOR_DELAY_MICRO_SECS  250
+#define CALIBRATION_MAGIC               0x44535043 // "DSPC"
 
-DispenserControl::DispenserControl ( const PinName homePin, const PinName endPin, const PinName motorStepPin, const PinName motorDirPin )
-        : homeSwitchPin ( homePin ), endSwitchPin ( endPin ), dispenserStepPin ( motorStepPin ), dispenserDirPin ( motorDirPin )
+DispenserControl::DispenserControl ( const PinName homePin, const PinName endPin, const PinName motorStepPin, const PinName motorDirPin, NonVolatileStorage * _eeprom )
+        : homeSwitchPin ( homePin ), endSwitchPin ( endPin ), dispenserStepPin ( motorStepPin ), dispenserDirPin ( motorDirPin ), eeprom ( _eeprom )
 
 {
     inMotion = false;
@@ -12,16 +12,133 @@ DispenserControl::DispenserControl ( const PinName homePin, const PinName endPin
     atHome = false;
     maximumNumberOfSteps = 0;
     dispenserCurrentPosition = 0;
+    moveDirection = HOME;
+    moveSteps = 0;
+    moveStepsTaken = 0;
+    movePhase = NotMoving;
+    targetPosition = 0;
+    targetStepsTaken = 0;
+    stepsSinceHome = 0;
+    homingRequested = false;
+    switchMismatch = false;
+    homedThisMove = false;
+    lastMoveFailed = false;
+    totalTravelSteps = 0;
+    completedMoves = 0;
+    failedMoves = 0;
+    savedMaximumNumberOfSteps = 0;
+    savedPosition = -1;
     listener = NULL;
 
+    // Precomputed so the step interrupt only has to look the delay up
+    for ( int i = 0; i < DISPENSER_RAMP_STEPS; i++ )
+    {
+        rampDelay [ i ] = rampDelayAt ( i );
+    }
+
+    Calibration calibration;
+    if ( !loadCalibration ( calibration ) || !verifyCalibration ( calibration ) )
+    {
+        calibrate ();
+    }
+    saveCalibration ();
+}
+
+DispenserControl::~DispenserControl ()
+{
+    stepTimer.detach ();
+}
+
+/**
+ * Linear speed ramp from the start rate to the cruise rate
+ */
+uint16_t DispenserControl::rampDelayAt ( const unsigned int rampIndex )
+{
+    const float startRate = 1000000.0f / DISPENSER_START_STEP_DELAY_MICRO_SECS;
+    const float cruiseRate = 1000000.0f / DISPENSER_CRUISE_STEP_DELAY_MICRO_SECS;
+    float rate = startRate + ( ( cruiseRate - startRate ) * rampIndex ) / ( DISPENSER_RAMP_STEPS - 1 );
+    return (uint16_t) ( 1000000.0f / rate );
+}
+
+/**
+ * Full calibration: find home, measure the travel to the end switch and park
+ * in the middle of the rail
+ */
+void DispenserControl::calibrate ()
+{
     goToHome ();
 
     goToEnd ();
     moveDispenserHead ( ( maximumNumberOfSteps / 2 ), HOME );
 }
 
-DispenserControl::~DispenserControl ()
+uint32_t DispenserControl::checksumOf ( const Calibration &calibration )
+{
+    return ~ ( calibration.magic ^ calibration.maximumNumberOfSteps ^ (uint32_t) calibration.position );
+}
+
+bool DispenserControl::loadCalibration ( Calibration &calibration ) const
+{
+    if ( ( eeprom == NULL ) || !eeprom->read ( DISPENSER_CALIBRATION_EEPROM_ADDRESS, &calibration, sizeof ( calibration ) ) )
+    {
+        return false;
+    }
+
+    return ( calibration.magic == CALIBRATION_MAGIC ) && ( calibration.checksum == checksumOf ( calibration ) ) && ( calibration.maximumNumberOfSteps > 0 ) && ( calibration.position >= 0 )
+             && ( calibration.position <= (int32_t) calibration.maximumNumberOfSteps );
+}
+
+/**
+ * Quick boot check: the home switch has to show up within the tolerance
+ * around the stored position, otherwise the head was moved while powered
+ * down (or the power went away mid move) and the stored data can't be used.
+ */
+bool DispenserControl::verifyCalibration ( const Calibration &calibration )
+{
+    unsigned int stepsTaken = 0;
+
+    testLimitSwitches ();
+    if ( !isAtHome () )
+    {
+        stepsTaken = moveDispenserHead ( calibration.position + DISPENSER_CALIBRATION_TOLERANCE_STEPS, HOME );
+    }
+
+    int error = (int) stepsTaken - calibration.position;
+    if ( !isAtHome () || ( error > DISPENSER_CALIBRATION_TOLERANCE_STEPS ) || ( error < -DISPENSER_CALIBRATION_TOLERANCE_STEPS ) )
+    {
+        return false;
+    }
+
+    maximumNumberOfSteps = calibration.maximumNumberOfSteps;
+    return true;
+}
+
+bool DispenserControl::saveCalibration ()
 {
+    if ( ( eeprom == NULL ) || isInMotion () )
+    {
+        return false;
+    }
+
+    if ( ( savedPosition == dispenserCurrentPosition ) && ( savedMaximumNumberOfSteps == maximumNumberOfSteps ) )
+    {
+        return true;
+    }
+
+    Calibration calibration;
+    calibration.magic = CALIBRATION_MAGIC;
+    calibration.maximumNumberOfSteps = maximumNumberOfSteps;
+    calibration.position = dispenserCurrentPosition;
+    calibration.checksum = checksumOf ( calibration );
+
+    if ( !eeprom->write ( DISPENSER_CALIBRATION_EEPROM_ADDRESS, &calibration, sizeof ( calibration ) ) )
+    {
+        return false;
+    }
+
+    savedPosition = calibration.position;
+    savedMaximumNumberOfSteps = calibration.maximumNumberOfSteps;
+    return true;
 }
 
 unsigned int DispenserControl::goToHome ()
@@ -44,51 +161,163 @@ unsigned int DispenserControl::goToEnd ()
     return stepsTaken;
 }
 
+/**
+ * Blocking move, only used while calibrating.  The steps are still generated
+ * by the step timer, this just sleeps until the move has finished.
+ */
 unsigned int DispenserControl::moveDispenserHead ( unsigned int steps, Direction direction )
 {
-    int delta = 1;
-    if ( direction == HOME )
+    startMove ( steps, direction );
+    __disable_irq ();
+    while ( isInMotion () )
     {
-        delta = -delta; // reduce steps moving towards Home
+        // A pending interrupt ends __WFI even while masked, so the last step
+        // can't slip in between the check and the sleep
+        __WFI ();
+        __enable_irq ();
+        __disable_irq ();
     }
+    __enable_irq ();
+    return moveStepsTaken;
+}
 
-    dispenserDirPin = direction;
+void DispenserControl::startMove ( const unsigned int steps, Direction direction )
+{
+    moveDirection = direction;
+    moveSteps = steps;
+    moveStepsTaken = 0;
 
-    bool stopMotorMovement = false;
-    unsigned int stepsTaken = 0;
+    dispenserDirPin = direction;
+    TRACE( TraceDispenserMoveStart, direction, steps );
 
     inMotion = true;
-    while ( ( !stopMotorMovement ) && ( stepsTaken < steps ) )
+    atStepTimer ();
+}
+
+void DispenserControl::atStepTimer ()
+{
+    IsrDurationScope isrDuration ( stepTimerIsrDuration );
+    PROFILE_SCOPE ( "atStepTimer" );
+
+    testLimitSwitches ();
+
+    bool stopMotorMovement = ( moveStepsTaken >= moveSteps ) || switchMismatch;
+    if ( isAtHome () && ( moveDirection == HOME ) )
+    {
+        stopMotorMovement = true;
+    }
+    else if ( isAtEnd () && ( moveDirection == END ) )
     {
-        testLimitSwitches ();
+        stopMotorMovement = true;
+    }
 
-        if ( isAtHome () && ( direction == HOME ) )
-        {
-            stopMotorMovement = true;
-        }
-        else if ( isAtEnd () && ( direction == END ) )
-        {
-            stopMotorMovement = true;
-        }
+    if ( stopMotorMovement )
+    {
+        moveFinished ();
+        return;
+    }
 
-        if ( !stopMotorMovement )
-        {
-            dispenserStepPin = ON;
-            dispenserStepPin = OFF;
-            stepsTaken++;
-            dispenserCurrentPosition += delta;
-            wait_us ( STEPPER_MOTOR_DELAY_MICRO_SECS ); // To prevent motor from stalling
-        }
+    dispenserStepPin = ON;
+    dispenserStepPin = OFF;
+    dispenserCurrentPosition += ( moveDirection == HOME ) ? -1 : 1;
+    stepsSinceHome++;
+
+    // delay before the next step, the switches are tested again right before it
+    unsigned int stepDelay = stepDelayAt ( moveStepsTaken );
+    moveStepsTaken++;
+    stepTimer.attach_us ( this, &DispenserControl::atStepTimer, stepDelay );
+}
+
+void DispenserControl::moveFinished ()
+{
+    TRACE( TraceDispenserMoveEnd, moveStepsTaken, dispenserCurrentPosition );
+    switch ( movePhase )
+    {
+        case Homing:
+            targetStepsTaken += moveStepsTaken;
+            if ( !isAtHome () )
+            {
+                failMove (); // out of steps, where ever the head is it isn't home
+                return;
+            }
+            stepsSinceHome = 0;
+            homingRequested = false;
+            homedThisMove = true;
+            startTravel ();
+            return;
+
+        case Travelling:
+            targetStepsTaken += moveStepsTaken;
+            if ( switchMismatch )
+            {
+                switchMismatch = false;
+                if ( homedThisMove )
+                {
+                    failMove ();
+                }
+                else
+                {
+                    startHoming ();
+                }
+                return;
+            }
+            movePhase = NotMoving;
+            totalTravelSteps += targetStepsTaken;
+            completedMoves++;
+            inMotion = false;
+            if ( listener != NULL )
+            {
+                listener->reachedToPosition ( targetPosition, targetStepsTaken );
+            }
+            return;
+
+        default:
+            inMotion = false;
+            return;
     }
+}
+
+void DispenserControl::startHoming ()
+{
+    movePhase = Homing;
+    startMove ( maximumNumberOfSteps + DISPENSER_CALIBRATION_TOLERANCE_STEPS + DISPENSER_HOMING_MARGIN_STEPS, HOME );
+}
+
+void DispenserControl::failMove ()
+{
+    movePhase = NotMoving;
+    homingRequested = true; // the position can't be trusted any more
+    totalTravelSteps += targetStepsTaken;
+    failedMoves++;
+    lastMoveFailed = true;
     inMotion = false;
+    if ( listener != NULL )
+    {
+        listener->moveFailed ( targetPosition );
+    }
+}
 
-    return stepsTaken;
+void DispenserControl::startTravel ()
+{
+    movePhase = Travelling;
+    if ( (int) targetPosition < dispenserCurrentPosition )
+    {
+        startMove ( dispenserCurrentPosition - targetPosition, HOME );
+    }
+    else
+    {
+        startMove ( targetPosition - dispenserCurrentPosition, END );
+    }
 }
 
 void DispenserControl::testLimitSwitches ()
 {
     if ( homeSwitchPin.read () == ON )
     { // Home Button Pressed
+        if ( ( movePhase == Travelling ) && ( dispenserCurrentPosition > DISPENSER_CALIBRATION_TOLERANCE_STEPS ) )
+        {
+            switchMismatch = true; // we weren't where we thought we were
+        }
         atHome = true;
         dispenserCurrentPosition = 0;
     }
@@ -99,8 +328,15 @@ void DispenserControl::testLimitSwitches ()
 
     if ( endSwitchPin.read () == ON )
     { // End Button Pressed
+        if ( ( movePhase == Travelling ) && ( ( dispenserCurrentPosition + DISPENSER_CALIBRATION_TOLERANCE_STEPS ) < (int) maximumNumberOfSteps ) )
+        {
+            switchMismatch = true; // the travel stays as calibrated
+        }
+        else if ( movePhase != Homing )
+        {
+            maximumNumberOfSteps = dispenserCurrentPosition;
+        }
         atEnd = true;
-        maximumNumberOfSteps = dispenserCurrentPosition;
     }
     else
     {
@@ -108,21 +344,30 @@ void DispenserControl::testLimitSwitches ()
     }
 }
 
-unsigned int DispenserControl::moveToPosition ( const unsigned int position )
+bool DispenserControl::moveToPosition ( const unsigned int position )
 {
-    unsigned int stepsTaken = 0;
-    if ( !isInMotion () )
+    if ( isInMotion () )
     {
-        goToHome ();
-        stepsTaken = moveDispenserHead ( position, END );
+        return false;
+    }
 
-        if ( listener != NULL )
-        {
-            listener->reachedToPosition ( position, stepsTaken );
-        }
+    targetPosition = position;
+    targetStepsTaken = 0;
+    switchMismatch = false;
+    homedThisMove = false;
+    lastMoveFailed = false;
+    inMotion = true;
+
+    if ( homingRequested || ( stepsSinceHome >= DISPENSER_REHOME_STEP_BUDGET ) )
+    {
+        startHoming ();
+    }
+    else
+    {
+        startTravel ();
     }
 
-    return stepsTaken;
+    return true;
 }
 
 void DispenserControl::setListener ( DispenserControlListener * &_listener )
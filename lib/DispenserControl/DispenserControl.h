@@ -2,6 +2,32 @@
 #define DISPENSER_CONTROL_H
 
 #include "mbed.h"
+#include "Eeprom.h"
+#include "DeferredQueue.h"
+#include "Profile.h"
+#include "Trace.h"
+
+// Trapezoidal step profile: accelerate from the start rate to the cruise rate
+// over DISPENSER_RAMP_STEPS steps, cruise, and decelerate the same way
+#define DISPENSER_START_STEP_DELAY_MICRO_SECS   600
+#define DISPENSER_CRUISE_STEP_DELAY_MICRO_SECS  120
+#define DISPENSER_RAMP_STEPS                    64
+
+// Where the travel calibration is kept ( the bytes reserved for it ), and how
+// far off the stored position the home switch may be found before a full
+// calibration is forced
+#define DISPENSER_CALIBRATION_EEPROM_ADDRESS    0
+#define DISPENSER_CALIBRATION_EEPROM_SIZE       16
+#define DISPENSER_CALIBRATION_TOLERANCE_STEPS   20
+
+// moveToPosition travels relative to the current position and only goes
+// home first once this many steps were taken since the last homing, after a
+// move failed, or when requestHoming was called
+#define DISPENSER_REHOME_STEP_BUDGET            20000
+
+// Homing gives up once it went the calibrated travel plus the tolerance plus
+// this much without finding the home switch
+#define DISPENSER_HOMING_MARGIN_STEPS           200
 
 class DispenserControlListener
 {
@@ -9,7 +35,19 @@ class DispenserControlListener
         virtual ~DispenserControlListener ()
         {
         }
+        /**
+         * Called from the step timer interrupt once a moveToPosition has
+         * finished, keep it short or post to a DeferredQueue.
+         */
         virtual void reachedToPosition ( const unsigned int position, const unsigned int stepsTaken ) = 0;
+
+        /**
+         * Called instead of reachedToPosition when the head could not be
+         * brought to position: a limit switch triggered where it shouldn't,
+         * again after going home and starting over, or the home switch
+         * didn't show up.  Same context as reachedToPosition.
+         */
+        virtual void moveFailed ( const unsigned int position ) = 0;
 };
 
 class DispenserControl
@@ -27,39 +65,140 @@ class DispenserControl
             ON = 1
         };
 
+        enum MovePhase
+        {
+            NotMoving,
+            Homing,     // moveToPosition: travelling to the home switch
+            Travelling  // moveToPosition: travelling out to the target
+        };
+
         DigitalIn homeSwitchPin;
         DigitalIn endSwitchPin;
         DigitalOut dispenserStepPin;
         DigitalOut dispenserDirPin;
 
-        bool inMotion;
-        bool atEnd;
-        bool atHome;
-        unsigned int maximumNumberOfSteps;
-        int dispenserCurrentPosition;
+        volatile bool inMotion;
+        volatile bool atEnd;
+        volatile bool atHome;
+        volatile unsigned int maximumNumberOfSteps;
+        volatile int dispenserCurrentPosition;
+
+        Timeout stepTimer;
+        uint16_t rampDelay [ DISPENSER_RAMP_STEPS ]; // micro seconds between steps while ramping
+        Direction moveDirection;
+        unsigned int moveSteps;
+        volatile unsigned int moveStepsTaken;
+
+        volatile MovePhase movePhase;
+        unsigned int targetPosition;
+        unsigned int targetStepsTaken;
+
+        volatile unsigned int stepsSinceHome;
+        volatile bool homingRequested;
+        volatile bool switchMismatch; // a limit switch triggered away from where it is
+        bool homedThisMove;
+        volatile bool lastMoveFailed;
+
+        unsigned int totalTravelSteps;
+        unsigned int completedMoves;
+        unsigned int failedMoves;
+
+        struct Calibration
+        {
+                uint32_t magic;
+                uint32_t maximumNumberOfSteps;
+                int32_t position;
+                uint32_t checksum;
+        };
+        // Fails to compile if the calibration outgrows its EEPROM region
+        typedef char CalibrationFitsItsRegion [ ( sizeof(Calibration) <= DISPENSER_CALIBRATION_EEPROM_SIZE ) ? 1 : -1 ];
+
+        NonVolatileStorage * eeprom;
+        unsigned int savedMaximumNumberOfSteps;
+        int savedPosition;
 
         DispenserControlListener * listener;
 
+        bool loadCalibration ( Calibration &calibration ) const;
+        bool verifyCalibration ( const Calibration &calibration );
+        void calibrate ();
+        static uint32_t checksumOf ( const Calibration &calibration );
+
         void testLimitSwitches ();
         unsigned int moveDispenserHead ( const unsigned int steps, Direction direction );
 
+        void startMove ( const unsigned int steps, Direction direction );
+        void atStepTimer ();
+        IsrDuration stepTimerIsrDuration;
+        void moveFinished ();
+        void startHoming ();
+        void startTravel ();
+        void failMove ();
+        inline unsigned int stepDelayAt ( const unsigned int step ) const;
+        static uint16_t rampDelayAt ( const unsigned int rampIndex );
+        static inline unsigned int rampIndexAt ( const unsigned int step, const unsigned int steps );
+
         unsigned int goToHome ();
         unsigned int goToEnd ();
 
     public:
-        DispenserControl ( const PinName homePin, const PinName endPin, const PinName motorStepPin, const PinName motorDirPin );
+        /**
+         * With an eeprom the travel calibration and the last position are
+         * restored from it, and boot only verifies the home switch is where
+         * they say.  The full home/end calibration runs when nothing valid
+         * is stored, when the verification fails, or without an eeprom.
+         */
+        DispenserControl ( const PinName homePin, const PinName endPin, const PinName motorStepPin, const PinName motorDirPin, NonVolatileStorage * _eeprom = NULL );
         virtual ~DispenserControl ();
 
-        unsigned int moveToPosition ( const unsigned int position );
+        /**
+         * Stores the calibration and current position if they changed since
+         * the last save.  Writes the eeprom, call it from main context while
+         * the head is idle.
+         * @return false if there is no eeprom, the head moves or the write failed
+         */
+        bool saveCalibration ();
+
+        /**
+         * Starts moving the head to position (steps from home) and returns
+         * right away, the steps are generated from a timer interrupt.  The
+         * listener's reachedToPosition is called when the head arrives.
+         *
+         * A limit switch that triggers where it shouldn't means the position
+         * is off: the head goes home and starts over once, a second surprise
+         * or a homing that doesn't find the home switch fails the move with
+         * moveFailed instead.
+         * @return false if the head is already in motion
+         */
+        bool moveToPosition ( const unsigned int position );
         void setListener ( DispenserControlListener * &_listener );
 
+        /**
+         * Makes the next moveToPosition go home first
+         */
+        inline void requestHoming ();
+
         inline bool isInMotion () const;
         inline bool isAtHome () const;
         inline bool isAtEnd () const;
 //        inline unsigned int getMaxPosition () const;
         inline unsigned int getCurrentPosition () const;
+        inline unsigned int getTotalTravelSteps () const;
+        inline unsigned int getCompletedMoves () const;
+        inline unsigned int getFailedMoves () const;
+
+        /**
+         * @return true if the last moveToPosition ended in moveFailed
+         */
+        inline bool hasMoveFailed () const;
+        inline const IsrDuration & getStepTimerIsrDuration () const;
 };
 
+inline void DispenserControl::requestHoming ()
+{
+    homingRequested = true;
+}
+
 inline bool DispenserControl::isInMotion () const
 {
     return inMotion;
@@ -85,4 +224,52 @@ inline unsigned int DispenserControl::getCurrentPosition () const
     return dispenserCurrentPosition;
 }
 
+/**
+ * Steps taken by all moveToPosition calls, homing included
+ */
+inline unsigned int DispenserControl::getTotalTravelSteps () const
+{
+    return totalTravelSteps;
+}
+
+inline unsigned int DispenserControl::getCompletedMoves () const
+{
+    return completedMoves;
+}
+
+inline unsigned int DispenserControl::getFailedMoves () const
+{
+    return failedMoves;
+}
+
+inline bool DispenserControl::hasMoveFailed () const
+{
+    return lastMoveFailed;
+}
+
+inline const IsrDuration & DispenserControl::getStepTimerIsrDuration () const
+{
+    return stepTimerIsrDuration;
+}
+
+inline unsigned int DispenserControl::rampIndexAt ( const unsigned int step, const unsigned int steps )
+{
+    // distance to the nearer end of the move decides where on the ramp we are
+    unsigned int rampIndex = step;
+    if ( ( steps - 1 - step ) < rampIndex )
+    {
+        rampIndex = steps - 1 - step;
+    }
+    if ( rampIndex >= DISPENSER_RAMP_STEPS )
+    {
+        rampIndex = DISPENSER_RAMP_STEPS - 1;
+    }
+    return rampIndex;
+}
+
+inline unsigned int DispenserControl::stepDelayAt ( const unsigned int step ) const
+{
+    return rampDelay [ rampIndexAt ( step, moveSteps ) ];
+}
+
 #endif
@@ -0,0 +1,126 @@
+#include "Eeprom.h"
+
+// Flash memory module (FTFL) registers, see K20 Sub-Family Reference Manual chapter 30
+#define FTFL_FSTAT              ( * (volatile uint8_t *) 0x40020000 )
+#define FTFL_FCNFG              ( * (volatile uint8_t *) 0x40020001 )
+#define FTFL_FCCOB0             ( * (volatile uint8_t *) 0x40020007 )
+#define FTFL_FCCOB5             ( * (volatile uint8_t *) 0x4002000A )
+#define FTFL_FCCOB4             ( * (volatile uint8_t *) 0x4002000B )
+
+#define FTFL_FSTAT_ERROR_MASK   0x70 // ACCERR | FPVIOL | RDCOLERR
+#define FTFL_FCNFG_EEERDY       0x01
+#define FTFL_FCNFG_RAMRDY       0x02
+
+#define FTFL_CMD_PGMPART        0x80
+#define EEPROM_EEESIZE_2048     0x33 // EEESIZE code for 2K, both subsystems equal
+#define EEPROM_DEPART_32K       0x03 // all 32K FlexNVM backs the EEPROM, no data flash
+
+#define FLEXRAM                 ( (volatile uint8_t *) 0x14000000 )
+
+#define EEPROM_READY_TIMEOUT    20000
+
+/**
+ * Launches the loaded flash command and waits for it.  The flash controller
+ * can't be read while it runs a command, so this has to execute from RAM:
+ *      ldr  r3, =0x80 ; strb r3, [r0]   ( FSTAT = CCIF, launch )
+ *  1:  ldrb r3, [r0] ; tst r3, #0x80 ; beq 1b
+ *      bx   lr
+ */
+static const uint16_t FLASH_COMMAND_FROM_RAM [] = { 0xf06f, 0x037f, 0x7003, 0x7803, 0xf013, 0x0f80, 0xd0fb, 0x4770 };
+
+Eeprom::Eeprom ()
+{
+    ready = false;
+
+    if ( FTFL_FCNFG & FTFL_FCNFG_RAMRDY )
+    {
+        // FlexRAM is still plain RAM ( first boot ), partition it for EEPROM use
+        uint16_t command [ sizeof ( FLASH_COMMAND_FROM_RAM ) / sizeof ( uint16_t ) ];
+        memcpy ( command, FLASH_COMMAND_FROM_RAM, sizeof ( command ) );
+
+        FTFL_FCCOB0 = FTFL_CMD_PGMPART;
+        FTFL_FCCOB4 = EEPROM_EEESIZE_2048;
+        FTFL_FCCOB5 = EEPROM_DEPART_32K;
+        __disable_irq ();
+        ( * ( (void (*) ( volatile uint8_t * )) ( (uintptr_t) command | 1 ) ) ) ( &FTFL_FSTAT );
+        __enable_irq ();
+
+        uint8_t status = FTFL_FSTAT;
+        if ( status & FTFL_FSTAT_ERROR_MASK )
+        {
+            FTFL_FSTAT = ( status & FTFL_FSTAT_ERROR_MASK );
+            return;
+        }
+    }
+
+    for ( int count = 0; count < EEPROM_READY_TIMEOUT; count++ )
+    {
+        if ( FTFL_FCNFG & FTFL_FCNFG_EEERDY )
+        {
+            ready = true;
+            break;
+        }
+    }
+}
+
+Eeprom::Eeprom ( const Eeprom &other )
+{
+    ready = false;
+}
+
+Eeprom::~Eeprom ()
+{
+}
+
+unsigned int Eeprom::getSize () const
+{
+    return EEPROM_SIZE;
+}
+
+void Eeprom::waitUntilReady () const
+{
+    while ( ! ( FTFL_FCNFG & FTFL_FCNFG_EEERDY ) )
+    {
+    }
+}
+
+bool Eeprom::read ( const unsigned int address, void * data, const unsigned int length ) const
+{
+    if ( !ready || ( address + length ) > EEPROM_SIZE )
+    {
+        return false;
+    }
+
+    uint8_t * bytes = (uint8_t *) data;
+    waitUntilReady ();
+    for ( unsigned int i = 0; i < length; i++ )
+    {
+        bytes [ i ] = FLEXRAM [ address + i ];
+    }
+    return true;
+}
+
+bool Eeprom::write ( const unsigned int address, const void * data, const unsigned int length )
+{
+    if ( !ready || ( address + length ) > EEPROM_SIZE )
+    {
+        return false;
+    }
+
+    const uint8_t * bytes = (const uint8_t *) data;
+    for ( unsigned int i = 0; i < length; i++ )
+    {
+        // Unchanged bytes cost neither time nor wear
+        if ( FLEXRAM [ address + i ] != bytes [ i ] )
+        {
+            uint8_t status = FTFL_FSTAT & FTFL_FSTAT_ERROR_MASK;
+            if ( status )
+            {
+                FTFL_FSTAT = status;
+            }
+            FLEXRAM [ address + i ] = bytes [ i ];
+            waitUntilReady ();
+        }
+    }
+    return true;
+}
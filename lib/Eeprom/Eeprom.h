@@ -0,0 +1,59 @@
+#ifndef LIB_EEPROM_EEPROM_H_
+#define LIB_EEPROM_EEPROM_H_
+
+#include "mbed.h"
+
+/**
+ * Byte addressable non-volatile storage on the Teensy 3.1 (MK20DX256).
+ *
+ * The FlexRAM is partitioned as Enhanced EEPROM (EEE) backed by the 32K
+ * FlexNVM, the flash controller then does the erase / wear levelling by
+ * itself and the EEPROM just looks like EEPROM_SIZE bytes of memory at
+ * 0x14000000.  Reads are plain memory reads, every changed byte written
+ * costs a few hundred micro seconds (worst case a few milli seconds) while
+ * the controller commits it, so write from main context only.
+ */
+#define EEPROM_SIZE     2048
+
+/**
+ * Byte addressable non-volatile memory as seen by the storage layers built
+ * on top of it ( see KvStore ), so they can run on any backing store.
+ */
+class NonVolatileStorage
+{
+    public:
+        virtual ~NonVolatileStorage ()
+        {
+        }
+        virtual bool read ( const unsigned int address, void * data, const unsigned int length ) const = 0;
+        virtual bool write ( const unsigned int address, const void * data, const unsigned int length ) = 0;
+        virtual unsigned int getSize () const = 0;
+};
+
+class Eeprom : public NonVolatileStorage
+{
+    private:
+        bool ready;
+
+        Eeprom ( const Eeprom &other ); // Don't allow pass-by-value
+
+        void waitUntilReady () const;
+
+    public:
+        Eeprom ();
+        virtual ~Eeprom ();
+
+        virtual bool read ( const unsigned int address, void * data, const unsigned int length ) const;
+        virtual bool write ( const unsigned int address, const void * data, const unsigned int length );
+        virtual unsigned int getSize () const;
+
+        inline bool isReady () const;
+};
+
+inline bool Eeprom::isReady () const
+{
+    return ready;
+}
+
+
+#endif /* LIB_EEPROM_EEPROM_H_ */
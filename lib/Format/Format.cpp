@@ -0,0 +1,432 @@
+#include "Format.h"
+#include <string.h>
+
+#define FORMAT_MAX_DIGITS           10 // uint32_t in base 10
+#define FORMAT_MAX_SIGNIFICANT      9  // decimal digits that fit the uint32_t mantissa
+
+/**
+ * Bounded writer that keeps counting past the end of the buffer
+ */
+struct FormatOutput
+{
+        char * buffer;
+        int size;
+        int length;
+
+        inline void put ( const char c )
+        {
+            if ( length < ( size - 1 ) )
+            {
+                buffer [ length ] = c;
+            }
+            length++;
+        }
+
+        inline void append ( const char * text, const int count )
+        {
+            const int room = size - 1 - length;
+            if ( room > 0 )
+            {
+                memcpy ( buffer + length, text, ( count < room ) ? count : room );
+            }
+            length += count;
+        }
+
+        inline void repeat ( const char c, int count )
+        {
+            while ( count-- > 0 )
+            {
+                put ( c );
+            }
+        }
+
+        inline int finish ()
+        {
+            if ( size > 0 )
+            {
+                buffer [ ( length < size ) ? length : ( size - 1 ) ] = '\0';
+            }
+            return length;
+        }
+};
+
+static void putNumber ( FormatOutput & out, uint32_t magnitude, const bool negative, const int width, const char pad, const bool leftAlign, const int base, const bool upperCase )
+{
+    const char * digitChars = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+    char digits [ FORMAT_MAX_DIGITS ];
+    int count = 0;
+    if ( base == 10 )
+    {
+        do
+        {
+            // A constant divisor turns into a multiply, no udiv
+            digits [ count++ ] = '0' + ( magnitude % 10 );
+            magnitude /= 10;
+        } while ( magnitude != 0 );
+    }
+    else // 16
+    {
+        do
+        {
+            digits [ count++ ] = digitChars [ magnitude & 0x0F ];
+            magnitude >>= 4;
+        } while ( magnitude != 0 );
+    }
+
+    const int padding = width - count - ( negative ? 1 : 0 );
+    if ( !leftAlign && ( pad != '0' ) )
+    {
+        out.repeat ( ' ', padding );
+    }
+    if ( negative )
+    {
+        out.put ( '-' );
+    }
+    if ( !leftAlign && ( pad == '0' ) )
+    {
+        out.repeat ( '0', padding );
+    }
+    while ( count > 0 )
+    {
+        out.put ( digits [ --count ] );
+    }
+    if ( leftAlign )
+    {
+        out.repeat ( ' ', padding );
+    }
+}
+
+static inline uint32_t magnitudeOf ( const int32_t value )
+{
+    return ( value < 0 ) ? ( 0u - (uint32_t) value ) : (uint32_t) value;
+}
+
+int Format::unsignedValue ( char * buffer, const int size, const uint32_t value, const int width, const char pad, const int base )
+{
+    FormatOutput out = { buffer, size, 0 };
+    putNumber ( out, value, false, width, pad, false, ( base == 16 ) ? 16 : 10, false );
+    return out.finish ();
+}
+
+int Format::integer ( char * buffer, const int size, const int32_t value, const int width, const char pad )
+{
+    FormatOutput out = { buffer, size, 0 };
+    putNumber ( out, magnitudeOf ( value ), value < 0, width, pad, false, 10, false );
+    return out.finish ();
+}
+
+int Format::decimal ( char * buffer, const int size, const int32_t value, const int decimals )
+{
+    FormatOutput out = { buffer, size, 0 };
+    uint32_t scale = 1;
+    for ( int i = 0; i < decimals; i++ )
+    {
+        scale *= 10;
+    }
+
+    const uint32_t magnitude = magnitudeOf ( value );
+    if ( value < 0 )
+    {
+        out.put ( '-' );
+    }
+    putNumber ( out, magnitude / scale, false, 0, ' ', false, 10, false );
+    if ( decimals > 0 )
+    {
+        out.put ( '.' );
+        putNumber ( out, magnitude % scale, false, decimals, '0', false, 10, false );
+    }
+    return out.finish ();
+}
+
+int Format::print ( char * buffer, const int size, const char * format, ... )
+{
+    va_list args;
+    va_start ( args, format );
+    int length = vprint ( buffer, size, format, args );
+    va_end ( args );
+    return length;
+}
+
+int Format::vprint ( char * buffer, const int size, const char * format, va_list args )
+{
+    FormatOutput out = { buffer, size, 0 };
+
+    while ( *format != '\0' )
+    {
+        if ( *format != '%' )
+        {
+            const char * literal = format;
+            while ( ( *format != '%' ) && ( *format != '\0' ) )
+            {
+                format++;
+            }
+            out.append ( literal, format - literal );
+            continue;
+        }
+        const char * conversionStart = format++;
+
+        bool leftAlign = false;
+        char pad = ' ';
+        for ( ;; format++ )
+        {
+            if ( *format == '-' )
+            {
+                leftAlign = true;
+            }
+            else if ( *format == '0' )
+            {
+                pad = '0';
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        int width = 0;
+        if ( *format == '*' )
+        {
+            width = va_arg( args, int );
+            format++;
+        }
+        while ( ( *format >= '0' ) && ( *format <= '9' ) )
+        {
+            width = ( width * 10 ) + ( *format++ - '0' );
+        }
+
+        int precision = -1;
+        if ( *format == '.' )
+        {
+            format++;
+            precision = 0;
+            if ( *format == '*' )
+            {
+                precision = va_arg( args, int );
+                format++;
+            }
+            while ( ( *format >= '0' ) && ( *format <= '9' ) )
+            {
+                precision = ( precision * 10 ) + ( *format++ - '0' );
+            }
+        }
+
+        bool isLong = false;
+        while ( ( *format == 'l' ) || ( *format == 'h' ) )
+        {
+            isLong = isLong || ( *format == 'l' );
+            format++;
+        }
+
+        switch ( *format )
+        {
+            case 'd':
+            case 'i':
+            {
+                int32_t value = isLong ? (int32_t) va_arg( args, long ) : (int32_t) va_arg( args, int );
+                putNumber ( out, magnitudeOf ( value ), value < 0, width, pad, leftAlign, 10, false );
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            {
+                uint32_t value = isLong ? (uint32_t) va_arg( args, unsigned long ) : (uint32_t) va_arg( args, unsigned int );
+                putNumber ( out, value, false, width, pad, leftAlign, ( *format == 'u' ) ? 10 : 16, *format == 'X' );
+                break;
+            }
+            case 'p':
+            {
+                out.put ( '0' );
+                out.put ( 'x' );
+                putNumber ( out, (uint32_t) (uintptr_t) va_arg( args, void * ), false, 8, '0', false, 16, false );
+                break;
+            }
+            case 'c':
+            {
+                if ( !leftAlign )
+                {
+                    out.repeat ( ' ', width - 1 );
+                }
+                out.put ( (char) va_arg( args, int ) );
+                if ( leftAlign )
+                {
+                    out.repeat ( ' ', width - 1 );
+                }
+                break;
+            }
+            case 's':
+            {
+                const char * text = va_arg( args, const char * );
+                if ( text == NULL )
+                {
+                    text = "(null)";
+                }
+                int length = 0;
+                while ( ( text [ length ] != '\0' ) && ( ( precision < 0 ) || ( length < precision ) ) )
+                {
+                    length++;
+                }
+                if ( !leftAlign )
+                {
+                    out.repeat ( ' ', width - length );
+                }
+                out.append ( text, length );
+                if ( leftAlign )
+                {
+                    out.repeat ( ' ', width - length );
+                }
+                break;
+            }
+            case '%':
+                out.put ( '%' );
+                break;
+            default:
+                // Not supported, copy the conversion as it is
+                while ( conversionStart != format )
+                {
+                    out.put ( *conversionStart++ );
+                }
+                if ( *format == '\0' )
+                {
+                    return out.finish ();
+                }
+                out.put ( *format );
+                break;
+        }
+        format++;
+    }
+
+    return out.finish ();
+}
+
+int Format::parseInteger ( const char * text, const int length, int32_t & value )
+{
+    int i = 0;
+    bool negative = false;
+    value = 0;
+
+    if ( ( i < length ) && ( ( text [ i ] == '-' ) || ( text [ i ] == '+' ) ) )
+    {
+        negative = ( text [ i ] == '-' );
+        i++;
+    }
+
+    const int digitsStart = i;
+    const uint32_t limit = negative ? 0x80000000u : 0x7FFFFFFFu;
+    uint32_t magnitude = 0;
+    while ( ( i < length ) && ( text [ i ] >= '0' ) && ( text [ i ] <= '9' ) )
+    {
+        uint32_t digit = text [ i ] - '0';
+        magnitude = ( magnitude > ( ( limit - digit ) / 10 ) ) ? limit : ( ( magnitude * 10 ) + digit );
+        i++;
+    }
+
+    if ( i == digitsStart )
+    {
+        return 0;
+    }
+    value = negative ? (int32_t) ( 0u - magnitude ) : (int32_t) magnitude;
+    return i;
+}
+
+/**
+ * 10^exponent for 0 <= exponent < 64, by squaring
+ */
+static float powerOfTen ( int exponent )
+{
+    static const float powers [] = { 1e1f, 1e2f, 1e4f, 1e8f, 1e16f, 1e32f };
+    float result = 1.0f;
+    for ( unsigned int bit = 0; ( exponent != 0 ) && ( bit < ( sizeof ( powers ) / sizeof ( powers [ 0 ] ) ) ); bit++, exponent >>= 1 )
+    {
+        if ( exponent & 1 )
+        {
+            result *= powers [ bit ];
+        }
+    }
+    return result;
+}
+
+int Format::parseDecimal ( const char * text, const int length, float & value )
+{
+    int i = 0;
+    bool negative = false;
+    value = 0.0f;
+
+    if ( ( i < length ) && ( ( text [ i ] == '-' ) || ( text [ i ] == '+' ) ) )
+    {
+        negative = ( text [ i ] == '-' );
+        i++;
+    }
+
+    uint32_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    int digitCount = 0;
+
+    while ( ( i < length ) && ( text [ i ] >= '0' ) && ( text [ i ] <= '9' ) )
+    {
+        if ( significant < FORMAT_MAX_SIGNIFICANT )
+        {
+            mantissa = ( mantissa * 10 ) + ( text [ i ] - '0' );
+            significant += ( mantissa != 0 ) ? 1 : 0;
+        }
+        else
+        {
+            exponent++; // digits beyond the mantissa only scale it
+        }
+        digitCount++;
+        i++;
+    }
+
+    if ( ( i < length ) && ( text [ i ] == '.' ) )
+    {
+        i++;
+        while ( ( i < length ) && ( text [ i ] >= '0' ) && ( text [ i ] <= '9' ) )
+        {
+            if ( significant < FORMAT_MAX_SIGNIFICANT )
+            {
+                mantissa = ( mantissa * 10 ) + ( text [ i ] - '0' );
+                significant += ( mantissa != 0 ) ? 1 : 0;
+                exponent--;
+            }
+            digitCount++;
+            i++;
+        }
+    }
+
+    if ( digitCount == 0 )
+    {
+        return 0;
+    }
+
+    if ( ( i < length ) && ( ( text [ i ] == 'e' ) || ( text [ i ] == 'E' ) ) )
+    {
+        int32_t exponentValue;
+        int used = parseInteger ( text + i + 1, length - i - 1, exponentValue );
+        if ( used > 0 )
+        {
+            exponent += ( exponentValue > 100 ) ? 100 : ( ( exponentValue < -100 ) ? -100 : exponentValue );
+            i += 1 + used;
+        }
+    }
+
+    float result = (float) mantissa;
+    if ( exponent > 0 )
+    {
+        result *= powerOfTen ( exponent > 63 ? 63 : exponent );
+    }
+    else if ( exponent < 0 )
+    {
+        // Two steps keep 10^-45 .. 10^-38 out of the denormals as long as possible
+        int down = -exponent;
+        if ( down > 38 )
+        {
+            result /= powerOfTen ( down - 38 );
+            down = 38;
+        }
+        result /= powerOfTen ( down );
+    }
+
+    value = negative ? -result : result;
+    return i;
+}
@@ -0,0 +1,67 @@
+#ifndef BARVIS_FORMAT_H_
+#define BARVIS_FORMAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+/**
+ * Allocation free number formatting and parsing, instead of the libc
+ * printf / atoi / atof family.
+ *
+ * Every writer takes the buffer size, never writes past it, always
+ * terminates the output ( unless size is 0 ) and returns the length the
+ * output would have had, like snprintf.  The parsers work on length
+ * bounded spans, e.g. JSON tokens that aren't terminated, and return the
+ * number of characters used, 0 if there was no number at all.
+ *
+ * Nothing here depends on mbed, host builds ( see Profile ) use it as well.
+ */
+// Keeps the compiler's printf argument checks on Format::print
+#ifdef __GNUC__
+#define FORMAT_PRINTF_CHECK     __attribute__ ( ( format ( printf, 3, 4 ) ) )
+#else
+#define FORMAT_PRINTF_CHECK
+#endif
+
+class Format
+{
+    private:
+        Format ();
+
+    public:
+        /**
+         * value in base 10 or 16, at least width characters, padded on the
+         * left with pad ( ' ' or '0' )
+         */
+        static int unsignedValue ( char * buffer, const int size, const uint32_t value, const int width = 0, const char pad = ' ', const int base = 10 );
+        static int integer ( char * buffer, const int size, const int32_t value, const int width = 0, const char pad = ' ' );
+
+        /**
+         * value / 10^decimals with exactly decimals fraction digits, e.g.
+         * ( 1234, 3 ) is "1.234" and ( -5, 2 ) "-0.05"
+         */
+        static int decimal ( char * buffer, const int size, const int32_t value, const int decimals );
+
+        /**
+         * snprintf for the subset the firmware uses: %d %i %u %x %X %c %s %p
+         * and %%, the flags '-' and '0', a field width, a precision for %s
+         * ( also .* ) and the l length modifier.  No floating point.
+         */
+        static int print ( char * buffer, const int size, const char * format, ... ) FORMAT_PRINTF_CHECK;
+        static int vprint ( char * buffer, const int size, const char * format, va_list args );
+
+        /**
+         * Optional sign and decimal digits, what atoi accepts minus the
+         * leading white space.  Saturates instead of overflowing.
+         */
+        static int parseInteger ( const char * text, const int length, int32_t & value );
+
+        /**
+         * Optional sign, digits, fraction and exponent, what atof accepts
+         * minus the leading white space, inf and nan.
+         */
+        static int parseDecimal ( const char * text, const int length, float & value );
+};
+
+#endif
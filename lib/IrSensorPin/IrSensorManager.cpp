@@ -0,0 +1,129 @@
+#include <new>
+#include "IrSensorManager.h"
+
+IrSensorManager::IrSensorManager ( const PinName * pinNames, const int count )
+        : pinCount ( ( count < IR_SENSOR_MANAGER_MAX_PINS ) ? count : IR_SENSOR_MANAGER_MAX_PINS )
+{
+    listenerCount = 0;
+    edgeCount = 0;
+    eventCount = 0;
+
+    uint32_t now = us_ticker_read ();
+    for ( int i = 0; i < pinCount; i++ )
+    {
+        sensors [ i ].lastEdgeTime = now;
+        sensors [ i ].stableValue = false;
+        sensors [ i ].reported = false;
+        sensors [ i ].delivering = false;
+        sensors [ i ].lostMeanwhile = false;
+        pins [ i ] = new ( pinStorage [ i ] ) IrSensorPin ( pinNames [ i ], i, this ); // in place, no heap
+    }
+}
+
+IrSensorManager::IrSensorManager ( const IrSensorManager &other )
+        : pinCount ( 0 )
+{
+    listenerCount = 0;
+    edgeCount = 0;
+    eventCount = 0;
+}
+
+IrSensorManager::~IrSensorManager ()
+{
+    for ( int i = 0; i < pinCount; i++ )
+    {
+        pins [ i ]->~IrSensorPin ();
+    }
+}
+
+bool IrSensorManager::addListener ( IrSensorListener * listener )
+{
+    if ( listenerCount >= IR_SENSOR_MANAGER_MAX_LISTENERS )
+    {
+        return false;
+    }
+    listeners [ listenerCount++ ] = listener;
+    return true;
+}
+
+void IrSensorManager::pinStateChanged ( const PinName pin, const int pinId, const bool pinValue )
+{
+    SensorState &sensor = sensors [ pinId ];
+    sensor.lastEdgeTime = us_ticker_read ();
+    edgeCount++;
+    TRACE( TraceSensorEdge, pinId, pinValue );
+
+    if ( pinValue || !sensor.reported || !sensor.stableValue )
+    {
+        return; // the level is sampled again once it settled
+    }
+
+    // The cup is going away, don't wait for the beam to settle
+    sensor.stableValue = false;
+    if ( sensor.delivering )
+    {
+        sensor.lostMeanwhile = true; // process () reports it after its own event
+        return;
+    }
+    deliver ( pinId, false );
+}
+
+void IrSensorManager::deliver ( const int pinId, const bool value )
+{
+    __disable_irq ();
+    eventCount++;
+    __enable_irq ();
+    TRACE( TraceSensorChange, pinId, value );
+    for ( int l = 0; l < listenerCount; l++ )
+    {
+        listeners [ l ]->pinStateChanged ( NC, pinId, value );
+    }
+}
+
+void IrSensorManager::process ()
+{
+    uint32_t now = us_ticker_read ();
+
+    for ( int i = 0; i < pinCount; i++ )
+    {
+        SensorState &sensor = sensors [ i ];
+        const unsigned int edgesBefore = edgeCount;
+        bool value = pins [ i ]->isHigh ();
+
+        if ( sensor.reported && ( value == sensor.stableValue ) )
+        {
+            continue;
+        }
+
+        uint32_t settleTime = ( value ? IR_SENSOR_RETURN_SETTLE_MS : IR_SENSOR_SETTLE_MS ) * 1000;
+        if ( sensor.reported && ( ( now - sensor.lastEdgeTime ) < settleTime ) )
+        {
+            continue; // still bouncing, or not held long enough yet
+        }
+
+        // The pin interrupt may lose the cup again while the listeners run,
+        // it leaves that event to us so the order of the two holds
+        __disable_irq ();
+        if ( edgeCount != edgesBefore )
+        {
+            __enable_irq ();
+            continue; // value may be stale already, look again next time
+        }
+        sensor.stableValue = value;
+        sensor.reported = true;
+        sensor.delivering = true;
+        __enable_irq ();
+
+        deliver ( i, value );
+
+        __disable_irq ();
+        sensor.delivering = false;
+        const bool lost = sensor.lostMeanwhile;
+        sensor.lostMeanwhile = false;
+        __enable_irq ();
+        if ( lost )
+        {
+            deliver ( i, false );
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef __IR_SENSOR_MANAGER_H
+#define __IR_SENSOR_MANAGER_H
+
+#include "mbed.h"
+#include "IrSensorPin.h"
+#include "Trace.h"
+
+#define IR_SENSOR_MANAGER_MAX_PINS          8
+#define IR_SENSOR_MANAGER_MAX_LISTENERS     2
+
+// Losing a cup is reported on its first edge.  Anything else has to hold
+// this long after the last edge before it is reported, and a cup coming
+// back after it was lost longer still, so a flickering beam pauses a pour
+// once instead of toggling the pumps ( hysteresis ).
+#define IR_SENSOR_SETTLE_MS                 50
+#define IR_SENSOR_RETURN_SETTLE_MS          300
+
+/**
+ * Debounced cup sensor array, one pinStateChanged event per real change,
+ * pinId of the events is the index into the pin table.
+ *
+ * A cup that goes away is reported right from the pin interrupt, so the
+ * pumps pause on the first edge.  Every other change is only timestamped
+ * by the interrupt and reported by process () ( called from the main loop )
+ * once the level settled, from main context.  Listeners have to take the
+ * absent event in interrupt context.
+ */
+class IrSensorManager : public IrSensorListener
+{
+    private:
+        struct SensorState
+        {
+                volatile uint32_t lastEdgeTime;
+                volatile bool stableValue;
+                volatile bool reported;
+                volatile bool delivering;    // process () is reporting it
+                volatile bool lostMeanwhile; // an absent edge came in meanwhile
+        };
+
+        const int pinCount;
+        IrSensorPin * pins [ IR_SENSOR_MANAGER_MAX_PINS ];
+        uint32_t pinStorage [ IR_SENSOR_MANAGER_MAX_PINS ] [ ( sizeof(IrSensorPin) + sizeof(uint32_t) - 1 ) / sizeof(uint32_t) ];
+        SensorState sensors [ IR_SENSOR_MANAGER_MAX_PINS ];
+
+        IrSensorListener * listeners [ IR_SENSOR_MANAGER_MAX_LISTENERS ];
+        int listenerCount;
+
+        volatile unsigned int edgeCount;
+        volatile unsigned int eventCount;
+
+        IrSensorManager ( const IrSensorManager &other ); // Don't allow copying at all
+
+        void deliver ( const int pinId, const bool value );
+
+    public:
+        /**
+         * @param pinNames table of count ( at most IR_SENSOR_MANAGER_MAX_PINS ) pins
+         */
+        IrSensorManager ( const PinName * pinNames, const int count );
+        virtual ~IrSensorManager ();
+
+        bool addListener ( IrSensorListener * listener );
+        void process ();
+
+        // Raw edge, interrupt context, reports a lost cup right away
+        virtual void pinStateChanged ( const PinName pin, const int pinId, const bool pinValue );
+
+        inline int getPinCount () const;
+        inline bool isPresent ( const int pinId ) const;
+        inline unsigned int getEdgeCount () const;
+        inline unsigned int getEventCount () const;
+};
+
+inline int IrSensorManager::getPinCount () const
+{
+    return pinCount;
+}
+
+inline bool IrSensorManager::isPresent ( const int pinId ) const
+{
+    return sensors [ pinId ].stableValue;
+}
+
+/**
+ * Raw edges seen by the interrupts, bounces included
+ */
+inline unsigned int IrSensorManager::getEdgeCount () const
+{
+    return edgeCount;
+}
+
+/**
+ * Debounced events delivered to the listeners
+ */
+inline unsigned int IrSensorManager::getEventCount () const
+{
+    return eventCount;
+}
+
+#endif
@@ -6,6 +6,7 @@ IrSensorPin::IrSensorPin ( const PinName _pinName, const int _pinId, IrSensorLis
 {
     mode ( PullUp );
     fall ( this, &IrSensorPin::pinStateChanged );
+    rise ( this, &IrSensorPin::pinStateChanged );
 }
 
 IrSensorPin::IrSensorPin ( const IrSensorPin &other )
@@ -25,10 +26,3 @@ void IrSensorPin::pinStateChanged ()
         listener->pinStateChanged ( pinName, pinId, pinValue );
     }
 }
-
-/*
- template<typename T> void rise(T* tptr, void (T::*mptr)(void)) {
- _rise.attach(tptr, mptr);
- gpio_irq_set(&gpio_irq, IRQ_RISE, 1);
- }
- */
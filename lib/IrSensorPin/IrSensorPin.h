@@ -24,8 +24,20 @@ class IrSensorPin : private InterruptIn
         void pinStateChanged ();
 
     public:
+        /**
+         * The listener is called from interrupt context on every rising and
+         * falling edge, bounces included.  Use IrSensorManager for debounced
+         * events in main context.
+         */
         IrSensorPin ( const PinName _pinName, const int _pinId, IrSensorListener * _listener = NULL );
         virtual ~IrSensorPin ();
+
+        inline bool isHigh ();
 };
 
+inline bool IrSensorPin::isHigh ()
+{
+    return ( read () == 1 );
+}
+
 #endif
@@ -1,18 +1,20 @@
 #include "Json.h"
+#include "Format.h"
 
-Json::Json ( const char * jsonString, size_t length )
-        : source ( jsonString ), sourceLength ( length )
+Json::Json ( const char * jsonString, size_t length, jsmntok_t * tokenStorage, int tokenCapacity )
+        : source ( jsonString ), sourceLength ( length ), ownsTokens ( tokenStorage == NULL )
 {
+    PROFILE_SCOPE ( "Json" );
     jsmn_parser parser;
-    int count = 100; //jsmn_parse ( &parser, jsonString, length, NULL, 16384 );
-    tokens = new jsmntok_t [ count ];
+    int count = ownsTokens ? JSON_MAX_TOKENS : tokenCapacity; //jsmn_parse ( &parser, jsonString, length, NULL, 16384 );
+    tokens = ownsTokens ? new jsmntok_t [ count ] : tokenStorage;
 
     jsmn_init ( &parser );
     tokenCount = jsmn_parse ( &parser, jsonString, length, tokens, count );
 }
 
 Json::Json ( const Json & other )
-        : source ( NULL ), sourceLength ( 0 )
+        : source ( NULL ), sourceLength ( 0 ), ownsTokens ( false )
 {
     tokenCount = 0;
     tokens = NULL;
@@ -20,7 +22,10 @@ Json::Json ( const Json & other )
 
 Json::~Json ()
 {
-    delete [] tokens;
+    if ( ownsTokens )
+    {
+        delete [] tokens;
+    }
 }
 
 int Json::findKeyIndexIn ( const char * key, const int &parentIndex ) const
@@ -96,12 +101,13 @@ int Json::tokenIntegerValue ( const int tokenIndex ) const
     if ( type ( tokenIndex ) == JSMN_PRIMITIVE )
     {
         int len = tokenLength ( tokenIndex );
-        char * tok = new char [ len + 1 ];
-        strncpy ( tok, tokenAddress ( tokenIndex ), len );
-        tok [ len ] = 0;
-        int retVal = atoi ( tok );
-        delete [] tok;
-        return retVal;
+        if ( len > JSON_MAX_PRIMITIVE_LENGTH )
+        {
+            len = JSON_MAX_PRIMITIVE_LENGTH;
+        }
+        int32_t value;
+        Format::parseInteger ( tokenAddress ( tokenIndex ), len, value ); // straight from the source, 0 if it isn't a number
+        return value;
     }
     return -1;
 }
@@ -111,12 +117,13 @@ float Json::tokenNumberValue ( const int tokenIndex ) const
     if ( type ( tokenIndex ) == JSMN_PRIMITIVE )
     {
         int len = tokenLength ( tokenIndex );
-        char * tok = new char [ len + 1 ];
-        strncpy ( tok, tokenAddress ( tokenIndex ), len );
-        tok [ len ] = 0;
-        float retVal = atof ( tok );
-        delete [] tok;
-        return retVal;
+        if ( len > JSON_MAX_PRIMITIVE_LENGTH )
+        {
+            len = JSON_MAX_PRIMITIVE_LENGTH;
+        }
+        float value;
+        Format::parseDecimal ( tokenAddress ( tokenIndex ), len, value );
+        return value;
     }
     return -1;
 }
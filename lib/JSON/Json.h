@@ -2,9 +2,13 @@
 #define __JSON_LIB_CLASS_H_
 
 #include "jsmn.h"
+#include "Profile.h"
 #include <stdlib.h>
 #include <string.h>
 
+#define JSON_MAX_TOKENS             100
+#define JSON_MAX_PRIMITIVE_LENGTH   32
+
 /*
  JSON wrapper over JSMN lib
  */
@@ -15,11 +19,16 @@ class Json
         const char * source;
         const size_t sourceLength;
         jsmntok_t * tokens;
+        const bool ownsTokens;
         int tokenCount;
         Json ( const Json & other );
 
     public:
-        Json ( const char * jsonString, size_t length );
+        /**
+         * tokenStorage: optional caller owned array of tokenCapacity tokens,
+         * JSON_MAX_TOKENS tokens are allocated on the heap when NULL.
+         */
+        Json ( const char * jsonString, size_t length, jsmntok_t * tokenStorage = NULL, int tokenCapacity = JSON_MAX_TOKENS );
         virtual ~Json ();
 
         int findKeyIndexIn ( const char * key, const int &parentIndex ) const;
@@ -27,6 +36,7 @@ class Json
         bool matches ( const int & tokenIndex, const char * value ) const;
 
         inline bool isValidJson () const;
+        inline int getTokenCount () const;
         inline jsmntype_t type ( const int tokenIndex ) const;
         inline int parent ( const int tokenIndex ) const;
         inline int childCount ( const int tokenIndex ) const;
@@ -46,6 +56,14 @@ inline bool Json::isValidJson () const
     return ( tokenCount >= 1 );
 }
 
+/**
+ * @return the jsmn_parse result, the number of tokens or a negative jsmnerr
+ */
+inline int Json::getTokenCount () const
+{
+    return tokenCount;
+}
+
 inline jsmntype_t Json::type ( const int tokenIndex ) const
 {
     return tokens [ tokenIndex ].type;
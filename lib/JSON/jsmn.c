@@ -1,4 +1,161 @@
 #include "jsmn.h"
+#include <stdint.h>
+#include <string.h>
+
+/*
+ String bodies and whitespace runs are scanned a 32 bit word at a time
+ ( SWAR ).  The scans stop exactly at the first byte the byte wise loop has
+ to look at, so tokens, the returned count and where a failing parse stops
+ are those of the byte wise loop.  The json_corpus host test holds that.
+
+ Host builds with SSE2 or NEON ( a gateway, the host tests ) scan 16 bytes
+ at a time first, the words only take the tail.  JSMN_NO_VECTOR keeps them
+ on the words the Teensy runs, json_corpus_swar tests those on the host.
+ */
+#define JSMN_ONES       0x01010101UL
+#define JSMN_HIGHS      0x80808080UL
+#define JSMN_LOWS       0x7F7F7F7FUL
+
+/* 0x80 in exactly those bytes of word that equal c, 0 in all others */
+#define JSMN_BYTES_EQUAL(word, c)   ( ~( ( ( ( ( word ) ^ ( JSMN_ONES * ( c ) ) ) & JSMN_LOWS ) + JSMN_LOWS ) | ( ( word ) ^ ( JSMN_ONES * ( c ) ) ) | JSMN_LOWS ) & JSMN_HIGHS )
+
+/* Offset of the first byte in memory flagged with 0x80, mask must not be 0 */
+#if defined ( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+#define JSMN_FIRST_FLAGGED(mask)    ( __builtin_clz ( mask ) >> 3 )
+#else
+#define JSMN_FIRST_FLAGGED(mask)    ( __builtin_ctz ( mask ) >> 3 )
+#endif
+
+static uint32_t jsmn_load_word ( const char *js )
+{
+    uint32_t word;
+    memcpy ( &word, js, sizeof ( word ) ); /* a single unaligned load on the M4 */
+    return word;
+}
+
+#if !defined ( JSMN_NO_VECTOR ) && defined ( __SSE2__ )
+#include <emmintrin.h>
+#define JSMN_VECTOR_BYTES   16
+typedef unsigned int jsmn_vector_mask;
+
+/* Bit i set for byte i of the 16 at js that is a quote, a backslash or 0 */
+static jsmn_vector_mask jsmn_vector_string_stops ( const char *js )
+{
+    __m128i bytes = _mm_loadu_si128 ( ( const __m128i * ) js );
+    __m128i stop = _mm_or_si128 ( _mm_or_si128 ( _mm_cmpeq_epi8 ( bytes, _mm_set1_epi8 ( '\"' ) ), _mm_cmpeq_epi8 ( bytes, _mm_set1_epi8 ( '\\' ) ) ),
+            _mm_cmpeq_epi8 ( bytes, _mm_setzero_si128 () ) );
+    return ( unsigned int ) _mm_movemask_epi8 ( stop );
+}
+
+/* Bit i set for byte i of the 16 at js that isn't whitespace */
+static jsmn_vector_mask jsmn_vector_non_blanks ( const char *js )
+{
+    __m128i bytes = _mm_loadu_si128 ( ( const __m128i * ) js );
+    __m128i blank = _mm_or_si128 ( _mm_or_si128 ( _mm_cmpeq_epi8 ( bytes, _mm_set1_epi8 ( ' ' ) ), _mm_cmpeq_epi8 ( bytes, _mm_set1_epi8 ( '\n' ) ) ),
+            _mm_or_si128 ( _mm_cmpeq_epi8 ( bytes, _mm_set1_epi8 ( '\r' ) ), _mm_cmpeq_epi8 ( bytes, _mm_set1_epi8 ( '\t' ) ) ) );
+    return ~( unsigned int ) _mm_movemask_epi8 ( blank ) & 0xFFFFU;
+}
+
+/* Offset of the first byte flagged by the above, mask must not be 0 */
+#define JSMN_VECTOR_FIRST(mask)     ( ( unsigned int ) __builtin_ctz ( mask ) )
+
+#elif !defined ( JSMN_NO_VECTOR ) && defined ( __ARM_NEON ) && !( defined ( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ ) )
+#include <arm_neon.h>
+#define JSMN_VECTOR_BYTES   16
+typedef uint64_t jsmn_vector_mask;
+
+/* NEON has no movemask, narrowing the 0xFF / 0 compare bytes by 4 bits
+   leaves a nibble per byte, in memory order from the low end */
+static jsmn_vector_mask jsmn_vector_nibbles ( uint8x16_t flagged )
+{
+    return vget_lane_u64 ( vreinterpret_u64_u8 ( vshrn_n_u16 ( vreinterpretq_u16_u8 ( flagged ), 4 ) ), 0 );
+}
+
+/* A nibble set for byte i of the 16 at js that is a quote, a backslash or 0 */
+static jsmn_vector_mask jsmn_vector_string_stops ( const char *js )
+{
+    uint8x16_t bytes = vld1q_u8 ( ( const uint8_t * ) js );
+    uint8x16_t stop = vorrq_u8 ( vorrq_u8 ( vceqq_u8 ( bytes, vdupq_n_u8 ( '\"' ) ), vceqq_u8 ( bytes, vdupq_n_u8 ( '\\' ) ) ), vceqq_u8 ( bytes, vdupq_n_u8 ( 0 ) ) );
+    return jsmn_vector_nibbles ( stop );
+}
+
+/* A nibble set for byte i of the 16 at js that isn't whitespace */
+static jsmn_vector_mask jsmn_vector_non_blanks ( const char *js )
+{
+    uint8x16_t bytes = vld1q_u8 ( ( const uint8_t * ) js );
+    uint8x16_t blank = vorrq_u8 ( vorrq_u8 ( vceqq_u8 ( bytes, vdupq_n_u8 ( ' ' ) ), vceqq_u8 ( bytes, vdupq_n_u8 ( '\n' ) ) ),
+            vorrq_u8 ( vceqq_u8 ( bytes, vdupq_n_u8 ( '\r' ) ), vceqq_u8 ( bytes, vdupq_n_u8 ( '\t' ) ) ) );
+    return jsmn_vector_nibbles ( vmvnq_u8 ( blank ) );
+}
+
+/* Offset of the first byte flagged by the above, mask must not be 0 */
+#define JSMN_VECTOR_FIRST(mask)     ( ( unsigned int ) __builtin_ctzll ( mask ) >> 2 )
+#endif
+
+/**
+ * @return the first position from pos on holding a quote, a backslash or
+ * the terminator, or less than 4 bytes before len.
+ */
+static unsigned int jsmn_skip_string_body ( const char *js, size_t len, unsigned int pos )
+{
+#ifdef JSMN_VECTOR_BYTES
+    while ( pos + JSMN_VECTOR_BYTES <= len )
+    {
+        jsmn_vector_mask stop = jsmn_vector_string_stops ( js + pos );
+        if ( stop != 0 )
+        {
+            return pos + JSMN_VECTOR_FIRST ( stop );
+        }
+        pos += JSMN_VECTOR_BYTES;
+    }
+#endif
+    while ( pos + 4 <= len )
+    {
+        uint32_t word = jsmn_load_word ( js + pos );
+        uint32_t stop = JSMN_BYTES_EQUAL ( word, '\"' ) | JSMN_BYTES_EQUAL ( word, '\\' ) | JSMN_BYTES_EQUAL ( word, '\0' );
+        if ( stop != 0 )
+        {
+            return pos + JSMN_FIRST_FLAGGED ( stop );
+        }
+        pos += 4;
+    }
+    return pos;
+}
+
+/**
+ * @return the first position from pos on that isn't whitespace, or less
+ * than 4 bytes before len.  Single blanks, as in "key": value, don't pay
+ * for a word.
+ */
+static unsigned int jsmn_skip_whitespace ( const char *js, size_t len, unsigned int pos )
+{
+    if ( pos >= len || js [ pos ] != ' ' )
+    {
+        return pos;
+    }
+#ifdef JSMN_VECTOR_BYTES
+    while ( pos + JSMN_VECTOR_BYTES <= len )
+    {
+        jsmn_vector_mask other = jsmn_vector_non_blanks ( js + pos );
+        if ( other != 0 )
+        {
+            return pos + JSMN_VECTOR_FIRST ( other );
+        }
+        pos += JSMN_VECTOR_BYTES;
+    }
+#endif
+    while ( pos + 4 <= len )
+    {
+        uint32_t word = jsmn_load_word ( js + pos );
+        uint32_t other = ~( JSMN_BYTES_EQUAL ( word, ' ' ) | JSMN_BYTES_EQUAL ( word, '\n' ) | JSMN_BYTES_EQUAL ( word, '\r' ) | JSMN_BYTES_EQUAL ( word, '\t' ) ) & JSMN_HIGHS;
+        if ( other != 0 )
+        {
+            return pos + JSMN_FIRST_FLAGGED ( other );
+        }
+        pos += 4;
+    }
+    return pos;
+}
 
 /**
  * Allocates a fresh unused token from the token pull.
@@ -160,6 +317,11 @@ static int jsmn_parse_string ( jsmn_parser *parser, const char *js, size_t len,
                     return JSMN_ERROR_INVAL;
             }
         }
+        else if ( c != '\\' )
+        {
+            /* Plain character, skip the plain ones after it by the word */
+            parser->pos = jsmn_skip_string_body ( js, len, parser->pos + 1 ) - 1;
+        }
     }
     parser->pos = start;
     return JSMN_ERROR_PART;
@@ -249,6 +411,7 @@ int jsmn_parse ( jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tok
             case '\r':
             case '\n':
             case ' ':
+                parser->pos = jsmn_skip_whitespace ( js, len, parser->pos + 1 ) - 1;
                 break;
             case ':':
                 isKey = 0;
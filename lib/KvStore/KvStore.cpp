@@ -0,0 +1,433 @@
+#include "KvStore.h"
+#include <string.h>
+
+#define KV_BANK_MAGIC               0x4B56 // "KV"
+#define KV_BANK_HEADER_SIZE         6      // magic ( 2 ), generation ( 2 ), crc ( 2 )
+#define KV_RECORD_HEADER_SIZE       4      // key ( 1 ), length ( 1 ), crc ( 2 )
+#define KV_END_OF_LOG               0xFF
+#define KV_COMPACT_STALE_PERCENT    25     // don't compact for less than this much to gain
+#define KV_CRC_CHUNK                32
+
+// CRC-16/CCITT-FALSE, bitwise as it only runs on mount and on writes
+static uint16_t crc16 ( uint16_t crc, const void * data, const unsigned int length )
+{
+    const uint8_t * bytes = ( const uint8_t * ) data;
+    for ( unsigned int i = 0; i < length; i++ )
+    {
+        crc ^= ( uint16_t ) ( bytes [ i ] << 8 );
+        for ( int bit = 0; bit < 8; bit++ )
+        {
+            crc = ( crc & 0x8000 ) ? ( uint16_t ) ( ( crc << 1 ) ^ 0x1021 ) : ( uint16_t ) ( crc << 1 );
+        }
+    }
+    return crc;
+}
+
+static uint16_t recordCrcStart ( const uint16_t generation, const uint8_t key, const uint8_t length )
+{
+    const uint8_t prefix [ 4 ] = { ( uint8_t ) generation, ( uint8_t ) ( generation >> 8 ), key, length };
+    return crc16 ( 0xFFFF, prefix, sizeof ( prefix ) );
+}
+
+KvStore::KvStore ( NonVolatileStorage * _storage, const unsigned int _baseAddress, const unsigned int regionSize )
+        : storage ( _storage ), baseAddress ( _baseAddress ), bankSize ( regionSize / 2 )
+{
+    mounted = false;
+    activeBank = 0;
+    generation = 0;
+    appendOffset = KV_BANK_HEADER_SIZE;
+    compacting = false;
+    compactKey = 0;
+    compactOffset = KV_BANK_HEADER_SIZE;
+    compactionCount = 0;
+    for ( unsigned int i = 0; i < KV_STORE_MAX_KEYS; i++ )
+    {
+        index [ i ] = KV_STORE_NO_RECORD;
+        compactIndex [ i ] = KV_STORE_NO_RECORD;
+    }
+}
+
+KvStore::KvStore ( const KvStore &other )
+        : storage ( NULL ), baseAddress ( 0 ), bankSize ( 0 )
+{
+    mounted = false;
+    activeBank = 0;
+    generation = 0;
+    appendOffset = 0;
+    compacting = false;
+    compactKey = 0;
+    compactOffset = 0;
+    compactionCount = 0;
+}
+
+unsigned int KvStore::bankAddress ( const unsigned int bank ) const
+{
+    return baseAddress + ( bank * bankSize );
+}
+
+bool KvStore::readHeader ( const unsigned int bank, uint16_t &headerGeneration ) const
+{
+    uint8_t header [ KV_BANK_HEADER_SIZE ];
+    if ( !storage->read ( bankAddress ( bank ), header, KV_BANK_HEADER_SIZE ) )
+    {
+        return false;
+    }
+
+    const uint16_t magic = header [ 0 ] | ( header [ 1 ] << 8 );
+    const uint16_t crc = header [ 4 ] | ( header [ 5 ] << 8 );
+    if ( ( magic != KV_BANK_MAGIC ) || ( crc != crc16 ( 0xFFFF, header, 4 ) ) )
+    {
+        return false;
+    }
+
+    headerGeneration = header [ 2 ] | ( header [ 3 ] << 8 );
+    return true;
+}
+
+bool KvStore::writeHeader ( const unsigned int bank, const uint16_t headerGeneration )
+{
+    uint8_t header [ KV_BANK_HEADER_SIZE ];
+    header [ 0 ] = ( uint8_t ) KV_BANK_MAGIC;
+    header [ 1 ] = ( uint8_t ) ( KV_BANK_MAGIC >> 8 );
+    header [ 2 ] = ( uint8_t ) headerGeneration;
+    header [ 3 ] = ( uint8_t ) ( headerGeneration >> 8 );
+    const uint16_t crc = crc16 ( 0xFFFF, header, 4 );
+    header [ 4 ] = ( uint8_t ) crc;
+    header [ 5 ] = ( uint8_t ) ( crc >> 8 );
+
+    // The CRC goes last, it is what makes the bank valid
+    return storage->write ( bankAddress ( bank ), header, 4 ) && storage->write ( bankAddress ( bank ) + 4, header + 4, 2 );
+}
+
+void KvStore::scan ()
+{
+    const unsigned int bank = bankAddress ( activeBank );
+    unsigned int offset = KV_BANK_HEADER_SIZE;
+
+    for ( unsigned int i = 0; i < KV_STORE_MAX_KEYS; i++ )
+    {
+        index [ i ] = KV_STORE_NO_RECORD;
+    }
+
+    while ( offset + KV_RECORD_HEADER_SIZE <= bankSize )
+    {
+        uint8_t header [ KV_RECORD_HEADER_SIZE ];
+        if ( !storage->read ( bank + offset, header, KV_RECORD_HEADER_SIZE ) )
+        {
+            break;
+        }
+
+        const uint8_t key = header [ 0 ];
+        const uint8_t length = header [ 1 ];
+        if ( ( key == KV_END_OF_LOG ) || ( key >= KV_STORE_MAX_KEYS ) || ( offset + KV_RECORD_HEADER_SIZE + length > bankSize ) )
+        {
+            break;
+        }
+
+        uint16_t crc = recordCrcStart ( generation, key, length );
+        uint8_t chunk [ KV_CRC_CHUNK ];
+        unsigned int done = 0;
+        while ( done < length )
+        {
+            const unsigned int count = ( length - done < KV_CRC_CHUNK ) ? ( length - done ) : KV_CRC_CHUNK;
+            storage->read ( bank + offset + KV_RECORD_HEADER_SIZE + done, chunk, count );
+            crc = crc16 ( crc, chunk, count );
+            done += count;
+        }
+
+        // A torn record or one from an older generation ends the log
+        if ( crc != ( header [ 2 ] | ( header [ 3 ] << 8 ) ) )
+        {
+            break;
+        }
+
+        index [ key ] = ( length != 0 ) ? offset : KV_STORE_NO_RECORD;
+        offset += KV_RECORD_HEADER_SIZE + length;
+    }
+
+    appendOffset = offset;
+}
+
+bool KvStore::mount ()
+{
+    mounted = false;
+    compacting = false;
+
+    if ( ( storage == NULL ) || ( bankSize < KV_BANK_HEADER_SIZE + KV_RECORD_HEADER_SIZE ) || ( bankSize > KV_STORE_NO_RECORD )
+            || ( baseAddress + ( 2 * bankSize ) > storage->getSize () ) )
+    {
+        return false;
+    }
+
+    uint16_t generations [ 2 ];
+    const bool valid [ 2 ] = { readHeader ( 0, generations [ 0 ] ), readHeader ( 1, generations [ 1 ] ) };
+
+    if ( valid [ 0 ] && valid [ 1 ] )
+    {
+        // Serial number arithmetic, the generation wraps after 65536 compactions
+        activeBank = ( ( int16_t ) ( generations [ 1 ] - generations [ 0 ] ) > 0 ) ? 1 : 0;
+    }
+    else if ( valid [ 0 ] || valid [ 1 ] )
+    {
+        activeBank = valid [ 0 ] ? 0 : 1;
+    }
+    else
+    {
+        const uint8_t endOfLog = KV_END_OF_LOG;
+        activeBank = 0;
+        generations [ 0 ] = 1;
+        if ( !storage->write ( bankAddress ( 0 ) + KV_BANK_HEADER_SIZE, &endOfLog, 1 ) || !writeHeader ( 0, generations [ 0 ] ) )
+        {
+            return false;
+        }
+    }
+
+    generation = generations [ activeBank ];
+    scan ();
+    mounted = true;
+    return true;
+}
+
+int KvStore::get ( const unsigned int key, void * value, const unsigned int maxLength ) const
+{
+    if ( !contains ( key ) )
+    {
+        return -1;
+    }
+
+    const unsigned int address = bankAddress ( activeBank ) + index [ key ];
+    uint8_t length;
+    if ( !storage->read ( address + 1, &length, 1 ) )
+    {
+        return -1;
+    }
+
+    const unsigned int count = ( length < maxLength ) ? length : maxLength;
+    if ( ( count > 0 ) && !storage->read ( address + KV_RECORD_HEADER_SIZE, value, count ) )
+    {
+        return -1;
+    }
+    return length;
+}
+
+bool KvStore::equals ( const unsigned int key, const void * value, const unsigned int length ) const
+{
+    if ( !contains ( key ) )
+    {
+        return ( length == 0 );
+    }
+
+    const unsigned int address = bankAddress ( activeBank ) + index [ key ];
+    uint8_t storedLength;
+    if ( !storage->read ( address + 1, &storedLength, 1 ) || ( storedLength != length ) )
+    {
+        return false;
+    }
+
+    uint8_t chunk [ KV_CRC_CHUNK ];
+    unsigned int done = 0;
+    while ( done < length )
+    {
+        const unsigned int count = ( length - done < KV_CRC_CHUNK ) ? ( length - done ) : KV_CRC_CHUNK;
+        if ( !storage->read ( address + KV_RECORD_HEADER_SIZE + done, chunk, count ) || ( memcmp ( chunk, ( const uint8_t * ) value + done, count ) != 0 ) )
+        {
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+bool KvStore::append ( const unsigned int bank, const uint16_t recordGeneration, unsigned int &offset, const uint8_t key, const void * value, const uint8_t length )
+{
+    const unsigned int recordSize = KV_RECORD_HEADER_SIZE + length;
+    if ( offset + recordSize > bankSize )
+    {
+        return false;
+    }
+
+    const unsigned int address = bankAddress ( bank ) + offset;
+    const uint8_t endOfLog = KV_END_OF_LOG;
+    const uint8_t header [ 2 ] = { key, length };
+    const uint16_t crc = crc16 ( recordCrcStart ( recordGeneration, key, length ), value, length );
+    const uint8_t crcBytes [ 2 ] = { ( uint8_t ) crc, ( uint8_t ) ( crc >> 8 ) };
+
+    // Terminate the log behind the record first and commit it with its CRC last
+    if ( ( offset + recordSize < bankSize ) && !storage->write ( address + recordSize, &endOfLog, 1 ) )
+    {
+        return false;
+    }
+    if ( ( length > 0 ) && !storage->write ( address + KV_RECORD_HEADER_SIZE, value, length ) )
+    {
+        return false;
+    }
+    if ( !storage->write ( address, header, 2 ) || !storage->write ( address + 2, crcBytes, 2 ) )
+    {
+        return false;
+    }
+
+    offset += recordSize;
+    return true;
+}
+
+bool KvStore::put ( const unsigned int key, const void * value, const unsigned int length )
+{
+    if ( !mounted || ( key >= KV_STORE_MAX_KEYS ) || ( length > KV_STORE_MAX_VALUE_LENGTH ) )
+    {
+        return false;
+    }
+    if ( equals ( key, value, length ) )
+    {
+        return true; // don't wear the storage for nothing
+    }
+
+    unsigned int offset = appendOffset;
+    if ( !append ( activeBank, generation, appendOffset, key, value, length ) )
+    {
+        if ( !finishCompaction () )
+        {
+            return false;
+        }
+        offset = appendOffset;
+        if ( !append ( activeBank, generation, appendOffset, key, value, length ) )
+        {
+            return false;
+        }
+    }
+    index [ key ] = ( length != 0 ) ? offset : KV_STORE_NO_RECORD;
+
+    // Keys the running compaction already copied have to follow the change
+    if ( compacting && ( key < compactKey ) && ( ( length != 0 ) || ( compactIndex [ key ] != KV_STORE_NO_RECORD ) ) )
+    {
+        const unsigned int compactRecordOffset = compactOffset;
+        if ( append ( 1 - activeBank, ( uint16_t ) ( generation + 1 ), compactOffset, key, value, length ) )
+        {
+            compactIndex [ key ] = ( length != 0 ) ? compactRecordOffset : KV_STORE_NO_RECORD;
+        }
+        else
+        {
+            startCompaction ();
+        }
+    }
+    return true;
+}
+
+bool KvStore::remove ( const unsigned int key )
+{
+    return put ( key, NULL, 0 );
+}
+
+bool KvStore::copyRecord ( const unsigned int key )
+{
+    uint8_t value [ KV_STORE_MAX_VALUE_LENGTH ];
+    const int length = get ( key, value, sizeof ( value ) );
+    if ( length < 0 )
+    {
+        return false;
+    }
+
+    const unsigned int offset = compactOffset;
+    if ( !append ( 1 - activeBank, ( uint16_t ) ( generation + 1 ), compactOffset, key, value, length ) )
+    {
+        return false;
+    }
+    compactIndex [ key ] = offset;
+    return true;
+}
+
+void KvStore::startCompaction ()
+{
+    const uint8_t endOfLog = KV_END_OF_LOG;
+    storage->write ( bankAddress ( 1 - activeBank ) + KV_BANK_HEADER_SIZE, &endOfLog, 1 );
+
+    for ( unsigned int i = 0; i < KV_STORE_MAX_KEYS; i++ )
+    {
+        compactIndex [ i ] = KV_STORE_NO_RECORD;
+    }
+    compactKey = 0;
+    compactOffset = KV_BANK_HEADER_SIZE;
+    compacting = true;
+}
+
+bool KvStore::compactStep ()
+{
+    while ( ( compactKey < KV_STORE_MAX_KEYS ) && ( index [ compactKey ] == KV_STORE_NO_RECORD ) )
+    {
+        compactKey++;
+    }
+
+    if ( compactKey < KV_STORE_MAX_KEYS )
+    {
+        if ( !copyRecord ( compactKey ) )
+        {
+            compacting = false; // the live records don't fit a bank
+            return false;
+        }
+        compactKey++;
+        return true;
+    }
+
+    // Every live record is in place, the new header switches banks
+    const uint16_t nextGeneration = generation + 1;
+    if ( !writeHeader ( 1 - activeBank, nextGeneration ) )
+    {
+        compacting = false;
+        return false;
+    }
+
+    activeBank = 1 - activeBank;
+    generation = nextGeneration;
+    appendOffset = compactOffset;
+    memcpy ( index, compactIndex, sizeof ( index ) );
+    compacting = false;
+    compactionCount++;
+    return true;
+}
+
+bool KvStore::finishCompaction ()
+{
+    if ( !compacting )
+    {
+        startCompaction ();
+    }
+    while ( compacting )
+    {
+        if ( !compactStep () )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KvStore::maintain ()
+{
+    if ( !mounted )
+    {
+        return;
+    }
+    if ( compacting )
+    {
+        compactStep ();
+        return;
+    }
+    if ( appendOffset * 100 <= bankSize * KV_STORE_COMPACT_PERCENT )
+    {
+        return;
+    }
+
+    unsigned int liveSize = KV_BANK_HEADER_SIZE;
+    for ( unsigned int key = 0; key < KV_STORE_MAX_KEYS; key++ )
+    {
+        uint8_t length;
+        if ( ( index [ key ] != KV_STORE_NO_RECORD ) && storage->read ( bankAddress ( activeBank ) + index [ key ] + 1, &length, 1 ) )
+        {
+            liveSize += KV_RECORD_HEADER_SIZE + length;
+        }
+    }
+
+    if ( ( appendOffset - liveSize ) * 100 >= bankSize * KV_COMPACT_STALE_PERCENT )
+    {
+        startCompaction ();
+    }
+}
@@ -0,0 +1,152 @@
+#ifndef BARVIS_KV_STORE_H_
+#define BARVIS_KV_STORE_H_
+
+#include "mbed.h"
+#include "Eeprom.h"
+
+#define KV_STORE_MAX_KEYS           64  // keys are 0 .. KV_STORE_MAX_KEYS - 1
+#define KV_STORE_MAX_VALUE_LENGTH   255
+#define KV_STORE_COMPACT_PERCENT    75  // maintain () starts compacting above this fill level
+
+/**
+ * Small log structured key / value store on top of a NonVolatileStorage
+ * region.
+ *
+ * The region is split into two banks.  The active bank starts with a
+ * header carrying a generation number, followed by records appended one
+ * after the other:
+ *
+ *      key ( 1 ) | length ( 1 ) | crc ( 2 ) | value ( length )
+ *
+ * A record of length 0 deletes its key.  The CRC covers the bank
+ * generation, key, length and value and is written last, so a record torn
+ * by a power cut fails its check and ends the log, as do records left
+ * over from an older generation.  Rewriting a key appends a new record,
+ * which spreads the writes over the whole bank instead of wearing the
+ * same bytes.
+ *
+ * mount () scans the active bank once and keeps the offset of the latest
+ * record of every key in RAM, get () is a single read after that.
+ *
+ * When the active bank fills up, the live records are copied into the
+ * other bank, whose header is written last with the next generation.
+ * maintain () does that one key per call from the main loop; put () only
+ * finishes it in one go when it runs out of space.
+ *
+ * Writes take milliseconds on the FlexRAM EEPROM, so put (), remove ()
+ * and maintain () belong in the main context only.
+ */
+class KvStore
+{
+    private:
+        NonVolatileStorage * storage;
+        const unsigned int baseAddress;
+        const unsigned int bankSize;
+
+        bool mounted;
+        unsigned int activeBank;
+        uint16_t generation;
+        unsigned int appendOffset;
+        uint16_t index [ KV_STORE_MAX_KEYS ]; // offsets within the active bank
+
+        bool compacting;
+        unsigned int compactKey;
+        unsigned int compactOffset;
+        uint16_t compactIndex [ KV_STORE_MAX_KEYS ];
+
+        unsigned int compactionCount;
+
+        KvStore ( const KvStore &other ); // Don't allow copying at all
+
+        unsigned int bankAddress ( const unsigned int bank ) const;
+        bool readHeader ( const unsigned int bank, uint16_t &headerGeneration ) const;
+        bool writeHeader ( const unsigned int bank, const uint16_t headerGeneration );
+        void scan ();
+        bool append ( const unsigned int bank, const uint16_t recordGeneration, unsigned int &offset, const uint8_t key, const void * value, const uint8_t length );
+        bool copyRecord ( const unsigned int key );
+        bool equals ( const unsigned int key, const void * value, const unsigned int length ) const;
+
+        void startCompaction ();
+        bool compactStep ();
+        bool finishCompaction ();
+
+    public:
+        /**
+         * @param baseAddress, regionSize the part of storage owned by the
+         * store, nothing outside of it is touched
+         */
+        KvStore ( NonVolatileStorage * _storage, const unsigned int _baseAddress, const unsigned int regionSize );
+
+        /**
+         * Picks the newest valid bank and builds the index, formats the
+         * region if neither bank is valid.
+         * @return false if the storage can't be read or written
+         */
+        bool mount ();
+
+        /**
+         * @return the length of the value of key, of which at most
+         * maxLength bytes are copied into value, or -1 if key isn't set
+         */
+        int get ( const unsigned int key, void * value, const unsigned int maxLength ) const;
+
+        /**
+         * Stores value as key, nothing is written if it is unchanged.  A
+         * length of 0 removes the key.
+         * @return false if the store isn't mounted, key or length are out
+         * of range or the live records don't fit a bank
+         */
+        bool put ( const unsigned int key, const void * value, const unsigned int length );
+        bool remove ( const unsigned int key );
+
+        /**
+         * Background compaction, call it from the main loop.  Copies at
+         * most one record per call.
+         */
+        void maintain ();
+
+        inline bool isMounted () const;
+        inline bool contains ( const unsigned int key ) const;
+        inline unsigned int getUsed () const;
+        inline unsigned int getCapacity () const;
+        inline uint16_t getGeneration () const;
+        inline unsigned int getCompactionCount () const;
+};
+
+#define KV_STORE_NO_RECORD      0xFFFF
+
+inline bool KvStore::isMounted () const
+{
+    return mounted;
+}
+
+inline bool KvStore::contains ( const unsigned int key ) const
+{
+    return mounted && ( key < KV_STORE_MAX_KEYS ) && ( index [ key ] != KV_STORE_NO_RECORD );
+}
+
+/**
+ * Bytes of the active bank taken by the header and records, including
+ * stale ones
+ */
+inline unsigned int KvStore::getUsed () const
+{
+    return appendOffset;
+}
+
+inline unsigned int KvStore::getCapacity () const
+{
+    return bankSize;
+}
+
+inline uint16_t KvStore::getGeneration () const
+{
+    return generation;
+}
+
+inline unsigned int KvStore::getCompactionCount () const
+{
+    return compactionCount;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdarg.h>
+#include <string.h>
+#include "Log.h"
+#include "Format.h"
+
+LogRecord Log::ring [ LOG_CAPACITY ];
+volatile uint32_t Log::head = 0;
+volatile uint32_t Log::tail = 0;
+volatile uint32_t Log::dropped = 0;
+
+Log::Log ()
+{
+}
+
+void Log::record ( const uint8_t level, const char * format, ... )
+{
+    uint32_t now = us_ticker_read ();
+
+    // Records may come from interrupt context, fill the slot in one go
+    __disable_irq ();
+    if ( ( tail - head ) >= LOG_CAPACITY )
+    {
+        dropped++;
+        __enable_irq ();
+        return;
+    }
+
+    LogRecord &slot = ring [ tail & ( LOG_CAPACITY - 1 ) ];
+    slot.format = format;
+    slot.timestamp = now;
+    slot.level = level;
+    slot.argCount = 0;
+    slot.textArg = -1;
+
+    va_list argList;
+    va_start ( argList, format );
+    for ( const char * c = format; ( *c != '\0' ) && ( slot.argCount < LOG_MAX_ARGS ); c++ )
+    {
+        if ( *c != '%' )
+        {
+            continue;
+        }
+        c++;
+        if ( *c == '%' )
+        {
+            continue;
+        }
+        while ( ( *c != '\0' ) && ( strchr ( "-+ #0123456789.hlzjt", *c ) != NULL ) )
+        {
+            c++; // flags, width, precision and length
+        }
+        if ( *c == '\0' )
+        {
+            break;
+        }
+
+        uintptr_t arg = va_arg ( argList, uintptr_t );
+        if ( ( *c == 's' ) && ( slot.textArg == -1 ) )
+        {
+            const char * text = (const char *) arg;
+            strncpy ( slot.text, ( text != NULL ) ? text : "(null)", LOG_TEXT_SIZE - 1 );
+            slot.text [ LOG_TEXT_SIZE - 1 ] = '\0';
+            slot.textArg = slot.argCount;
+        }
+        slot.args [ slot.argCount++ ] = arg;
+    }
+    va_end ( argList );
+
+    tail++;
+    __enable_irq ();
+}
+
+bool Log::pop ( char * line, const int lineSize )
+{
+    static const char * levelNames [] = { "", "ERROR", "WARN", "INFO", "DEBUG" };
+
+    if ( head == tail )
+    {
+        return false;
+    }
+
+    LogRecord record = ring [ head & ( LOG_CAPACITY - 1 ) ];
+    head++;
+
+    uintptr_t args [ LOG_MAX_ARGS ] = { 0 };
+    for ( int i = 0; i < record.argCount; i++ )
+    {
+        args [ i ] = ( i == record.textArg ) ? (uintptr_t) record.text : record.args [ i ];
+    }
+
+    int length = Format::print ( line, lineSize, "[%5lu.%03lu] [%s] ", (unsigned long) ( record.timestamp / 1000000 ), (unsigned long) ( ( record.timestamp / 1000 ) % 1000 ), levelNames [ ( record.level <= LOG_LEVEL_DEBUG ) ? record.level : 0 ] );
+    if ( ( length > 0 ) && ( length < lineSize ) )
+    {
+        Format::print ( line + length, lineSize - length, record.format, args [ 0 ], args [ 1 ], args [ 2 ], args [ 3 ] );
+    }
+    return true;
+}
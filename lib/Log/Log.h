@@ -0,0 +1,109 @@
+#ifndef BARVIS_LOG_H_
+#define BARVIS_LOG_H_
+
+#include "mbed.h"
+
+#define LOG_LEVEL_NONE      0
+#define LOG_LEVEL_ERROR     1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_INFO      3
+#define LOG_LEVEL_DEBUG     4
+
+/**
+ * Highest level compiled in, define it before including Log.h or as a
+ * build flag ( see platformio.ini ).  Calls above it compile to nothing.
+ */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL           LOG_LEVEL_INFO
+#endif
+
+#define LOG_CAPACITY        32  // records, power of two
+#define LOG_MAX_ARGS        4
+#define LOG_TEXT_SIZE       48  // copy of the first %s argument
+#define LOG_LINE_SIZE       160 // formatted line, see Log::pop
+
+/**
+ * Deferred logging.  LOG_INFO ( "Command queued at %d of %d", size, capacity )
+ * only stores the format string pointer ( the message id ) and the raw
+ * arguments in a ring, formatting happens when the main loop pops the
+ * record in idle time.
+ *
+ * Arguments are integers, characters or pointers, at most LOG_MAX_ARGS of
+ * them, no floating point.  The string of the first %s is copied into the
+ * record ( up to LOG_TEXT_SIZE - 1 characters ), further %s arguments have
+ * to stay valid until the record is popped, i.e. be literals.  When the
+ * ring is full new records are dropped and counted.
+ */
+struct LogRecord
+{
+        const char * format;
+        uint32_t timestamp; // us_ticker_read ()
+        uint8_t level;
+        uint8_t argCount;
+        int8_t textArg;     // index of the copied %s argument, -1 if none
+        uintptr_t args [ LOG_MAX_ARGS ];
+        char text [ LOG_TEXT_SIZE ];
+};
+
+class Log
+{
+    private:
+        static LogRecord ring [ LOG_CAPACITY ];
+        static volatile uint32_t head; // next record to pop
+        static volatile uint32_t tail; // next free slot
+        static volatile uint32_t dropped;
+
+        Log ();
+
+    public:
+        /**
+         * Use the LOG_* macros instead, they compile out disabled levels
+         */
+        static void record ( const uint8_t level, const char * format, ... );
+
+        /**
+         * Formats the oldest record into line as "[  seconds] [LEVEL] message"
+         * and frees its slot, main context only.
+         * @return false when there was nothing to pop
+         */
+        static bool pop ( char * line, const int lineSize );
+
+        static inline unsigned int size ();
+        static inline unsigned int getDroppedCount ();
+};
+
+inline unsigned int Log::size ()
+{
+    return tail - head;
+}
+
+inline unsigned int Log::getDroppedCount ()
+{
+    return dropped;
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...)      Log::record ( LOG_LEVEL_ERROR, __VA_ARGS__ )
+#else
+#define LOG_ERROR(...)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...)       Log::record ( LOG_LEVEL_WARN, __VA_ARGS__ )
+#else
+#define LOG_WARN(...)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...)       Log::record ( LOG_LEVEL_INFO, __VA_ARGS__ )
+#else
+#define LOG_INFO(...)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...)      Log::record ( LOG_LEVEL_DEBUG, __VA_ARGS__ )
+#else
+#define LOG_DEBUG(...)
+#endif
+
+#endif
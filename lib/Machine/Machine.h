@@ -0,0 +1,50 @@
+#ifndef BARVIS_MACHINE_H_
+#define BARVIS_MACHINE_H_
+
+#include "PumpControl.h"
+#include "OrderQueue.h"
+#include "OrderManager.h"
+
+/**
+ * Compile time description of a machine.  Pump count, cup count and order
+ * queue depth become template arguments, so every array is sized by the
+ * compiler and lives wherever the objects themselves live (static storage
+ * when declared static) instead of being new[]'ed by the constructors.
+ *
+ * @code
+ *  typedef Machine < 24, 1, 4 > BarMachine;
+ *
+ *  static BarMachine::Pumps pumps ( D2, D3, D4, D5, D6 );
+ *  static BarMachine::Queue queue;
+ *  static BarMachine::Manager manager ( &queue, &pumps, &dispenser );
+ * @endcode
+ *
+ * The runtime sized constructors of PumpControl, OrderQueue and OrderManager
+ * keep working, the Static* types are thin adapters over them.
+ */
+template <unsigned int PUMPS, unsigned int CUPS, unsigned int QUEUE_DEPTH>
+class Machine
+{
+    private:
+        // Compile time checks, a negative array size fails the build
+        typedef char pumpCountMustNotBeZero [ ( PUMPS > 0 ) ? 1 : -1 ];
+        typedef char cupCountMustNotBeZero [ ( CUPS > 0 ) ? 1 : -1 ];
+        typedef char cupCountMustFitOrderManager [ ( CUPS <= ORDER_MANAGER_MAX_CUPS ) ? 1 : -1 ];
+        typedef char queueDepthMustNotBeZero [ ( QUEUE_DEPTH > 0 ) ? 1 : -1 ];
+
+        Machine ();
+
+    public:
+        enum
+        {
+            PUMP_COUNT = PUMPS,
+            CUP_COUNT = CUPS,
+            QUEUE_CAPACITY = QUEUE_DEPTH
+        };
+
+        typedef StaticPumpControl <PUMPS> Pumps;
+        typedef StaticOrderQueue <QUEUE_DEPTH, PUMPS> Queue;
+        typedef StaticOrderManager <CUPS, PUMPS> Manager;
+};
+
+#endif
@@ -1,62 +1,615 @@
 #include "OrderManager.h"
 
-OrderManager::OrderManager ( int _CUP_COUNT, int _PUMP_COUNT, OrderQueue * _orderQueue, PumpControl * _pumpControl, DispenserControl * _dispenserControl )
-        : pumpCount ( _PUMP_COUNT ), cupCount ( _CUP_COUNT )
+OrderManager::OrderManager ( int _CUP_COUNT, int _PUMP_COUNT, OrderQueue * _orderQueue, PumpControl * _pumpControl, DispenserControl * _dispenserControl, unsigned int * durationStorage )
+        : pumpCount ( _PUMP_COUNT ), cupCount ( _CUP_COUNT ), ownsDurations ( durationStorage == NULL )
 {
     orderQueue = _orderQueue;
     pumpControl = _pumpControl;
     dispenserControl = _dispenserControl;
-    semaphoreLock = false;
     currCupIndex = -1;
-    durations = new unsigned int [ pumpCount ];
+    cupSelectionPolicy = NearestFirst;
+    cupPositions = NULL;
+    cupPresentMask = ( cupCount >= ORDER_MANAGER_MAX_CUPS ) ? 0xFFFFFFFF : ( ( 1UL << cupCount ) - 1 );
+    cupServedMask = 0;
+    cupPresenceReported = false;
+    scanTowardsEnd = true;
+    state = WaitingForOrder;
+    overlapMode = false;
+    pendingCupIndex = -1;
+    deferredQueue = NULL;
+    dispatchPending = false;
+    latchedEvents = 0;
+    dispatchedAt = 0;
+    pumpsOnAt = 0;
+    pouring = false;
+    currentCancelled = false;
+    currentAborted = false;
+    currentOrder.orderId = 0;
+    progressListener = NULL;
+    durations = ownsDurations ? new unsigned int [ pumpCount ] : durationStorage;
 
-    orderProcessingTimer = new Ticker ();
-    orderProcessingTimer->attach_us ( this, &OrderManager::atOrderProcessingTimer, 250000 );
+    pumpControl->setListener ( this );
+    if ( dispenserControl != NULL )
+    {
+        DispenserControlListener * dispenserListener = this;
+        dispenserControl->setListener ( dispenserListener );
+    }
+
+    orderProcessingTimer.attach_us ( this, &OrderManager::atOrderProcessingTimer, ORDER_MANAGER_DISPATCH_PERIOD_MICRO_SECS );
 }
 
 OrderManager::OrderManager ( OrderManager & other )
-        : pumpCount ( 0 ), cupCount ( 0 )
+        : pumpCount ( 0 ), cupCount ( 0 ), ownsDurations ( false )
 {
     orderQueue = NULL;
     pumpControl = NULL;
     dispenserControl = NULL;
     currCupIndex = -1;
+    cupSelectionPolicy = RoundRobin;
+    cupPositions = NULL;
+    cupPresentMask = 0;
+    cupServedMask = 0;
+    cupPresenceReported = false;
+    scanTowardsEnd = true;
+    state = WaitingForOrder;
+    overlapMode = false;
+    pendingCupIndex = -1;
+    deferredQueue = NULL;
+    dispatchPending = false;
+    latchedEvents = 0;
+    dispatchedAt = 0;
+    pumpsOnAt = 0;
+    pouring = false;
+    currentCancelled = false;
+    currentAborted = false;
+    currentOrder.orderId = 0;
+    progressListener = NULL;
     durations = NULL;
-    orderProcessingTimer = NULL;
 }
 
 OrderManager::~OrderManager ()
 {
-    orderProcessingTimer->detach ();
-    delete [] durations;
-    delete orderProcessingTimer;
+    orderProcessingTimer.detach ();
+    if ( ownsDurations )
+    {
+        delete [] durations;
+    }
 }
 
 void OrderManager::atOrderProcessingTimer ()
 {
-    if ( semaphoreLock == false )
+    IsrDurationScope isrDuration ( processingTimerIsrDuration );
+
+    if ( deferredQueue != NULL )
     {
-        orderProcessingTimer->detach ();
-        executeNextOrder ();
-        orderProcessingTimer->attach_us ( this, &OrderManager::atOrderProcessingTimer, 250000 );
+        // One dispatch in flight is enough, a late main loop must not pile them up
+        if ( !dispatchPending )
+        {
+            dispatchPending = deferredQueue->post ( this, DispatchEvent );
+        }
+        return;
     }
+
+    orderProcessingTimer.detach ();
+    executeNextOrder ();
+    orderProcessingTimer.attach_us ( this, &OrderManager::atOrderProcessingTimer, ORDER_MANAGER_DISPATCH_PERIOD_MICRO_SECS );
+}
+
+void OrderManager::setDeferredQueue ( DeferredQueue * queue )
+{
+    deferredQueue = queue;
+}
+
+void OrderManager::setProgressListener ( OrderProgressListener * listener )
+{
+    progressListener = listener;
+}
+
+void OrderManager::notifyProgress ( const OrderInfo & order, const OrderProgress progress )
+{
+    if ( ( progressListener != NULL ) && ( order.orderId != 0 ) )
+    {
+        progressListener->orderProgress ( order, progress );
+    }
+}
+
+void OrderManager::abortPour ()
+{
+    // pumpsIdle may finish the same pour meanwhile, only one of them reports it
+    __disable_irq ();
+    bool wasPouring = pouring;
+    pouring = false;
+    const bool wasWaiting = ( state == WaitingForCup );
+    if ( wasWaiting )
+    {
+        state = WaitingForOrder;
+    }
+    else if ( state == MovingToCup )
+    {
+        currentAborted = true; // pourInto reports it once the head arrives
+    }
+    __enable_irq ();
+
+    pumpControl->resetPumps ();
+    if ( wasPouring || wasWaiting )
+    {
+        notifyProgress ( currentOrder, OrderFailed );
+    }
+}
+
+bool OrderManager::cancelOrder ( const uint16_t orderId )
+{
+    OrderInfo cancelled;
+    if ( orderQueue->cancelOrder ( orderId, &cancelled ) )
+    {
+        notifyProgress ( cancelled, OrderCancelled );
+        return true;
+    }
+
+    if ( ( orderId == 0 ) || ( currentOrder.orderId != orderId ) || currentCancelled || currentAborted )
+    {
+        return false;
+    }
+
+    __disable_irq ();
+    const bool waitingForCup = ( state == WaitingForCup );
+    if ( waitingForCup )
+    {
+        state = WaitingForOrder;
+        currentCancelled = true;
+    }
+    __enable_irq ();
+    if ( waitingForCup )
+    {
+        notifyProgress ( currentOrder, OrderCancelled );
+        return true;
+    }
+
+    if ( state == MovingToCup )
+    {
+        currentCancelled = true; // pourInto reports it once the head arrives
+        return true;
+    }
+
+    // The pour may run out meanwhile, then it stays done
+    __disable_irq ();
+    const bool inFlight = pouring;
+    currentCancelled = inFlight;
+    __enable_irq ();
+
+    if ( inFlight )
+    {
+        pumpControl->cancelPumps (); // pumpsIdle reports it
+    }
+    return inFlight;
+}
+
+/**
+ * Posts from interrupt context, an event the full queue drops is latched
+ * and handled by the next DispatchEvent instead of being lost
+ */
+void OrderManager::postOrLatch ( const DeferredEvent event, const uint32_t arg )
+{
+    if ( !deferredQueue->post ( this, event, arg ) )
+    {
+        __disable_irq ();
+        latchedEvents |= ( 1UL << event );
+        __enable_irq ();
+    }
+}
+
+void OrderManager::handleLatchedEvents ()
+{
+    __disable_irq ();
+    uint32_t latched = latchedEvents;
+    latchedEvents = 0;
+    __enable_irq ();
+
+    for ( int event = PumpsIdleEvent; latched != 0; event++ )
+    {
+        if ( latched & ( 1UL << event ) )
+        {
+            latched &= ~( 1UL << event );
+            handleDeferred ( event, 0 );
+        }
+    }
+}
+
+void OrderManager::handleDeferred ( const int event, const uint32_t arg )
+{
+    switch ( event )
+    {
+        case DispatchEvent:
+            dispatchPending = false;
+            handleLatchedEvents (); // before the tick, they happened earlier
+            executeNextOrder ();
+            break;
+        case PumpsIdleEvent:
+            startPendingCup ();
+            break;
+        case ReachedPositionEvent:
+            pourAfterMove ();
+            break;
+        case MoveFailedEvent:
+            failAfterMove ();
+            break;
+    }
+}
+
+void OrderManager::setCupPositions ( const unsigned int * positions )
+{
+    cupPositions = positions;
+}
+
+void OrderManager::setCupSelectionPolicy ( const CupSelectionPolicy policy )
+{
+    cupSelectionPolicy = policy;
+}
+
+void OrderManager::cupPresenceChanged ( const int cupIndex, const bool present )
+{
+    if ( cupIndex < 0 || cupIndex >= cupCount )
+    {
+        return;
+    }
+
+    // A cup going away is reported from interrupt context, see IrSensorManager
+    __disable_irq ();
+    if ( !cupPresenceReported )
+    {
+        cupPresenceReported = true;
+        cupPresentMask = 0;
+    }
+
+    uint32_t bit = ( 1UL << cupIndex );
+    if ( present )
+    {
+        cupPresentMask |= bit;
+    }
+    else
+    {
+        cupPresentMask &= ~bit;
+    }
+    cupServedMask &= ~bit; // a new cup, or none at all, either way nothing is served yet
+    if ( cupIndex == pendingCupIndex )
+    {
+        pendingCupIndex = -1;
+    }
+    __enable_irq ();
+}
+
+void OrderManager::pinStateChanged ( const PinName pin, const int pinId, const bool pinValue )
+{
+    cupPresenceChanged ( pinId, pinValue );
+
+    if ( ( pinId == currCupIndex ) && ( state == WaitingForCup ) )
+    {
+        pourIfCupBack (); // the pumps aren't on, nothing to resume
+    }
+    else if ( pinId == currCupIndex )
+    {
+        if ( pinValue )
+        {
+            pumpControl->resumePumps ();
+        }
+        else
+        {
+            pumpControl->pausePumps ();
+        }
+        if ( pouring )
+        {
+            notifyProgress ( currentOrder, pinValue ? OrderPouring : OrderPaused );
+        }
+    }
+}
+
+void OrderManager::setOverlapMode ( const bool enabled )
+{
+    overlapMode = enabled;
+    pendingCupIndex = -1;
 }
 
 void OrderManager::executeNextOrder ()
 {
-    if ( !orderQueue->isEmpty () )
+    if ( state == MovingToCup )
+    {
+        // The move ended but its event hasn't been handled yet
+        if ( !dispenserControl->isInMotion () )
+        {
+            if ( dispenserControl->hasMoveFailed () )
+            {
+                failAfterMove ();
+            }
+            else
+            {
+                pourAfterMove ();
+            }
+        }
+        return;
+    }
+
+    if ( state == WaitingForCup )
+    {
+        pourIfCupBack ();
+        return;
+    }
+
+    if ( orderQueue->hasOrder () )
+    {
+        PumpControllerState pumpState = pumpControl->getState ();
+        if ( pumpState == Idle )
+        {
+            int nextCupIndex = ( pendingCupIndex != -1 ) ? pendingCupIndex : selectNextCup ();
+            pendingCupIndex = -1;
+            if ( nextCupIndex == -1 )
+            {
+                return; // no cup to pour into, keep the order queued
+            }
+            serveCup ( nextCupIndex );
+        }
+        else if ( overlapMode && ( pumpState == Executing ) && ( pendingCupIndex == -1 ) && ( pumpControl->getRemainingTime () <= ORDER_MANAGER_PRESELECT_TICKS ) )
+        {
+            // Pick the next cup now so pumpsIdle only has to start the move
+            pendingCupIndex = selectNextCup ();
+        }
+    }
+}
+
+/**
+ * Moves the dispenser to cupIndex if it isn't there yet, else pours right away
+ */
+void OrderManager::serveCup ( const int cupIndex )
+{
+    if ( !isCupPresent ( cupIndex ) )
     {
-        if ( pumpControl->getState () == Idle )
+        return; // taken away since it was picked, keep the order queued
+    }
+
+    if ( ( cupPositions != NULL ) && ( dispenserControl != NULL ) && ( dispenserControl->getCurrentPosition () != cupPositions [ cupIndex ] ) )
+    {
+        if ( dispenserControl->isInMotion () )
+        {
+            return; // keep the order queued, the next dispatch tries again
+        }
+        currCupIndex = cupIndex;
+        takeOrder ();
+        state = MovingToCup;
+        dispenserControl->moveToPosition ( cupPositions [ cupIndex ] );
+        return;
+    }
+    currCupIndex = cupIndex;
+    takeOrder ();
+    pourInto ( cupIndex );
+}
+
+/**
+ * The order leaves the queue once it is dispatched
+ */
+void OrderManager::takeOrder ()
+{
+    dispatchedAt = us_ticker_read ();
+    orderQueue->removeOrder ( durations, &currentOrder );
+    currentCancelled = false;
+    currentAborted = false;
+    TRACE( TraceOrderDispatched, currCupIndex, orderQueue->size () );
+    orderStats.record ( StageQueueWait, dispatchedAt - currentOrder.enqueuedAt );
+    notifyProgress ( currentOrder, OrderDispatched );
+}
+
+void OrderManager::pumpsIdle ()
+{
+    pourFinished (); // right away, the deferred work may run late
+    if ( deferredQueue != NULL )
+    {
+        postOrLatch ( PumpsIdleEvent );
+        return;
+    }
+    startPendingCup ();
+}
+
+void OrderManager::startPendingCup ()
+{
+    if ( !overlapMode || ( state != WaitingForOrder ) || ( pendingCupIndex == -1 ) || !orderQueue->hasOrder () )
+    {
+        return;
+    }
+
+    int nextCupIndex = pendingCupIndex;
+    pendingCupIndex = -1;
+    serveCup ( nextCupIndex );
+}
+
+void OrderManager::reachedToPosition ( const unsigned int position, const unsigned int stepsTaken )
+{
+    if ( deferredQueue != NULL )
+    {
+        postOrLatch ( ReachedPositionEvent, position );
+        return;
+    }
+    pourAfterMove ();
+}
+
+void OrderManager::pourAfterMove ()
+{
+    if ( state != MovingToCup )
+    {
+        return;
+    }
+
+    state = WaitingForOrder;
+    pourInto ( currCupIndex );
+}
+
+void OrderManager::moveFailed ( const unsigned int position )
+{
+    if ( deferredQueue != NULL )
+    {
+        postOrLatch ( MoveFailedEvent, position );
+        return;
+    }
+    failAfterMove ();
+}
+
+void OrderManager::failAfterMove ()
+{
+    if ( state != MovingToCup )
+    {
+        return;
+    }
+
+    state = WaitingForOrder;
+    notifyProgress ( currentOrder, currentCancelled ? OrderCancelled : OrderFailed );
+}
+
+void OrderManager::pourIfCupBack ()
+{
+    // The dispatch tick and the cup sensor event may both get here
+    __disable_irq ();
+    const bool back = ( state == WaitingForCup ) && isCupPresent ( currCupIndex );
+    if ( back )
+    {
+        state = WaitingForOrder;
+    }
+    __enable_irq ();
+
+    if ( back )
+    {
+        pourInto ( currCupIndex );
+    }
+}
+
+void OrderManager::pourInto ( const int cupIndex )
+{
+    if ( currentCancelled )
+    {
+        // Cancelled on the way to the cup, report it without pouring
+        pouring = true;
+        pourFinished ();
+        return;
+    }
+    if ( currentAborted )
+    {
+        notifyProgress ( currentOrder, OrderFailed ); // CLEAR on the way to the cup
+        return;
+    }
+
+    if ( !isCupPresent ( cupIndex ) )
+    {
+        state = WaitingForCup; // taken away while the head was on its way
+        return;
+    }
+
+    pumpsOnAt = us_ticker_read ();
+    pumpControl->runPumpsFor ( durations );
+    cupServedMask |= ( 1UL << cupIndex );
+
+    orderStats.record ( StageDispatch, pumpsOnAt - dispatchedAt );
+    pouring = true;
+    notifyProgress ( currentOrder, OrderPouring );
+    if ( pumpControl->getState () == Idle )
+    {
+        pourFinished (); // nothing to pour, pumpsIdle won't come
+    }
+}
+
+void OrderManager::pourFinished ()
+{
+    if ( pouring )
+    {
+        pouring = false;
+        if ( currentCancelled )
+        {
+            notifyProgress ( currentOrder, OrderCancelled );
+            return;
+        }
+        uint32_t now = us_ticker_read ();
+        orderStats.record ( StagePour, now - pumpsOnAt );
+        orderStats.record ( StageTotal, now - currentOrder.receivedAt );
+        notifyProgress ( currentOrder, OrderDone );
+    }
+}
+
+int OrderManager::selectNextCup ()
+{
+    uint32_t waitingMask = cupPresentMask & ~cupServedMask;
+    if ( ( waitingMask == 0 ) && !cupPresenceReported )
+    {
+        cupServedMask = 0; // every cup had its turn, start the next round
+        waitingMask = cupPresentMask;
+    }
+
+    if ( ( cupPositions == NULL ) || ( dispenserControl == NULL ) )
+    {
+        return pickCup ( RoundRobin, NULL, cupCount, waitingMask, 0, currCupIndex, scanTowardsEnd );
+    }
+    return pickCup ( cupSelectionPolicy, cupPositions, cupCount, waitingMask, dispenserControl->getCurrentPosition (), currCupIndex, scanTowardsEnd );
+}
+
+/**
+ * @param waitingMask cups that are present and not served yet
+ * @param lastCupIndex cup poured into last, -1 before the first
+ * @param scanTowardsEnd Scan's direction of travel, updated
+ * @return cup index or -1 if no cup is waiting
+ */
+int OrderManager::pickCup ( const CupSelectionPolicy policy, const unsigned int * cupPositions, const int cupCount, const uint32_t waitingMask, const int headPosition, const int lastCupIndex, bool & scanTowardsEnd )
+{
+    if ( policy == RoundRobin )
+    {
+        for ( int i = 1; i <= cupCount; i++ )
+        {
+            const int cupIndex = ( lastCupIndex + i ) % cupCount;
+            if ( ( waitingMask & ( 1UL << cupIndex ) ) != 0 )
+            {
+                return cupIndex;
+            }
+        }
+        return -1;
+    }
+
+    if ( policy == NearestFirst )
+    {
+        return nearestWaitingCup ( cupPositions, cupCount, waitingMask, headPosition, 0 );
+    }
+
+    // Scan: keep going the same way while there is a cup ahead, else turn around
+    int cupIndex = nearestWaitingCup ( cupPositions, cupCount, waitingMask, headPosition, scanTowardsEnd ? 1 : -1 );
+    if ( cupIndex == -1 )
+    {
+        scanTowardsEnd = !scanTowardsEnd;
+        cupIndex = nearestWaitingCup ( cupPositions, cupCount, waitingMask, headPosition, scanTowardsEnd ? 1 : -1 );
+    }
+    return cupIndex;
+}
+
+/**
+ * Closest cup in waitingMask to the dispenser head, only looking towards the
+ * end ( direction > 0 ), towards home ( direction < 0 ) or both ways ( 0 ).
+ * @return cup index or -1 if there is none
+ */
+int OrderManager::nearestWaitingCup ( const unsigned int * cupPositions, const int cupCount, const uint32_t waitingMask, const int headPosition, const int direction )
+{
+    int bestCup = -1;
+    int bestDistance = 0;
+
+    for ( int i = 0; i < cupCount; i++ )
+    {
+        if ( ( waitingMask & ( 1UL << i ) ) == 0 )
+        {
+            continue;
+        }
+
+        int offset = (int) cupPositions [ i ] - headPosition;
+        if ( ( direction > 0 && offset < 0 ) || ( direction < 0 && offset > 0 ) )
+        {
+            continue;
+        }
+
+        int distance = ( offset < 0 ) ? -offset : offset;
+        if ( ( bestCup == -1 ) || ( distance < bestDistance ) )
         {
-            int nextCupIndex = ( currCupIndex + 1 ) % ( cupCount );
-//            if ( dispenserControl -> moveToCup ( nextCupIndex ) ) {
-//            if ( dispenserControl->isCupPresent ( nextCupIndex ) )
-//            {
-            orderQueue->removeOrder ( durations );
-            pumpControl->runPumpsFor ( durations );
-            currCupIndex = nextCupIndex;
-//            }
-//            }
+            bestCup = i;
+            bestDistance = distance;
         }
     }
+    return bestCup;
 }
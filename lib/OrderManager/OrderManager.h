@@ -1,11 +1,76 @@
+#ifndef BARVIS_ORDER_MANAGER_H_
+#define BARVIS_ORDER_MANAGER_H_
+
 #include "mbed.h"
 #include "OrderQueue.h"
 #include "PumpControl.h"
 #include "DispenserControl.h"
+#include "DeferredQueue.h"
+#include "OrderStats.h"
+#include "Trace.h"
+
+#define ORDER_MANAGER_MAX_CUPS          32 // cup state is kept in 32 bit masks
+#define ORDER_MANAGER_PRESELECT_TICKS   1  // pump timer ticks before the end of a pour
+#define ORDER_MANAGER_DISPATCH_PERIOD_MICRO_SECS    250000
+
+/**
+ * How the next cup to pour into is picked, always among the cups that are
+ * present and still waiting.  RoundRobin takes the next such cup by index,
+ * NearestFirst and Scan pick by dispenser travel: the closest one, or the
+ * closest one ahead in the current direction of travel (elevator style).
+ */
+enum CupSelectionPolicy
+{
+    RoundRobin,
+    NearestFirst,
+    Scan
+};
+
+enum OrderManagerState
+{
+    WaitingForOrder,
+    MovingToCup,
+    WaitingForCup   // at the cup, but it was taken away on the way
+};
+
+/**
+ * Life cycle of an order after it left the command path
+ */
+enum OrderProgress
+{
+    OrderDispatched, // a cup was picked, the dispenser may still be moving
+    OrderPouring,    // pumps on, again after a pause
+    OrderPaused,     // the cup was taken away mid pour
+    OrderDone,
+    OrderFailed,     // the pour was aborted, or the cup couldn't be reached
+    OrderCancelled,  // see OrderManager::cancelOrder
+    ORDER_PROGRESS_COUNT
+};
+
+class OrderProgressListener
+{
+    public:
+        virtual ~OrderProgressListener ()
+        {
+        }
+        /**
+         * Called for every order with a non zero orderId, from interrupt
+         * context as well ( OrderDone comes from pumpsIdle ).  Keep it short.
+         */
+        virtual void orderProgress ( const OrderInfo & order, const OrderProgress progress ) = 0;
+};
 
-class OrderManager
+class OrderManager : public PumpControlListener, public DispenserControlListener, public IrSensorListener, public DeferredHandler
 {
     private:
+        enum DeferredEvent
+        {
+            DispatchEvent,
+            PumpsIdleEvent,
+            ReachedPositionEvent,
+            MoveFailedEvent
+        };
+
         const int pumpCount;
         const int cupCount;
 
@@ -14,29 +79,189 @@ class OrderManager
         DispenserControl * dispenserControl;
 
         unsigned int * durations;
+        const bool ownsDurations;
         int currCupIndex;
 
-        Ticker * orderProcessingTimer;
+        CupSelectionPolicy cupSelectionPolicy;
+        const unsigned int * cupPositions;
+        volatile uint32_t cupPresentMask;
+        volatile uint32_t cupServedMask;
+        volatile bool cupPresenceReported;
+        bool scanTowardsEnd;
+        volatile OrderManagerState state;
+
+        bool overlapMode;
+        volatile int pendingCupIndex;
+
+        Ticker orderProcessingTimer;
         void atOrderProcessingTimer ();
+        IsrDuration processingTimerIsrDuration;
+
+        DeferredQueue * deferredQueue;
+        volatile bool dispatchPending;
+        volatile uint32_t latchedEvents; // bit per DeferredEvent that didn't fit the queue
+
+        OrderStats orderStats;
+        OrderInfo currentOrder; // taken off the queue, moved to or being poured
+        uint32_t dispatchedAt;
+        uint32_t pumpsOnAt;
+        volatile bool pouring;
+        volatile bool currentCancelled;
+        volatile bool currentAborted; // abortPour while the head was moving to the cup
 
-        volatile bool semaphoreLock;
+        OrderProgressListener * progressListener;
+        void notifyProgress ( const OrderInfo & order, const OrderProgress progress );
 
         OrderManager ( OrderManager & other );
 
+        void postOrLatch ( const DeferredEvent event, const uint32_t arg = 0 );
+        void handleLatchedEvents ();
         void executeNextOrder ();
+        void pourInto ( const int cupIndex );
+        void serveCup ( const int cupIndex );
+        void takeOrder ();
+        void startPendingCup ();
+        void pourAfterMove ();
+        void failAfterMove ();
+        void pourIfCupBack ();
+        inline bool isCupPresent ( const int cupIndex ) const;
+        void pourFinished ();
+        int selectNextCup ();
+        static int pickCup ( const CupSelectionPolicy policy, const unsigned int * cupPositions, const int cupCount, const uint32_t waitingMask, const int headPosition, const int lastCupIndex, bool & scanTowardsEnd );
+        static int nearestWaitingCup ( const unsigned int * cupPositions, const int cupCount, const uint32_t waitingMask, const int headPosition, const int direction );
 
     public:
-        OrderManager ( int _CUP_COUNT, int _PUMP_COUNT, OrderQueue * _orderQueue, PumpControl * _pumpControl, DispenserControl * _dispenserControl );
+        /**
+         * durationStorage: optional caller owned buffer of _PUMP_COUNT
+         * entries, allocated on the heap when NULL.  See StaticOrderManager.
+         */
+        OrderManager ( int _CUP_COUNT, int _PUMP_COUNT, OrderQueue * _orderQueue, PumpControl * _pumpControl, DispenserControl * _dispenserControl, unsigned int * durationStorage = NULL );
         virtual ~OrderManager ();
 
-        inline void lock ()
-        {
-            semaphoreLock = true;
-        }
-        ;
-        inline void release ()
+        /**
+         * Dispenser position ( steps from home ) of every cup, the table is
+         * not copied.  Without positions the dispenser is never moved.
+         */
+        void setCupPositions ( const unsigned int * positions );
+        void setCupSelectionPolicy ( const CupSelectionPolicy policy );
+
+        /**
+         * Cup sensor input.  A cup that is put in place waits for an order,
+         * once poured into it is skipped until it is taken away and replaced.
+         * Until the first call every cup counts as present, and the served
+         * flags are cleared each time every cup has been served once.
+         *
+         * Nothing is poured into a cup that isn't present: the order stays
+         * queued, or when the cup went away while the head was moving to it
+         * the order waits there ( WaitingForCup ) until the cup is back.
+         */
+        void cupPresenceChanged ( const int cupIndex, const bool present );
+
+        /**
+         * Debounced cup sensor event ( see IrSensorManager ), pinId is the
+         * cup index.  Updates the cup presence and pauses the pumps while the
+         * cup being poured into is taken away, resuming once it is back.
+         * A cup going away is reported from interrupt context.
+         */
+        virtual void pinStateChanged ( const PinName pin, const int pinId, const bool pinValue );
+
+        /**
+         * Overlap mode pipelines cup changeovers: while an order pours, the
+         * cup for the next one is picked once the pour has at most
+         * ORDER_MANAGER_PRESELECT_TICKS left, and the dispenser starts
+         * moving the moment the last pump switches off instead of at the next
+         * dispatch tick.  The pour starts as soon as the head arrives.  The
+         * head never moves while any pump output is on.
+         */
+        void setOverlapMode ( const bool enabled );
+
+        /**
+         * With a queue set, the dispatch ticker, pumpsIdle,
+         * reachedToPosition and moveFailed only post an event and the order work runs
+         * when the main loop dispatches it.  Without one it all runs in
+         * interrupt context.  An event that doesn't fit a full queue is
+         * kept and handled with the next dispatch tick.
+         */
+        void setDeferredQueue ( DeferredQueue * queue );
+
+        void setProgressListener ( OrderProgressListener * listener );
+
+        /**
+         * Stops the pumps and resets them, the order being poured or
+         * waiting for its cup is reported as OrderFailed.  One the head is
+         * still moving to is reported once it arrives, without pouring.
+         */
+        void abortPour ();
+
+        /**
+         * Cancels orderId, main context.  A queued order is dropped from
+         * the queue, the order being poured is stopped through
+         * PumpControl::cancelPumps and one the dispenser is moving to, or
+         * that waits for its cup, is not poured.  Reports OrderCancelled.
+         * @return false if orderId is neither queued nor in flight
+         */
+        bool cancelOrder ( const uint16_t orderId );
+
+        virtual void pumpsIdle ();
+        virtual void reachedToPosition ( const unsigned int position, const unsigned int stepsTaken );
+
+        /**
+         * The order the dispenser was moving for is not poured, it is
+         * reported as OrderFailed ( OrderCancelled if it was cancelled on
+         * the way )
+         */
+        virtual void moveFailed ( const unsigned int position );
+        virtual void handleDeferred ( const int event, const uint32_t arg );
+
+        inline OrderManagerState getState () const;
+        inline const IsrDuration & getProcessingTimerIsrDuration () const;
+
+        /**
+         * Latency of every order stage.  The command path records
+         * StageParse and StageEnqueue itself, OrderManager the rest.
+         */
+        inline OrderStats & getOrderStats ();
+};
+
+inline OrderManagerState OrderManager::getState () const
+{
+    return state;
+}
+
+inline bool OrderManager::isCupPresent ( const int cupIndex ) const
+{
+    return ( cupPresentMask & ( 1UL << cupIndex ) ) != 0;
+}
+
+inline const IsrDuration & OrderManager::getProcessingTimerIsrDuration () const
+{
+    return processingTimerIsrDuration;
+}
+
+inline OrderStats & OrderManager::getOrderStats ()
+{
+    return orderStats;
+}
+
+/**
+ * OrderManager with cup and pump count fixed at compile time, its scratch
+ * order lives inside the object instead of on the heap.
+ */
+template <unsigned int PUMP_COUNT>
+class OrderManagerStorage
+{
+    protected:
+        unsigned int durationStorage [ PUMP_COUNT ];
+};
+
+template <unsigned int CUP_COUNT, unsigned int PUMP_COUNT>
+class StaticOrderManager : private OrderManagerStorage <PUMP_COUNT>, public OrderManager
+{
+    public:
+        StaticOrderManager ( OrderQueue * _orderQueue, PumpControl * _pumpControl, DispenserControl * _dispenserControl )
+                : OrderManager ( CUP_COUNT, PUMP_COUNT, _orderQueue, _pumpControl, _dispenserControl, this->durationStorage )
         {
-            semaphoreLock = false;
         }
-        ;
 };
+
+#endif
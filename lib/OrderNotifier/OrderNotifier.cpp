@@ -0,0 +1,93 @@
+#include "OrderNotifier.h"
+#include "Format.h"
+
+OrderNotifier::OrderNotifier ()
+{
+    pendingCount = 0;
+    sink = NULL;
+    lastSentAt = 0;
+    sentAny = false;
+    droppedCount = 0;
+    sentCount = 0;
+}
+
+OrderNotifier::OrderNotifier ( const OrderNotifier &other )
+{
+    pendingCount = 0;
+    sink = NULL;
+    lastSentAt = 0;
+    sentAny = false;
+    droppedCount = 0;
+    sentCount = 0;
+}
+
+void OrderNotifier::setSink ( OrderNotificationSink * _sink )
+{
+    sink = _sink;
+}
+
+void OrderNotifier::orderProgress ( const OrderInfo & order, const OrderProgress progress )
+{
+    __disable_irq ();
+    for ( unsigned int i = 0; i < pendingCount; i++ )
+    {
+        if ( pending [ i ].orderId == order.orderId )
+        {
+            pending [ i ].progress = progress;
+            __enable_irq ();
+            return;
+        }
+    }
+
+    if ( pendingCount == ORDER_NOTIFIER_CAPACITY )
+    {
+        droppedCount++;
+        __enable_irq ();
+        return;
+    }
+
+    Pending &slot = pending [ pendingCount ];
+    slot.orderId = order.orderId;
+    slot.replyTo = order.replyTo;
+    slot.progress = progress;
+    pendingCount++;
+    __enable_irq ();
+}
+
+bool OrderNotifier::flush ()
+{
+    if ( ( pendingCount == 0 ) || ( sink == NULL ) )
+    {
+        return false;
+    }
+
+    uint32_t now = us_ticker_read ();
+    if ( sentAny && ( ( now - lastSentAt ) < ORDER_NOTIFIER_INTERVAL_US ) )
+    {
+        return false;
+    }
+
+    __disable_irq ();
+    Pending next = pending [ 0 ];
+    pendingCount--;
+    for ( unsigned int i = 0; i < pendingCount; i++ )
+    {
+        pending [ i ] = pending [ i + 1 ];
+    }
+    __enable_irq ();
+
+    char message [ ORDER_NOTIFIER_MESSAGE_SIZE ];
+    Format::print ( message, sizeof ( message ), "{\"order\":%u,\"event\":\"%s\"}", next.orderId, progressName ( (OrderProgress) next.progress ) );
+    sink->sendNotification ( next.replyTo, message );
+
+    lastSentAt = now;
+    sentAny = true;
+    sentCount++;
+    return true;
+}
+
+const char * OrderNotifier::progressName ( const OrderProgress progress )
+{
+    static const char * const names [ ORDER_PROGRESS_COUNT ] = { "DISPATCHED", "POURING", "PAUSED", "DONE", "FAILED", "CANCELLED" };
+    return ( progress < ORDER_PROGRESS_COUNT ) ? names [ progress ] : "?";
+}
@@ -0,0 +1,98 @@
+#ifndef BARVIS_ORDER_NOTIFIER_H_
+#define BARVIS_ORDER_NOTIFIER_H_
+
+#include "mbed.h"
+#include "OrderManager.h"
+
+#define ORDER_NOTIFIER_CAPACITY         8     // orders with a pending notification
+#define ORDER_NOTIFIER_INTERVAL_US      50000 // at most one notification per interval
+#define ORDER_NOTIFIER_MESSAGE_SIZE     48
+
+class OrderNotificationSink
+{
+    public:
+        virtual ~OrderNotificationSink ()
+        {
+        }
+        /**
+         * Writes message to the transport replyTo, main context only
+         */
+        virtual void sendNotification ( const uint8_t replyTo, const char * message ) = 0;
+};
+
+/**
+ * Pushes order progress to the transport each order came in on, as
+ *
+ *      {"order":<orderId>,"event":"<DISPATCHED|POURING|PAUSED|DONE|FAILED|CANCELLED>"}
+ *
+ * orderProgress () only notes the latest event of an order, so an order
+ * never takes more than one slot and a burst of events for it collapses
+ * into its newest state.  flush () sends at most one notification every
+ * ORDER_NOTIFIER_INTERVAL_US, the command traffic always gets the rest of
+ * the link.
+ */
+class OrderNotifier : public OrderProgressListener
+{
+    private:
+        struct Pending
+        {
+                uint16_t orderId;
+                uint8_t replyTo;
+                uint8_t progress;
+        };
+
+        Pending pending [ ORDER_NOTIFIER_CAPACITY ]; // oldest first
+        volatile unsigned int pendingCount;
+
+        OrderNotificationSink * sink;
+        uint32_t lastSentAt;
+        bool sentAny;
+
+        volatile unsigned int droppedCount;
+        unsigned int sentCount;
+
+        OrderNotifier ( const OrderNotifier &other ); // Don't allow copying at all
+
+    public:
+        OrderNotifier ();
+
+        void setSink ( OrderNotificationSink * _sink );
+
+        /**
+         * Any context
+         */
+        virtual void orderProgress ( const OrderInfo & order, const OrderProgress progress );
+
+        /**
+         * Main context, sends the oldest pending notification unless the
+         * last one went out less than ORDER_NOTIFIER_INTERVAL_US ago.
+         * @return true if one was sent
+         */
+        bool flush ();
+
+        static const char * progressName ( const OrderProgress progress );
+
+        inline unsigned int getPendingCount () const;
+        inline unsigned int getDroppedCount () const;
+        inline unsigned int getSentCount () const;
+};
+
+inline unsigned int OrderNotifier::getPendingCount () const
+{
+    return pendingCount;
+}
+
+/**
+ * Notifications lost because ORDER_NOTIFIER_CAPACITY orders were waiting
+ */
+inline unsigned int OrderNotifier::getDroppedCount () const
+{
+    return droppedCount;
+}
+
+inline unsigned int OrderNotifier::getSentCount () const
+{
+    return sentCount;
+}
+
+#endif
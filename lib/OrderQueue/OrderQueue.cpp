@@ -1,98 +1,214 @@
 #include "OrderQueue.h"
+#include "Format.h"
 
-OrderQueue::OrderQueue ( unsigned int _capacity, unsigned int _pumpCount )
-        : capacity ( _capacity ), PUMP_OPERATION_SIZE ( _pumpCount )
+OrderQueue::OrderQueue ( unsigned int _capacity, unsigned int _pumpCount, unsigned int * storage, OrderInfo * infoStorage, uint8_t * stateStorage )
+        : capacity ( _capacity ), PUMP_OPERATION_SIZE ( _pumpCount ), generationCount ( ( _capacity > 0 ) ? ( 0xFFFF / _capacity ) : 0 ), ownsQueue ( storage == NULL ), ownsOrderInfo (
+                infoStorage == NULL ), ownsSlotState ( stateStorage == NULL )
 {
-    queue = new unsigned int * [ capacity ];
+    queue = ownsQueue ? new unsigned int [ capacity * PUMP_OPERATION_SIZE ] : storage;
+    orderInfo = ownsOrderInfo ? new OrderInfo [ capacity ] : infoStorage;
+    slotState = ownsSlotState ? new uint8_t [ capacity ] : stateStorage;
 
     for ( unsigned int i = 0; i < capacity; i++ )
     {
-        queue [ i ] = new unsigned int [ PUMP_OPERATION_SIZE ];
+        orderInfo [ i ].orderId = 0;
+        slotState [ i ] = SlotFree;
     }
 
     head = 0;
     tail = 0;
-    currSize = 0;
 }
 
 OrderQueue::OrderQueue ( OrderQueue & other )
-        : capacity ( 0 ), PUMP_OPERATION_SIZE ( 0 )
+        : capacity ( 0 ), PUMP_OPERATION_SIZE ( 0 ), generationCount ( 0 ), ownsQueue ( false ), ownsOrderInfo ( false ), ownsSlotState ( false )
 {
     head = 0;
     tail = 0;
-    currSize = 0;
     queue = NULL;
+    orderInfo = NULL;
+    slotState = NULL;
 }
 
 OrderQueue::~OrderQueue ()
 {
-    for ( unsigned int i = 0; i < capacity; i++ )
+    if ( ownsQueue )
+    {
+        delete [] queue;
+    }
+    if ( ownsOrderInfo )
     {
-        delete [] queue [ i ];
+        delete [] orderInfo;
+    }
+    if ( ownsSlotState )
+    {
+        delete [] slotState;
     }
-    delete [] queue;
 }
 
-int OrderQueue::addOrder ( unsigned int * runPumpsFor )
+int OrderQueue::addOrder ( unsigned int * runPumpsFor, OrderInfo * info )
 {
-    if ( !isFull () )
+    if ( isFull () )
     {
+        return -1;
+    }
 
-        tail = ( tail + 1 ) % capacity;
+    const unsigned int slotIndex = slotOf ( tail );
+    copyDurations ( queue + ( slotIndex * PUMP_OPERATION_SIZE ), runPumpsFor );
 
-        for ( unsigned int i = 0; i < PUMP_OPERATION_SIZE; i++ )
-        {
-            queue [ tail ] [ i ] = runPumpsFor [ i ];
-        }
-        currSize++;
+    // orderId = 1 + slot + capacity * generation, the generation moves on with every reuse
+    OrderInfo &slotInfo = orderInfo [ slotIndex ];
+    const unsigned int previousId = slotInfo.orderId;
+    const unsigned int generation = ( previousId == 0 ) ? 0 : ( ( ( ( previousId - 1 ) / capacity ) + 1 ) % generationCount );
+    if ( info != NULL )
+    {
+        slotInfo = *info;
     }
-    return currSize;
+    else
+    {
+        slotInfo.receivedAt = us_ticker_read ();
+        slotInfo.replyTo = 0;
+    }
+    slotInfo.enqueuedAt = us_ticker_read ();
+    slotInfo.orderId = 1 + slotIndex + ( capacity * generation );
+    slotState [ slotIndex ] = SlotQueued;
+    if ( info != NULL )
+    {
+        info->enqueuedAt = slotInfo.enqueuedAt;
+        info->orderId = slotInfo.orderId;
+    }
+
+    __DMB (); // the order has to be complete before the consumer can see it
+    tail = nextIndex ( tail );
+    return size ();
 }
 
-int OrderQueue::removeOrder ( unsigned int * runPumpsFor )
+int OrderQueue::removeOrder ( unsigned int * runPumpsFor, OrderInfo * info )
 {
-    if ( !isEmpty () )
+    while ( !isEmpty () )
     {
+        __DMB (); // read the order only after seeing the tail that published it
+        const unsigned int slotIndex = slotOf ( head );
 
-        for ( unsigned int i = 0; i < PUMP_OPERATION_SIZE; i++ )
+        // Claim the slot, from here on cancelOrder and amendOrder leave it alone
+        __disable_irq ();
+        const bool queued = ( slotState [ slotIndex ] == SlotQueued );
+        slotState [ slotIndex ] = SlotFree;
+        __enable_irq ();
+
+        if ( queued )
         {
-            runPumpsFor [ i ] = queue [ head ] [ i ];
+            copyDurations ( runPumpsFor, queue + ( slotIndex * PUMP_OPERATION_SIZE ) );
+            if ( info != NULL )
+            {
+                *info = orderInfo [ slotIndex ];
+            }
         }
 
-        head = ( head + 1 ) % capacity;
-        currSize--;
+        __DMB (); // done with the slot before the producer may reuse it
+        head = nextIndex ( head );
+        if ( queued )
+        {
+            break;
+        }
     }
 
-    return currSize;
+    return size ();
+}
+
+bool OrderQueue::hasOrder ()
+{
+    while ( !isEmpty () )
+    {
+        __DMB (); // see removeOrder
+        const unsigned int slotIndex = slotOf ( head );
+        if ( slotState [ slotIndex ] != SlotCancelled )
+        {
+            return true;
+        }
+        slotState [ slotIndex ] = SlotFree;
+        __DMB ();
+        head = nextIndex ( head );
+    }
+    return false;
 }
 
 int OrderQueue::deleteNextOrder ()
 {
     if ( !isEmpty () )
     {
+        slotState [ slotOf ( head ) ] = SlotFree;
+        head = nextIndex ( head );
+    }
 
-        head = ( head + 1 ) % capacity;
-        currSize--;
+    return size ();
+}
+
+void OrderQueue::copyDurations ( unsigned int * to, const unsigned int * from ) const
+{
+    for ( unsigned int i = 0; i < PUMP_OPERATION_SIZE; i++ )
+    {
+        to [ i ] = from [ i ];
     }
+}
 
-    return currSize;
+bool OrderQueue::findQueued ( const uint16_t orderId, unsigned int &slot ) const
+{
+    if ( ( orderId == 0 ) || ( capacity == 0 ) )
+    {
+        return false;
+    }
+    slot = ( orderId - 1 ) % capacity;
+    return ( slotState [ slot ] == SlotQueued ) && ( orderInfo [ slot ].orderId == orderId );
+}
+
+bool OrderQueue::cancelOrder ( const uint16_t orderId, OrderInfo * info )
+{
+    unsigned int slot;
+    // The consumer may claim the slot from interrupt context, check and mark in one go
+    __disable_irq ();
+    const bool found = findQueued ( orderId, slot );
+    if ( found )
+    {
+        slotState [ slot ] = SlotCancelled;
+        if ( info != NULL )
+        {
+            *info = orderInfo [ slot ];
+        }
+    }
+    __enable_irq ();
+    return found;
+}
+
+bool OrderQueue::amendOrder ( const uint16_t orderId, const unsigned int * runPumpsFor )
+{
+    unsigned int slot;
+    __disable_irq ();
+    const bool found = findQueued ( orderId, slot );
+    if ( found )
+    {
+        copyDurations ( queue + ( slot * PUMP_OPERATION_SIZE ), runPumpsFor );
+    }
+    __enable_irq ();
+    return found;
 }
 
 void OrderQueue::print ( char * buffer ) const
 {
     int length = 0;
     buffer [ length++ ] = '{';
-    int index = tail;
-    for ( unsigned int i = 0; i < currSize; i++ )
+    unsigned int index = head;
+    const int count = size ();
+    for ( int i = 0; i < count; i++ )
     {
         buffer [ length++ ] = '[';
         for ( unsigned int j = 0; j < PUMP_OPERATION_SIZE; j++ )
         {
-            sprintf ( buffer + length, "(%3d)", queue [ index ] [ j ] );
-            length += 5;
+            buffer [ length++ ] = '(';
+            length += Format::unsignedValue ( buffer + length, 11, queue [ ( slotOf ( index ) * PUMP_OPERATION_SIZE ) + j ], 3 );
+            buffer [ length++ ] = ')';
         }
         buffer [ length++ ] = ']';
-        index = ( index + 1 ) % capacity;
+        index = nextIndex ( index );
     }
     buffer [ length++ ] = '}';
     buffer [ length ] = '\0';
@@ -3,48 +3,180 @@
 
 #include "mbed.h"
 
+/**
+ * Bookkeeping that travels through the queue with each order
+ */
+struct OrderInfo
+{
+        uint32_t receivedAt; // us_ticker_read () when the command frame came in
+        uint32_t enqueuedAt; // set by addOrder
+        uint16_t orderId;    // set by addOrder, the order's handle, never 0
+        uint8_t replyTo;     // transport the order came in on
+};
+
+/**
+ * Lock free single producer / single consumer order channel.  The command
+ * path is the only producer ( addOrder, cancelOrder, amendOrder, isFull ),
+ * OrderManager's dispatch the only consumer ( hasOrder, removeOrder,
+ * deleteNextOrder, isEmpty ); each side only ever writes its own index, so
+ * neither needs a lock and an enqueue never holds up a dispatch.
+ *
+ * Every order gets an orderId that doubles as a handle: it encodes the
+ * slot and a per slot generation that changes each time the slot is
+ * reused, so cancelOrder and amendOrder find a queued order in constant
+ * time and a stale id never matches the order that took its slot.  A
+ * cancelled order keeps its slot, and counts towards size (), until the
+ * consumer next looks at the queue.
+ */
 class OrderQueue
 {
     private:
+        enum SlotState
+        {
+            SlotFree,
+            SlotQueued,
+            SlotCancelled
+        };
+
         const unsigned int capacity;
         const unsigned int PUMP_OPERATION_SIZE;
-        unsigned int * * queue;
+        const unsigned int generationCount; // orderIds stay within 16 bits
+        unsigned int * queue; // capacity orders of PUMP_OPERATION_SIZE durations each
+        const bool ownsQueue;
+        OrderInfo * orderInfo; // one per order slot
+        const bool ownsOrderInfo;
+        volatile uint8_t * slotState; // one SlotState per order slot
+        const bool ownsSlotState;
+
+        // Both run over 0 .. 2 * capacity - 1, so full and empty differ
+        // without a shared counter or a spare slot
+        volatile unsigned int head; // oldest order, written by the consumer only
+        volatile unsigned int tail; // next free slot, written by the producer only
 
-        unsigned int head;
-        unsigned int tail;
-        unsigned int currSize;
+        inline unsigned int slotOf ( const unsigned int index ) const;
+        inline unsigned int nextIndex ( const unsigned int index ) const;
+        bool findQueued ( const uint16_t orderId, unsigned int &slot ) const;
 
         OrderQueue ( OrderQueue & other );
 
+    protected:
+        /**
+         * Copies one order's PUMP_OPERATION_SIZE durations
+         */
+        virtual void copyDurations ( unsigned int * to, const unsigned int * from ) const;
+
     public:
-        OrderQueue ( unsigned int _capacity, unsigned int _pumpCount );
+        /**
+         * storage: optional caller owned buffer of ( _capacity * _pumpCount )
+         * entries, infoStorage and stateStorage ones of _capacity entries,
+         * each allocated on the heap when NULL.  See StaticOrderQueue.
+         */
+        OrderQueue ( unsigned int _capacity, unsigned int _pumpCount, unsigned int * storage = NULL, OrderInfo * infoStorage = NULL, uint8_t * stateStorage = NULL );
         virtual ~OrderQueue ();
 
-        int addOrder ( unsigned int * runPumpsFor );
-        int removeOrder ( unsigned int * runPumpsFor );
+        /**
+         * @param info optional, stored with the order, gets its enqueuedAt
+         * and orderId stamped
+         * @return queue size including the new order, -1 if the queue was full
+         */
+        int addOrder ( unsigned int * runPumpsFor, OrderInfo * info = NULL );
+
+        /**
+         * Takes the oldest order that wasn't cancelled
+         */
+        int removeOrder ( unsigned int * runPumpsFor, OrderInfo * info = NULL );
         int deleteNextOrder ();
 
+        /**
+         * Consumer side, drops cancelled orders from the head
+         * @return true if removeOrder will find an order
+         */
+        bool hasOrder ();
+
+        /**
+         * Producer side, constant time
+         * @param info optional, receives the cancelled order's info
+         * @return false if orderId isn't queued ( any more )
+         */
+        bool cancelOrder ( const uint16_t orderId, OrderInfo * info = NULL );
+
+        /**
+         * Replaces the durations of a queued order, producer side, constant
+         * time
+         * @return false if orderId isn't queued ( any more )
+         */
+        bool amendOrder ( const uint16_t orderId, const unsigned int * runPumpsFor );
+
         inline bool isEmpty () const;
         inline bool isFull () const;
         inline int size () const;
         inline int getCapacity () const;
 
+        /**
+         * Producer side snapshot, orders the consumer takes meanwhile may
+         * still show up
+         */
         void print ( char * buffer ) const;
 };
 
+/**
+ * OrderQueue with capacity and pump count fixed at compile time, the order
+ * slots live inside the object instead of on the heap and orders are
+ * copied in and out with a PUMP_COUNT bound loop.
+ */
+template <unsigned int CAPACITY, unsigned int PUMP_COUNT>
+class OrderQueueStorage
+{
+    protected:
+        unsigned int queueStorage [ CAPACITY * PUMP_COUNT ];
+        OrderInfo orderInfoStorage [ CAPACITY ];
+        uint8_t slotStateStorage [ CAPACITY ];
+};
+
+template <unsigned int CAPACITY, unsigned int PUMP_COUNT>
+class StaticOrderQueue : private OrderQueueStorage <CAPACITY, PUMP_COUNT>, public OrderQueue
+{
+    public:
+        StaticOrderQueue ()
+                : OrderQueue ( CAPACITY, PUMP_COUNT, this->queueStorage, this->orderInfoStorage, this->slotStateStorage )
+        {
+        }
+
+    protected:
+        virtual void copyDurations ( unsigned int * to, const unsigned int * from ) const
+        {
+            for ( unsigned int i = 0; i < PUMP_COUNT; i++ )
+            {
+                to [ i ] = from [ i ];
+            }
+        }
+};
+
+inline unsigned int OrderQueue::slotOf ( const unsigned int index ) const
+{
+    return ( index < capacity ) ? index : ( index - capacity );
+}
+
+inline unsigned int OrderQueue::nextIndex ( const unsigned int index ) const
+{
+    return ( ( index + 1 ) == ( 2 * capacity ) ) ? 0 : ( index + 1 );
+}
+
 inline bool OrderQueue::isEmpty () const
 {
-    return ( currSize == 0 );
+    return ( head == tail );
 }
 
 inline bool OrderQueue::isFull () const
 {
-    return ( currSize == capacity );
+    return ( size () == (int) capacity );
 }
 
 inline int OrderQueue::size () const
 {
-    return currSize;
+    unsigned int currTail = tail;
+    unsigned int currHead = head;
+    return ( currTail >= currHead ) ? ( currTail - currHead ) : ( currTail + ( 2 * capacity ) - currHead );
 }
 
 inline int OrderQueue::getCapacity () const
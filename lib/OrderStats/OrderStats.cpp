@@ -0,0 +1,141 @@
+#include "OrderStats.h"
+#include "Format.h"
+
+LatencyHistogram::LatencyHistogram ()
+{
+    reset ();
+}
+
+void LatencyHistogram::record ( const uint32_t microSeconds )
+{
+    int bucket = 0;
+    uint32_t value = microSeconds;
+    while ( value > 1 )
+    {
+        value >>= 1;
+        bucket++;
+    }
+
+    if ( buckets [ bucket ] != 0xFFFF )
+    {
+        buckets [ bucket ]++;
+    }
+    count++;
+    if ( microSeconds > maximum )
+    {
+        maximum = microSeconds;
+    }
+}
+
+void LatencyHistogram::reset ()
+{
+    for ( int i = 0; i < ORDER_STATS_BUCKETS; i++ )
+    {
+        buckets [ i ] = 0;
+    }
+    count = 0;
+    maximum = 0;
+}
+
+uint32_t LatencyHistogram::percentile ( const unsigned int percent ) const
+{
+    uint32_t total = 0;
+    for ( int i = 0; i < ORDER_STATS_BUCKETS; i++ )
+    {
+        total += buckets [ i ];
+    }
+    if ( total == 0 )
+    {
+        return 0;
+    }
+
+    // rank of the percentile, rounded up so p99 of few samples is the largest
+    uint32_t rank = ( ( total * percent ) + 99 ) / 100;
+    uint32_t seen = 0;
+    for ( int i = 0; i < ORDER_STATS_BUCKETS; i++ )
+    {
+        seen += buckets [ i ];
+        if ( seen >= rank )
+        {
+            uint32_t upperBound = ( i == ( ORDER_STATS_BUCKETS - 1 ) ) ? 0xFFFFFFFF : ( ( 2UL << i ) - 1 );
+            return ( upperBound < maximum ) ? upperBound : maximum;
+        }
+    }
+    return maximum;
+}
+
+int LatencyHistogram::print ( char * buffer, const int bufferSize ) const
+{
+    int length = 0;
+    buffer [ 0 ] = '\0';
+    for ( int i = 0; i < ORDER_STATS_BUCKETS; i++ )
+    {
+        if ( buckets [ i ] == 0 )
+        {
+            continue;
+        }
+        int written = Format::print ( buffer + length, bufferSize - length, ( length == 0 ) ? "%d:%u" : ",%d:%u", i, (unsigned int) buckets [ i ] );
+        if ( ( written < 0 ) || ( written >= ( bufferSize - length ) ) )
+        {
+            buffer [ length ] = '\0'; // out of room, keep what fit
+            break;
+        }
+        length += written;
+    }
+    return length;
+}
+
+OrderStats::OrderStats ()
+{
+}
+
+OrderStats::OrderStats ( const OrderStats &other )
+{
+}
+
+void OrderStats::reset ()
+{
+    for ( int i = 0; i < ORDER_STAGE_COUNT; i++ )
+    {
+        stages [ i ].reset ();
+    }
+}
+
+int OrderStats::printSummary ( char * buffer, const int bufferSize ) const
+{
+    int length = 0;
+    buffer [ 0 ] = '\0';
+    for ( int i = 0; i < ORDER_STAGE_COUNT; i++ )
+    {
+        const LatencyHistogram &histogram = stages [ i ];
+        int written = Format::print ( buffer + length, bufferSize - length, "%s:%lu,%lu,%lu,%lu;", stageName ( (OrderStage) i ), (unsigned long) histogram.getCount (), (unsigned long) histogram.percentile ( 50 ), (unsigned long) histogram.percentile ( 99 ), (unsigned long) histogram.getMaximum () );
+        if ( ( written < 0 ) || ( written >= ( bufferSize - length ) ) )
+        {
+            buffer [ length ] = '\0';
+            break;
+        }
+        length += written;
+    }
+    return length;
+}
+
+const char * OrderStats::stageName ( const OrderStage stage )
+{
+    switch ( stage )
+    {
+        case StageParse:
+            return "parse";
+        case StageEnqueue:
+            return "enqueue";
+        case StageQueueWait:
+            return "wait";
+        case StageDispatch:
+            return "dispatch";
+        case StagePour:
+            return "pour";
+        case StageTotal:
+            return "total";
+        default:
+            return "?";
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef BARVIS_ORDER_STATS_H_
+#define BARVIS_ORDER_STATS_H_
+
+#include "mbed.h"
+
+// Bucket b counts latencies of [ 2^b, 2^(b+1) ) micro seconds, bucket 0
+// also takes 0, the last one everything from 2^31 up
+#define ORDER_STATS_BUCKETS     32
+
+/**
+ * Stages of an order between the command frame coming in and the pumps
+ * going idle again.  Each one is the time from the previous mark.
+ */
+enum OrderStage
+{
+    StageParse,     // frame received -> JSON parsed
+    StageEnqueue,   // parsed -> validated and queued
+    StageQueueWait, // queued -> picked by OrderManager
+    StageDispatch,  // picked -> pumps on ( dispenser travel included )
+    StagePour,      // pumps on -> pumps idle
+    StageTotal,     // frame received -> pumps idle
+    ORDER_STAGE_COUNT
+};
+
+class LatencyHistogram
+{
+    private:
+        volatile uint16_t buckets [ ORDER_STATS_BUCKETS ]; // saturate at 0xFFFF
+        volatile uint32_t count;
+        volatile uint32_t maximum;
+
+    public:
+        LatencyHistogram ();
+
+        void record ( const uint32_t microSeconds );
+        void reset ();
+
+        /**
+         * @return upper bound ( micro seconds ) of the bucket holding the
+         * given percentile, at most the maximum, 0 when nothing was recorded
+         */
+        uint32_t percentile ( const unsigned int percent ) const;
+
+        /**
+         * Writes the non empty buckets as "bucket:count,..."
+         */
+        int print ( char * buffer, const int bufferSize ) const;
+
+        inline uint32_t getCount () const;
+        inline uint32_t getMaximum () const;
+};
+
+inline uint32_t LatencyHistogram::getCount () const
+{
+    return count;
+}
+
+inline uint32_t LatencyHistogram::getMaximum () const
+{
+    return maximum;
+}
+
+/**
+ * Fixed bucket latency histogram per OrderStage, all in RAM.  record () is
+ * cheap enough for interrupt context.
+ */
+class OrderStats
+{
+    private:
+        LatencyHistogram stages [ ORDER_STAGE_COUNT ];
+
+        OrderStats ( const OrderStats &other ); // Don't allow copying at all
+
+    public:
+        OrderStats ();
+
+        inline void record ( const OrderStage stage, const uint32_t microSeconds );
+        void reset ();
+
+        /**
+         * Writes "stage:count,p50,p99,max;..." for every stage, in micro seconds
+         */
+        int printSummary ( char * buffer, const int bufferSize ) const;
+
+        inline const LatencyHistogram & getHistogram ( const OrderStage stage ) const;
+        static const char * stageName ( const OrderStage stage );
+};
+
+inline void OrderStats::record ( const OrderStage stage, const uint32_t microSeconds )
+{
+    stages [ stage ].record ( microSeconds );
+}
+
+inline const LatencyHistogram & OrderStats::getHistogram ( const OrderStage stage ) const
+{
+    return stages [ stage ];
+}
+
+#endif
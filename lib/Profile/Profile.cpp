@@ -0,0 +1,106 @@
+#include "Profile.h"
+#include "Format.h"
+
+#ifdef PROFILE_USE_DWT
+#define profileLock()       __disable_irq ()
+#define profileUnlock()     __enable_irq ()
+#else
+#if __cplusplus >= 201103L
+#include <chrono>
+#else
+#include <time.h>
+#endif
+#define profileLock()
+#define profileUnlock()
+#endif
+
+ProfileSite * Profiler::sites = NULL;
+
+void ProfileSite::record ( const uint32_t ticks )
+{
+    if ( !registered )
+    {
+        Profiler::add ( this );
+    }
+
+    count++;
+    total += ticks;
+    if ( ticks < minimum )
+    {
+        minimum = ticks;
+    }
+    if ( ticks > maximum )
+    {
+        maximum = ticks;
+    }
+}
+
+void ProfileSite::reset ()
+{
+    count = 0;
+    minimum = 0xFFFFFFFF;
+    maximum = 0;
+    total = 0;
+}
+
+Profiler::Profiler ()
+{
+}
+
+void Profiler::start ()
+{
+#ifdef PROFILE_USE_DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+#ifndef PROFILE_USE_DWT
+uint32_t Profiler::ticks ()
+{
+#if __cplusplus >= 201103L
+    return (uint32_t) std::chrono::duration_cast < std::chrono::nanoseconds > ( std::chrono::steady_clock::now ().time_since_epoch () ).count ();
+#else
+    struct timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return (uint32_t) ( ( (uint64_t) now.tv_sec * 1000000000ULL ) + now.tv_nsec );
+#endif
+}
+#endif
+
+void Profiler::add ( ProfileSite * site )
+{
+    // Sites may register from interrupt context
+    profileLock ();
+    if ( !site->registered )
+    {
+        site->next = sites;
+        sites = site;
+        site->registered = true;
+    }
+    profileUnlock ();
+}
+
+void Profiler::reset ()
+{
+    for ( ProfileSite * site = sites; site != NULL; site = site->next )
+    {
+        profileLock ();
+        site->reset ();
+        profileUnlock ();
+    }
+}
+
+int Profiler::print ( const ProfileSite * site, char * buffer, const int bufferSize )
+{
+    profileLock (); // one consistent snapshot
+    uint32_t count = site->count;
+    uint32_t minimum = site->minimum;
+    uint32_t maximum = site->maximum;
+    uint64_t total = site->total;
+    profileUnlock ();
+
+    uint32_t average = ( count == 0 ) ? 0 : (uint32_t) ( total / count );
+    return Format::print ( buffer, bufferSize, "%-12s %8lu %8lu %8lu %8lu", site->name, (unsigned long) count, (unsigned long) ( ( count == 0 ) ? 0 : minimum ), (unsigned long) average, (unsigned long) maximum );
+}
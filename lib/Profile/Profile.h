@@ -0,0 +1,116 @@
+#ifndef BARVIS_PROFILE_H_
+#define BARVIS_PROFILE_H_
+
+/**
+ * Scoped hot path profiling.  Build with BARVIS_PROFILE ( see build_flags
+ * in platformio.ini ) and put
+ *
+ *      PROFILE_SCOPE ( "setData" );
+ *
+ * at the top of a function: every run adds its duration to a per site
+ * count / min / max / total kept in a static ProfileSite.  Sites register
+ * themselves on their first run, Profiler walks them for a dump.
+ *
+ * On Cortex-M3/M4 targets the duration is taken from the DWT cycle counter
+ * ( CPU cycles ), on a host build from std::chrono::steady_clock ( or the
+ * monotonic clock before C++11, nano seconds ).  Without BARVIS_PROFILE the
+ * macros compile to nothing.
+ */
+#if defined ( __ARM_ARCH_7M__ ) || defined ( __ARM_ARCH_7EM__ )
+#include "mbed.h"
+#define PROFILE_USE_DWT
+#define PROFILE_TICK_UNIT   "cycles"
+#else
+#include <stdint.h>
+#include <stddef.h>
+#define PROFILE_TICK_UNIT   "ns"
+#endif
+
+struct ProfileSite
+{
+        const char * name;
+        volatile uint32_t count;
+        volatile uint32_t minimum;
+        volatile uint32_t maximum;
+        volatile uint64_t total;
+        ProfileSite * next;
+        volatile bool registered;
+
+        void record ( const uint32_t ticks );
+        void reset ();
+};
+
+class Profiler
+{
+    private:
+        static ProfileSite * sites;
+
+        Profiler ();
+
+    public:
+        /**
+         * Starts the cycle counter, call once at boot
+         */
+        static void start ();
+
+        static uint32_t ticks ();
+
+        static void add ( ProfileSite * site );
+        static void reset ();
+
+        /**
+         * Sites in most recently registered first order, iterate with ->next
+         */
+        static inline ProfileSite * firstSite ();
+
+        /**
+         * Writes one site as "name count min avg max" ( ticks )
+         */
+        static int print ( const ProfileSite * site, char * buffer, const int bufferSize );
+};
+
+class ProfileScope
+{
+    private:
+        ProfileSite & site;
+        const uint32_t start;
+
+        ProfileScope ( const ProfileScope &other );
+
+    public:
+        ProfileScope ( ProfileSite & _site )
+                : site ( _site ), start ( Profiler::ticks () )
+        {
+        }
+
+        ~ProfileScope ()
+        {
+            site.record ( Profiler::ticks () - start );
+        }
+};
+
+inline ProfileSite * Profiler::firstSite ()
+{
+    return sites;
+}
+
+#ifdef PROFILE_USE_DWT
+inline uint32_t Profiler::ticks ()
+{
+    return DWT->CYCCNT;
+}
+#endif
+
+#define PROFILE_CONCAT_(a,b)    a##b
+#define PROFILE_CONCAT(a,b)     PROFILE_CONCAT_(a,b)
+
+#ifdef BARVIS_PROFILE
+// Aggregate initialised, so the site needs no guarded static construction
+#define PROFILE_SCOPE(siteName) \
+    static ProfileSite PROFILE_CONCAT(profileSite, __LINE__) = { siteName, 0, 0xFFFFFFFF, 0, 0, NULL, false }; \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__) ( PROFILE_CONCAT(profileSite, __LINE__) )
+#else
+#define PROFILE_SCOPE(siteName)
+#endif
+
+#endif
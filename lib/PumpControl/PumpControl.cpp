@@ -1,29 +1,41 @@
 #include "PumpControl.h"
 
-PumpControl::PumpControl ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int pumpCount )
-        : ShiftRegister ( _dataPin, _latchPin, _clockPin, _enablePin, _resetPin, pumpCount )
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+PumpControl::PumpControl ( PortName _dataPort, const uint8_t * _dataPortBits, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int pumpCount, unsigned int * runningTimeStorage, uint8_t * imageStorage )
+        : ShiftRegister ( _dataPort, _dataPortBits, _latchPin, _clockPin, _enablePin, _resetPin, pumpCount, imageStorage ), ownsPumpRunningTime ( runningTimeStorage == NULL )
+#else
+PumpControl::PumpControl ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int pumpCount, unsigned int * runningTimeStorage, uint8_t * imageStorage )
+        : ShiftRegister ( _dataPin, _latchPin, _clockPin, _enablePin, _resetPin, pumpCount, imageStorage ), ownsPumpRunningTime ( runningTimeStorage == NULL )
+#endif
 {
     isExecuteSemaphoreLock = false;
-    pumpTimer = new Ticker ();
-    pumpRunningTime = new unsigned int [ numberOfPins ];
+    listener = NULL;
+    pumpRunningTime = ownsPumpRunningTime ? new unsigned int [ numberOfPins ] : runningTimeStorage;
     resetPumps ();
-    pumpTimer->attach_us ( this, &PumpControl::atPumpTimer, 1000000 );
+    pumpTimer.attach_us ( this, &PumpControl::atPumpTimer, 1000000 );
 }
 
 PumpControl::PumpControl ( const PumpControl & other )
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+        : ShiftRegister ( PortA, NULL, D0, D0, D0, D0, 0 )
+#else
         : ShiftRegister ( D0, D0, D0, D0, D0, 0 )
+#endif
+        , ownsPumpRunningTime ( false )
 {
     isExecuteSemaphoreLock = false;
-    pumpTimer = NULL;
+    listener = NULL;
     pumpRunningTime = NULL;
 }
 
 PumpControl::~PumpControl ()
 {
-    pumpTimer->detach ();
+    pumpTimer.detach ();
 
-    delete pumpTimer;
-    delete [] pumpRunningTime;
+    if ( ownsPumpRunningTime )
+    {
+        delete [] pumpRunningTime;
+    }
 }
 
 void PumpControl::pinStateChanged ( const PinName pin, const int pinId, const bool pinValue )
@@ -48,25 +60,55 @@ void PumpControl::resetPumps ()
     masterReset ();
 }
 
+bool PumpControl::cancelPumps ()
+{
+    if ( pumpControllerState == Idle )
+    {
+        return false;
+    }
+
+    // The pump timer counts the same entries down
+    __disable_irq ();
+    for ( unsigned int i = 0; i < numberOfPins; i++ )
+    {
+        pumpRunningTime [ i ] = 0;
+    }
+    __enable_irq ();
+
+    if ( pumpControllerState == Paused )
+    {
+        setData (); // latch every output LOW while they are still disabled
+        enableOutput ();
+        pumpControllerState = Executing;
+    }
+
+    executePumpTimers ();
+    return true;
+}
+
 void PumpControl::atPumpTimer ()
 {
-    if ( pumpControllerState == Executing )
+    IsrDurationScope isrDuration ( pumpTimerIsrDuration );
+    PROFILE_SCOPE ( "atPumpTimer" );
+
+    if ( ( pumpControllerState == Executing ) && countDown () )
     {
-        bool stateChanged = false;
-        for ( unsigned int i = 0; i < numberOfPins; i++ )
-        {
-            if ( pumpRunningTime [ i ] > 0 )
-            {
-                pumpRunningTime [ i ]--;
-                stateChanged = true;
-            }
-        }
+        executePumpTimers ();
+    }
+}
 
-        if ( stateChanged )
+bool PumpControl::countDown ()
+{
+    bool running = false;
+    for ( unsigned int i = 0; i < numberOfPins; i++ )
+    {
+        if ( pumpRunningTime [ i ] > 0 )
         {
-            executePumpTimers ();
+            pumpRunningTime [ i ]--;
+            running = true;
         }
     }
+    return running;
 }
 
 void PumpControl::executePumpTimers ()
@@ -75,6 +117,7 @@ void PumpControl::executePumpTimers ()
     {
         isExecuteSemaphoreLock = true;
 
+        bool wasExecuting = ( pumpControllerState == Executing );
         unsigned int highBits = setData ();
 
         if ( highBits == 0 )
@@ -87,7 +130,31 @@ void PumpControl::executePumpTimers ()
         }
 
         isExecuteSemaphoreLock = false;
+
+        // Outside the lock, the listener may well start the next order
+        if ( wasExecuting && ( highBits == 0 ) && ( listener != NULL ) )
+        {
+            listener->pumpsIdle ();
+        }
+    }
+}
+
+void PumpControl::setListener ( PumpControlListener * _listener )
+{
+    listener = _listener;
+}
+
+unsigned int PumpControl::getRemainingTime () const
+{
+    unsigned int remaining = 0;
+    for ( unsigned int i = 0; i < numberOfPins; i++ )
+    {
+        if ( pumpRunningTime [ i ] > remaining )
+        {
+            remaining = pumpRunningTime [ i ];
+        }
     }
+    return remaining;
 }
 
 bool PumpControl::runPumpsFor ( unsigned int * durations )
@@ -108,20 +175,28 @@ bool PumpControl::runPumpsFor ( unsigned int * durations )
 
 void PumpControl::pausePumps ()
 {
-    if ( pumpControllerState == Executing )
+    // Called from main and from the cup sensor interrupt.  The pump timer
+    // mustn't end the pour in between, a pour with nothing left to run is
+    // left to go idle instead of being paused for good.
+    __disable_irq ();
+    if ( ( pumpControllerState == Executing ) && ( getRemainingTime () > 0 ) )
     {
         disableOutput ();
         pumpControllerState = Paused; // Explicitly set it to Paused
     }
+    __enable_irq ();
 }
 
 void PumpControl::resumePumps ()
 {
+    // A lost cup pauses from interrupt context, it mustn't land in between
+    __disable_irq ();
     if ( pumpControllerState == Paused )
     {
         enableOutput ();
         pumpControllerState = Executing;
     }
+    __enable_irq ();
 }
 
 bool PumpControl::testValueAt ( const int &index ) const
@@ -4,6 +4,7 @@
 #include "mbed.h"
 #include "IrSensorPin.h"
 #include "ShiftRegister.h"
+#include "DeferredQueue.h"
 
 #define __PUMPCONTROL_DURATION_MAX_SECS__   300
 
@@ -15,6 +16,20 @@ enum PumpControllerState
     Executing
 };
 
+class PumpControlListener
+{
+    public:
+        virtual ~PumpControlListener ()
+        {
+        }
+        /**
+         * Called from the pump timer interrupt right after the last running
+         * pump was switched off, i.e. every output is LOW.  Keep it short,
+         * or post to a DeferredQueue.
+         */
+        virtual void pumpsIdle () = 0;
+};
+
 class PumpControl : private ShiftRegister, public IrSensorListener
 {
     private:
@@ -23,9 +38,13 @@ class PumpControl : private ShiftRegister, public IrSensorListener
         volatile bool isExecuteSemaphoreLock;
 
         unsigned int * pumpRunningTime;
+        const bool ownsPumpRunningTime;
 
-        Ticker * pumpTimer;
+        Ticker pumpTimer;
         void atPumpTimer ();
+        IsrDuration pumpTimerIsrDuration;
+
+        PumpControlListener * listener;
 
         void executePumpTimers ();
 
@@ -33,8 +52,24 @@ class PumpControl : private ShiftRegister, public IrSensorListener
 
         bool testValueAt ( const int &index ) const;
 
+    protected:
+        /**
+         * One pump timer tick: takes a second off every running pump
+         * @return true if any pump was running
+         */
+        virtual bool countDown ();
+
     public:
-        PumpControl ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int pumpCount = 0 );
+        /**
+         * runningTimeStorage ( pumpCount entries ) and imageStorage ( see
+         * ShiftRegister ) are optional caller owned buffers, when NULL they
+         * are allocated on the heap.  StaticPumpControl provides both.
+         */
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+        PumpControl ( PortName _dataPort, const uint8_t * _dataPortBits, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int pumpCount = 0, unsigned int * runningTimeStorage = NULL, uint8_t * imageStorage = NULL );
+#else
+        PumpControl ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int pumpCount = 0, unsigned int * runningTimeStorage = NULL, uint8_t * imageStorage = NULL );
+#endif
         virtual ~PumpControl ();
 
         virtual bool runPumpsFor ( unsigned int * durations );
@@ -42,12 +77,91 @@ class PumpControl : private ShiftRegister, public IrSensorListener
         virtual void resumePumps ();
         virtual void resetPumps ();
 
+        /**
+         * Ends the running pour early: every pump is switched off through
+         * the normal output path, a pause is lifted, and the listener gets
+         * pumpsIdle as if the pour had run out.  Unlike resetPumps the
+         * shift registers aren't reset.
+         * @return false if no pour was running or paused
+         */
+        virtual bool cancelPumps ();
+
         virtual void pinStateChanged ( const PinName pin, const int pinId, const bool pinValue );
 
+        void setListener ( PumpControlListener * _listener );
+
+        /**
+         * @return timer ticks ( seconds ) until the last running pump stops
+         */
+        unsigned int getRemainingTime () const;
+
         inline PumpControllerState getState () const;
         inline unsigned int getPumpCount () const;
         inline bool isValidId ( const unsigned int id ) const;
         inline bool isValidDuration ( const int duration ) const;
+
+        inline unsigned int getShiftCount () const;
+        inline unsigned int getSkippedShiftCount () const;
+        inline const IsrDuration & getPumpTimerIsrDuration () const;
+};
+
+/**
+ * PumpControl for a pump count fixed at compile time, all of its arrays
+ * live inside the object instead of on the heap and the per tick loops
+ * ( countdown, output image ) run to PUMP_COUNT instead of a runtime bound.
+ */
+template <unsigned int PUMP_COUNT>
+class PumpControlStorage
+{
+    protected:
+        unsigned int pumpRunningTimeStorage [ PUMP_COUNT ];
+        uint8_t shiftRegisterImageStorage [ SHIFT_REGISTER_IMAGE_STORAGE_SIZE ( PUMP_COUNT ) ];
+};
+
+template <unsigned int PUMP_COUNT>
+class StaticPumpControl : private PumpControlStorage <PUMP_COUNT>, public PumpControl
+{
+    public:
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+        StaticPumpControl ( PortName _dataPort, const uint8_t * _dataPortBits, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin )
+                : PumpControl ( _dataPort, _dataPortBits, _latchPin, _clockPin, _enablePin, _resetPin, PUMP_COUNT, this->pumpRunningTimeStorage, this->shiftRegisterImageStorage )
+        {
+        }
+#else
+        StaticPumpControl ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin )
+                : PumpControl ( _dataPin, _latchPin, _clockPin, _enablePin, _resetPin, PUMP_COUNT, this->pumpRunningTimeStorage, this->shiftRegisterImageStorage )
+        {
+        }
+#endif
+
+    protected:
+        virtual bool countDown ()
+        {
+            bool running = false;
+            for ( unsigned int i = 0; i < PUMP_COUNT; i++ )
+            {
+                if ( this->pumpRunningTimeStorage [ i ] > 0 )
+                {
+                    this->pumpRunningTimeStorage [ i ]--;
+                    running = true;
+                }
+            }
+            return running;
+        }
+
+        virtual unsigned int renderImage ( uint8_t * image ) const
+        {
+            unsigned int highBits = 0;
+            for ( unsigned int i = 0; i < PUMP_COUNT; i++ )
+            {
+                if ( this->pumpRunningTimeStorage [ i ] > 0 )
+                {
+                    image [ i >> 3 ] |= ( 1 << ( i & 0x07 ) );
+                    highBits++;
+                }
+            }
+            return highBits;
+        }
 };
 
 inline PumpControllerState PumpControl::getState () const
@@ -70,4 +184,19 @@ inline bool PumpControl::isValidDuration ( const int duration ) const
     return ( ( duration >= 0 ) && ( duration <= __PUMPCONTROL_DURATION_MAX_SECS__ ) );
 }
 
+inline unsigned int PumpControl::getShiftCount () const
+{
+    return ShiftRegister::getShiftCount ();
+}
+
+inline unsigned int PumpControl::getSkippedShiftCount () const
+{
+    return ShiftRegister::getSkippedShiftCount ();
+}
+
+inline const IsrDuration & PumpControl::getPumpTimerIsrDuration () const
+{
+    return pumpTimerIsrDuration;
+}
+
 #endif
@@ -0,0 +1,121 @@
+#include "RecipeBook.h"
+#include <string.h>
+
+#define RECIPE_STEP_RECORD_SIZE 3 // pump, duration low, duration high
+
+RecipeBook::RecipeBook ( KvStore * _kvStore, const unsigned int _firstKey )
+        : kvStore ( _kvStore ), firstKey ( _firstKey )
+{
+    for ( unsigned int i = 0; i < RECIPE_BOOK_SIZE; i++ )
+    {
+        recipes [ i ].stepCount = 0;
+    }
+}
+
+RecipeBook::RecipeBook ( const RecipeBook &other )
+        : kvStore ( NULL ), firstKey ( 0 )
+{
+    for ( unsigned int i = 0; i < RECIPE_BOOK_SIZE; i++ )
+    {
+        recipes [ i ].stepCount = 0;
+    }
+}
+
+RecipeStoreResult RecipeBook::store ( const unsigned int id, const unsigned int * durations, const unsigned int pumpCount )
+{
+    if ( id >= RECIPE_BOOK_SIZE )
+    {
+        return RecipeInvalidId;
+    }
+
+    Recipe recipe;
+    recipe.stepCount = 0;
+    for ( unsigned int pump = 0; pump < pumpCount; pump++ )
+    {
+        if ( durations [ pump ] == 0 )
+        {
+            continue;
+        }
+        if ( recipe.stepCount == RECIPE_MAX_STEPS )
+        {
+            return RecipeTooManySteps;
+        }
+        recipe.steps [ recipe.stepCount ].pump = pump;
+        recipe.steps [ recipe.stepCount ].duration = durations [ pump ];
+        recipe.stepCount++;
+    }
+
+    if ( !persist ( id, recipe ) )
+    {
+        return RecipeNotPersisted;
+    }
+    recipes [ id ] = recipe;
+    return RecipeStored;
+}
+
+bool RecipeBook::persist ( const unsigned int id, const Recipe &recipe )
+{
+    if ( kvStore == NULL )
+    {
+        return true;
+    }
+
+    uint8_t record [ RECIPE_MAX_STEPS * RECIPE_STEP_RECORD_SIZE ];
+    for ( unsigned int i = 0; i < recipe.stepCount; i++ )
+    {
+        record [ ( i * RECIPE_STEP_RECORD_SIZE ) + 0 ] = recipe.steps [ i ].pump;
+        record [ ( i * RECIPE_STEP_RECORD_SIZE ) + 1 ] = ( uint8_t ) recipe.steps [ i ].duration;
+        record [ ( i * RECIPE_STEP_RECORD_SIZE ) + 2 ] = ( uint8_t ) ( recipe.steps [ i ].duration >> 8 );
+    }
+    // An empty record removes the key
+    return kvStore->put ( firstKey + id, record, recipe.stepCount * RECIPE_STEP_RECORD_SIZE );
+}
+
+unsigned int RecipeBook::load ()
+{
+    unsigned int loaded = 0;
+    if ( kvStore == NULL )
+    {
+        return loaded;
+    }
+
+    for ( unsigned int id = 0; id < RECIPE_BOOK_SIZE; id++ )
+    {
+        uint8_t record [ RECIPE_MAX_STEPS * RECIPE_STEP_RECORD_SIZE ];
+        const int length = kvStore->get ( firstKey + id, record, sizeof ( record ) );
+        recipes [ id ].stepCount = 0;
+        if ( ( length <= 0 ) || ( length > ( int ) sizeof ( record ) ) || ( ( length % RECIPE_STEP_RECORD_SIZE ) != 0 ) )
+        {
+            continue;
+        }
+
+        Recipe &recipe = recipes [ id ];
+        recipe.stepCount = length / RECIPE_STEP_RECORD_SIZE;
+        for ( unsigned int i = 0; i < recipe.stepCount; i++ )
+        {
+            recipe.steps [ i ].pump = record [ ( i * RECIPE_STEP_RECORD_SIZE ) + 0 ];
+            recipe.steps [ i ].duration = record [ ( i * RECIPE_STEP_RECORD_SIZE ) + 1 ] | ( record [ ( i * RECIPE_STEP_RECORD_SIZE ) + 2 ] << 8 );
+        }
+        loaded++;
+    }
+    return loaded;
+}
+
+bool RecipeBook::expand ( const unsigned int id, unsigned int * durations, const unsigned int pumpCount ) const
+{
+    if ( !isDefined ( id ) )
+    {
+        return false;
+    }
+
+    memset ( durations, 0, pumpCount * sizeof ( unsigned int ) );
+    const Recipe &recipe = recipes [ id ];
+    for ( unsigned int i = 0; i < recipe.stepCount; i++ )
+    {
+        if ( recipe.steps [ i ].pump < pumpCount )
+        {
+            durations [ recipe.steps [ i ].pump ] = recipe.steps [ i ].duration;
+        }
+    }
+    return true;
+}
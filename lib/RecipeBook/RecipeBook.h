@@ -0,0 +1,91 @@
+#ifndef BARVIS_RECIPE_BOOK_H_
+#define BARVIS_RECIPE_BOOK_H_
+
+#include "mbed.h"
+#include "KvStore.h"
+
+#define RECIPE_BOOK_SIZE        16 // recipes, numbered 0 .. RECIPE_BOOK_SIZE - 1
+#define RECIPE_MAX_STEPS        8  // pumps a single recipe may run
+
+struct RecipeStep
+{
+        uint8_t pump;
+        uint16_t duration;
+};
+
+struct Recipe
+{
+        uint8_t stepCount; // 0: not defined
+        RecipeStep steps [ RECIPE_MAX_STEPS ];
+};
+
+enum RecipeStoreResult
+{
+    RecipeStored,
+    RecipeInvalidId,
+    RecipeTooManySteps,  // more than RECIPE_MAX_STEPS pumps
+    RecipeNotPersisted   // the KvStore write failed, the previous recipe is kept
+};
+
+/**
+ * Fixed size table of pump plans uploaded once ( SET ) and ordered by
+ * number afterwards ( ORDER ).  Plans are validated by the caller before
+ * they are stored, expanding one into an order is a plain copy.
+ *
+ * Given a KvStore, recipe id is kept as key firstKey + id, 3 bytes per
+ * step, and load () brings the book back after a reboot.
+ */
+class RecipeBook
+{
+    private:
+        Recipe recipes [ RECIPE_BOOK_SIZE ];
+
+        KvStore * kvStore;
+        const unsigned int firstKey;
+
+        RecipeBook ( const RecipeBook &other ); // Don't allow copying at all
+
+        bool persist ( const unsigned int id, const Recipe &recipe );
+
+    public:
+        /**
+         * @param _kvStore optional, NULL keeps the recipes in RAM only
+         * @param _firstKey first of RECIPE_BOOK_SIZE keys owned in _kvStore
+         */
+        RecipeBook ( KvStore * _kvStore = NULL, const unsigned int _firstKey = 0 );
+
+        /**
+         * Reads every recipe back from the store
+         * @return number of recipes loaded
+         */
+        unsigned int load ();
+
+        /**
+         * Stores the non zero entries of durations ( pumpCount of them ) as
+         * recipe id, an all zero plan removes the recipe.  The recipe is
+         * persisted first and only replaced in RAM once that worked, so
+         * RAM and the store never disagree.
+         */
+        RecipeStoreResult store ( const unsigned int id, const unsigned int * durations, const unsigned int pumpCount );
+
+        /**
+         * Writes recipe id as a full durations array of pumpCount entries
+         * @return false if the recipe isn't defined
+         */
+        bool expand ( const unsigned int id, unsigned int * durations, const unsigned int pumpCount ) const;
+
+        inline bool isDefined ( const unsigned int id ) const;
+        inline const Recipe * getRecipe ( const unsigned int id ) const;
+};
+
+inline bool RecipeBook::isDefined ( const unsigned int id ) const
+{
+    return ( id < RECIPE_BOOK_SIZE ) && ( recipes [ id ].stepCount != 0 );
+}
+
+inline const Recipe * RecipeBook::getRecipe ( const unsigned int id ) const
+{
+    return isDefined ( id ) ? &recipes [ id ] : NULL;
+}
+
+#endif
@@ -1,45 +1,192 @@
 #include "ShiftRegister.h"
 
-ShiftRegister::ShiftRegister ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int totalPinCount )
-        : dataPin ( _dataPin ), latchPin ( _latchPin ), clockPin ( _clockPin ), enablePin ( _enablePin ), resetPin ( _resetPin ), numberOfPins ( totalPinCount )
+#ifdef SHIFT_REGISTER_USE_SPI
+
+ShiftRegister::ShiftRegister ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int totalPinCount, uint8_t * imageStorage )
+        : spi ( _dataPin, NC, _clockPin ), latchPin ( _latchPin ), enablePin ( _enablePin ), resetPin ( _resetPin ), imageSize ( ( totalPinCount + 7 ) / 8 ), numberOfPins ( totalPinCount )
 {
     enablePin = HIGH;   //diable the output
+    spi.format ( 8, 0 ); // 75HC595 shifts on the rising edge of SHCP, i.e. SPI mode 0
+    spi.frequency ( SHIFT_REGISTER_SPI_FREQUENCY );
+    initImages ( imageStorage );
     masterReset ();
 }
 
 ShiftRegister::ShiftRegister ( const ShiftRegister & other )
-        : dataPin ( D0 ), latchPin ( D0 ), clockPin ( D0 ), enablePin ( D0 ), resetPin ( D0 ), numberOfPins ( 0 )
+        : spi ( NC, NC, NC ), latchPin ( D0 ), enablePin ( D0 ), resetPin ( D0 ), imageSize ( 0 ), numberOfPins ( 0 )
 {
+    outputImage = NULL;
+    latchedImage = NULL;
+    ownsImageStorage = false;
+    shiftCount = 0;
+    skippedShiftCount = 0;
 }
 
-ShiftRegister::~ShiftRegister ()
+void ShiftRegister::shiftOut ()
 {
+    latchPin.write ( LOW );
+    // Highest byte first, its unused (LOW) pad bits fall off the far end of the chain
+    for ( int i = ( imageSize - 1 ); i >= 0; i-- )
+    {
+        spi.write ( outputImage [ i ] ); // blocks until the byte is on the wire
+    }
+    latchPin.write ( HIGH );
 }
 
-unsigned int ShiftRegister::setData ()
+#elif defined ( SHIFT_REGISTER_PARALLEL_CHAINS )
+
+uint32_t ShiftRegister::dataPortMask ( const uint8_t * bitNumbers )
+{
+    uint32_t mask = 0;
+    for ( int c = 0; ( bitNumbers != NULL ) && ( c < SHIFT_REGISTER_PARALLEL_CHAINS ); c++ )
+    {
+        mask |= ( 1UL << bitNumbers [ c ] ); // bit 31 is a port bit like any other
+    }
+    return mask;
+}
+
+ShiftRegister::ShiftRegister ( PortName _dataPort, const uint8_t * _dataPortBits, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int totalPinCount, uint8_t * imageStorage )
+        : dataPort ( _dataPort, dataPortMask ( _dataPortBits ) ), clockPin ( _clockPin ), latchPin ( _latchPin ), enablePin ( _enablePin ), resetPin ( _resetPin ), imageSize ( ( totalPinCount + 7 ) / 8 ), numberOfPins ( totalPinCount )
+{
+    enablePin = HIGH;   //diable the output
+    for ( int c = 0; c < SHIFT_REGISTER_PARALLEL_CHAINS; c++ )
+    {
+        dataPortBits [ c ] = ( _dataPortBits != NULL ) ? ( 1UL << _dataPortBits [ c ] ) : 0;
+    }
+    initImages ( imageStorage );
+    masterReset ();
+}
+
+ShiftRegister::ShiftRegister ( const ShiftRegister & other )
+        : dataPort ( PortA, 0 ), clockPin ( D0 ), latchPin ( D0 ), enablePin ( D0 ), resetPin ( D0 ), imageSize ( 0 ), numberOfPins ( 0 )
+{
+    outputImage = NULL;
+    latchedImage = NULL;
+    ownsImageStorage = false;
+    shiftCount = 0;
+    skippedShiftCount = 0;
+}
+
+void ShiftRegister::shiftOut ()
+{
+    const int pinsPerChain = ( numberOfPins + SHIFT_REGISTER_PARALLEL_CHAINS - 1 ) / SHIFT_REGISTER_PARALLEL_CHAINS;
+
+    latchPin.write ( LOW );
+
+    for ( int i = ( pinsPerChain - 1 ); i >= 0; i-- )
+    {
+        uint32_t portValue = 0;
+        for ( int c = 0, pin = i; c < SHIFT_REGISTER_PARALLEL_CHAINS; c++, pin += pinsPerChain )
+        {
+            if ( ( pin < (int) numberOfPins ) && ( ( outputImage [ pin >> 3 ] >> ( pin & 0x07 ) ) & 0x01 ) )
+            {
+                portValue |= dataPortBits [ c ];
+            }
+        }
+
+        clockPin.write ( LOW );
+        dataPort.write ( portValue );
+        clockPin.write ( HIGH );
+    }
+    latchPin.write ( HIGH );
+}
+
+#else
+
+ShiftRegister::ShiftRegister ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int totalPinCount, uint8_t * imageStorage )
+        : dataPin ( _dataPin ), clockPin ( _clockPin ), latchPin ( _latchPin ), enablePin ( _enablePin ), resetPin ( _resetPin ), imageSize ( ( totalPinCount + 7 ) / 8 ), numberOfPins ( totalPinCount )
+{
+    enablePin = HIGH;   //diable the output
+    initImages ( imageStorage );
+    masterReset ();
+}
+
+ShiftRegister::ShiftRegister ( const ShiftRegister & other )
+        : dataPin ( D0 ), clockPin ( D0 ), latchPin ( D0 ), enablePin ( D0 ), resetPin ( D0 ), imageSize ( 0 ), numberOfPins ( 0 )
 {
-    int highBits = 0;
+    outputImage = NULL;
+    latchedImage = NULL;
+    ownsImageStorage = false;
+    shiftCount = 0;
+    skippedShiftCount = 0;
+}
 
+void ShiftRegister::shiftOut ()
+{
     latchPin.write ( LOW );
 
     for ( int i = ( numberOfPins - 1 ); i >= 0; i-- )
     {
         clockPin.write ( LOW );
+        dataPin.write ( ( outputImage [ i >> 3 ] >> ( i & 0x07 ) ) & 0x01 );
+        clockPin.write ( HIGH );
+    }
+    latchPin.write ( HIGH );
+}
+
+#endif
+
+ShiftRegister::~ShiftRegister ()
+{
+    if ( ownsImageStorage )
+    {
+        delete [] outputImage;
+    }
+}
 
+void ShiftRegister::initImages ( uint8_t * imageStorage )
+{
+    ownsImageStorage = ( imageStorage == NULL );
+    if ( ownsImageStorage )
+    {
+        imageStorage = new uint8_t [ SHIFT_REGISTER_IMAGE_STORAGE_SIZE ( numberOfPins ) ];
+    }
+    outputImage = imageStorage;
+    latchedImage = imageStorage + imageSize;
+
+    shiftCount = 0;
+    skippedShiftCount = 0;
+}
+
+unsigned int ShiftRegister::setData ()
+{
+    PROFILE_SCOPE ( "setData" );
+    memset ( outputImage, 0, imageSize );
+    const unsigned int highBits = renderImage ( outputImage );
+
+    if ( memcmp ( outputImage, latchedImage, imageSize ) == 0 )
+    {
+        skippedShiftCount++;
+        return highBits;
+    }
+
+    shiftOut ();
+    memcpy ( latchedImage, outputImage, imageSize );
+    shiftCount++;
+
+#ifdef BARVIS_TRACE
+    uint32_t firstOutputs = 0;
+    for ( unsigned int i = 0; ( i < imageSize ) && ( i < sizeof ( firstOutputs ) ); i++ )
+    {
+        firstOutputs |= ( (uint32_t) outputImage [ i ] ) << ( 8 * i );
+    }
+    TRACE( TracePumpOutputs, highBits, firstOutputs );
+#endif
+
+    return highBits;
+}
+
+unsigned int ShiftRegister::renderImage ( uint8_t * image ) const
+{
+    unsigned int highBits = 0;
+    for ( unsigned int i = 0; i < numberOfPins; i++ )
+    {
         if ( testValueAt ( i ) == true )
         {
-            dataPin.write ( HIGH );
+            image [ i >> 3 ] |= ( 1 << ( i & 0x07 ) );
             highBits++;
         }
-        else
-        {
-            dataPin.write ( LOW );
-        }
-
-        clockPin.write ( HIGH );
     }
-    latchPin.write ( HIGH );
-
     return highBits;
 }
 
@@ -55,6 +202,8 @@ bool ShiftRegister::masterReset ()
     resetPin = HIGH;
     enablePin = LOW; // enable the Output, after reset
 
+    memset ( latchedImage, 0, imageSize ); // storage registers now hold all LOW
+
     return true;
 }
 
@@ -2,6 +2,8 @@
 #define LIB_SHIFTREGISTER_SHIFTREGISTER_H_
 
 #include "mbed.h"
+#include "Profile.h"
+#include "Trace.h"
 
 /**
  *      74HC595 & 74HCT595 Pinouts
@@ -54,15 +56,62 @@
  * ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
  */
 
+/**
+ * Define SHIFT_REGISTER_USE_SPI (see build_flags in platformio.ini) to drive
+ * DS and SHCP from the hardware SPI peripheral instead of bit-banging them
+ * through DigitalOut.  In that case _dataPin must be a MOSI and _clockPin a
+ * SCK capable pin; latch, enable and reset stay plain GPIOs.
+ */
+#ifndef SHIFT_REGISTER_SPI_FREQUENCY
+#define SHIFT_REGISTER_SPI_FREQUENCY    8000000
+#endif
+
+/**
+ * Define SHIFT_REGISTER_PARALLEL_CHAINS=<n> to split the pins over n
+ * daisy chains of equal length that share SHCP, STCP, OE and MR but each
+ * have their own DS line.  All DS lines must sit on the same GPIO port, so
+ * one port write presents the next bit of every chain before each clock
+ * edge and the update time depends on the chain length only.  Chain c
+ * carries pins [ c * pinsPerChain, ( c + 1 ) * pinsPerChain ).
+ */
+/**
+ * Bytes of image storage a chain of n pins needs, for callers that hand
+ * ShiftRegister its storage instead of letting it allocate from the heap.
+ */
+#define SHIFT_REGISTER_IMAGE_STORAGE_SIZE(n)    ( 2 * ( ( (n) + 7 ) / 8 ) )
+
+#if defined ( SHIFT_REGISTER_USE_SPI ) && defined ( SHIFT_REGISTER_PARALLEL_CHAINS )
+#error "SHIFT_REGISTER_USE_SPI and SHIFT_REGISTER_PARALLEL_CHAINS are mutually exclusive"
+#endif
+
 class ShiftRegister
 {
     private:
+#if defined ( SHIFT_REGISTER_USE_SPI )
+        SPI spi;                // MOSI -> 75HC595 Pin 14, SCK -> 75HC595 Pin 11
+#elif defined ( SHIFT_REGISTER_PARALLEL_CHAINS )
+        PortOut dataPort;       // 75HC595 Pin 14 of every chain
+        DigitalOut clockPin;    // 75HC595 Pin 11, shared
+        uint32_t dataPortBits [ SHIFT_REGISTER_PARALLEL_CHAINS ];
+
+        static uint32_t dataPortMask ( const uint8_t * bitNumbers );
+#else
         DigitalOut dataPin;     // 75HC595 Pin 14
-        DigitalOut latchPin;    // 75HC595 Pin 12
         DigitalOut clockPin;    // 75HC595 Pin 11
+#endif
+        DigitalOut latchPin;    // 75HC595 Pin 12
         DigitalOut enablePin;   // 75HC595 Pin 13
         DigitalOut resetPin;    // 75HC595 Pin 10
 
+        // Bit n of the chain lives in byte ( n / 8 ), bit ( n % 8 )
+        const unsigned int imageSize;
+        uint8_t * outputImage;  // what testValueAt asks for
+        uint8_t * latchedImage; // what the storage registers currently hold
+        bool ownsImageStorage;
+
+        volatile unsigned int shiftCount;
+        volatile unsigned int skippedShiftCount;
+
         enum PinState
         {
             LOW = 0,
@@ -71,12 +120,37 @@ class ShiftRegister
 
         ShiftRegister ( const ShiftRegister &other ); // Don't allow pass-by-value
 
+        void shiftOut ();
+        void initImages ( uint8_t * imageStorage );
+
       protected:
           const unsigned int numberOfPins;
           virtual bool testValueAt ( const int &index ) const = 0;
 
+          /**
+           * Sets bit n of the zeroed image ( byte n / 8, bit n % 8 ) for
+           * every HIGH pin and returns how many there are.  The default
+           * asks testValueAt pin by pin, subclasses whose pin count is a
+           * compile time constant override it with a fixed bound loop.
+           */
+          virtual unsigned int renderImage ( uint8_t * image ) const;
+
     public:
-        ShiftRegister ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int totalPinCount = 0 );
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+        /**
+         * @param _dataPort GPIO port carrying the DS line of every chain
+         * @param _dataPortBits SHIFT_REGISTER_PARALLEL_CHAINS bit numbers
+         * within _dataPort, one per chain, in chain order
+         * @param imageStorage see below
+         */
+        ShiftRegister ( PortName _dataPort, const uint8_t * _dataPortBits, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int totalPinCount = 0, uint8_t * imageStorage = NULL );
+#else
+        /**
+         * @param imageStorage SHIFT_REGISTER_IMAGE_STORAGE_SIZE ( totalPinCount )
+         * bytes owned by the caller, or NULL to allocate them on the heap
+         */
+        ShiftRegister ( PinName _dataPin, PinName _latchPin, PinName _clockPin, PinName _enablePin, PinName _resetPin, const unsigned int totalPinCount = 0, uint8_t * imageStorage = NULL );
+#endif
         virtual ~ShiftRegister () = 0;
 
         /**
@@ -84,6 +158,10 @@ class ShiftRegister
          * Internally it calls the pure virtual function testValueAt to
          * figure out if the bit at that particular index needs to be
          * HIGH (1) or LOW (0).  Function works in MSB first fashion.
+         * The chain is only shifted and latched if the resulting pattern
+         * differs from the one currently latched.
+         * With SHIFT_REGISTER_USE_SPI the bits are packed into whole bytes
+         * (leading pad bits are LOW) and clocked out by the SPI peripheral.
          * @return numberOfHighBits -- Returns the Number of HIGH (1) bits
          * output on the Shift Register Data
          * */
@@ -93,6 +171,8 @@ class ShiftRegister
         bool enableOutput ();
 
         inline int getNumberOfPins () const;
+        inline unsigned int getShiftCount () const;
+        inline unsigned int getSkippedShiftCount () const;
 };
 
 inline int ShiftRegister::getNumberOfPins () const
@@ -100,4 +180,20 @@ inline int ShiftRegister::getNumberOfPins () const
     return numberOfPins;
 }
 
+/**
+ * Number of setData calls that actually shifted and latched the chain
+ */
+inline unsigned int ShiftRegister::getShiftCount () const
+{
+    return shiftCount;
+}
+
+/**
+ * Number of setData calls skipped because the pattern did not change
+ */
+inline unsigned int ShiftRegister::getSkippedShiftCount () const
+{
+    return skippedShiftCount;
+}
+
 #endif /* LIB_SHIFTREGISTER_SHIFTREGISTER_H_ */
@@ -0,0 +1,68 @@
+#include "Trace.h"
+#include "Format.h"
+
+TraceRecord Trace::ring [ TRACE_CAPACITY ];
+volatile uint32_t Trace::recorded = 0;
+
+Trace::Trace ()
+{
+}
+
+void Trace::clear ()
+{
+    recorded = 0;
+}
+
+unsigned int Trace::size ()
+{
+    uint32_t total = recorded;
+    return ( total < TRACE_CAPACITY ) ? total : TRACE_CAPACITY;
+}
+
+bool Trace::get ( const unsigned int index, TraceRecord & record )
+{
+    __disable_irq ();
+    uint32_t total = recorded;
+    uint32_t held = ( total < TRACE_CAPACITY ) ? total : TRACE_CAPACITY;
+    if ( index >= held )
+    {
+        __enable_irq ();
+        return false;
+    }
+    record = ring [ ( total - held + index ) & ( TRACE_CAPACITY - 1 ) ];
+    __enable_irq ();
+    return true;
+}
+
+int Trace::print ( const TraceRecord & record, const uint32_t origin, char * buffer, const int bufferSize )
+{
+    uint32_t elapsed = record.timestamp - origin;
+    return Format::print ( buffer, bufferSize, "%7lu.%03lu ms %-10s %5u 0x%08lx", (unsigned long) ( elapsed / 1000 ), (unsigned long) ( elapsed % 1000 ), eventName ( record.event ), (unsigned int) record.arg0, (unsigned long) record.arg1 );
+}
+
+const char * Trace::eventName ( const uint16_t event )
+{
+    switch ( event )
+    {
+        case TraceOrderEnqueued:
+            return "enqueued";
+        case TraceOrderDispatched:
+            return "dispatched";
+        case TracePumpOutputs:
+            return "pumps";
+        case TraceDispenserMoveStart:
+            return "moveStart";
+        case TraceDispenserMoveEnd:
+            return "moveEnd";
+        case TraceSensorEdge:
+            return "edge";
+        case TraceSensorChange:
+            return "sensor";
+        case TraceFrameRx:
+            return "rx";
+        case TraceFrameTx:
+            return "tx";
+        default:
+            return "?";
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef BARVIS_TRACE_H_
+#define BARVIS_TRACE_H_
+
+#include "mbed.h"
+
+/**
+ * In RAM event trace.  Build with BARVIS_TRACE ( see build_flags in
+ * platformio.ini ) and
+ *
+ *      TRACE ( TracePumpOutputs, highBits, image );
+ *
+ * appends one binary record to a ring of TRACE_CAPACITY records, the
+ * oldest ones get overwritten.  Recording is a timer read and a 12 byte
+ * store with interrupts briefly off, so it is safe and cheap from any
+ * context.  Nothing is formatted until the ring is dumped.  Without
+ * BARVIS_TRACE the macro compiles to nothing.
+ */
+#define TRACE_CAPACITY      256 // records, power of two
+
+enum TraceEvent
+{
+    TraceOrderEnqueued = 1,     // arg0: queue size, arg1: -
+    TraceOrderDispatched,       // arg0: cup index, arg1: queue size
+    TracePumpOutputs,           // arg0: outputs HIGH, arg1: first 32 outputs as a bit mask
+    TraceDispenserMoveStart,    // arg0: direction ( 0 home, 1 end ), arg1: steps
+    TraceDispenserMoveEnd,      // arg0: steps taken, arg1: position
+    TraceSensorEdge,            // arg0: pin id, arg1: -
+    TraceSensorChange,          // arg0: pin id, arg1: debounced value
+    TraceFrameRx,               // arg0: source ( 0 BLE, 1 USB ), arg1: length
+    TraceFrameTx,               // arg0: -, arg1: length
+    TRACE_EVENT_COUNT
+};
+
+struct TraceRecord
+{
+        uint32_t timestamp; // us_ticker_read ()
+        uint16_t event;
+        uint16_t arg0;
+        uint32_t arg1;
+};
+
+class Trace
+{
+    private:
+        static TraceRecord ring [ TRACE_CAPACITY ];
+        static volatile uint32_t recorded; // total ever, the next slot is recorded % TRACE_CAPACITY
+
+        Trace ();
+
+    public:
+        static inline void record ( const TraceEvent event, const uint16_t arg0, const uint32_t arg1 );
+        static void clear ();
+
+        /**
+         * Number of records held, at most TRACE_CAPACITY
+         */
+        static unsigned int size ();
+
+        /**
+         * Copies record i ( 0 the oldest held ), false once past the end
+         */
+        static bool get ( const unsigned int index, TraceRecord & record );
+
+        /**
+         * Renders one record as a timeline line, time relative to origin
+         */
+        static int print ( const TraceRecord & record, const uint32_t origin, char * buffer, const int bufferSize );
+
+        static const char * eventName ( const uint16_t event );
+};
+
+inline void Trace::record ( const TraceEvent event, const uint16_t arg0, const uint32_t arg1 )
+{
+    uint32_t now = us_ticker_read ();
+    __disable_irq ();
+    TraceRecord &slot = ring [ recorded & ( TRACE_CAPACITY - 1 ) ];
+    slot.timestamp = now;
+    slot.event = event;
+    slot.arg0 = arg0;
+    slot.arg1 = arg1;
+    recorded++;
+    __enable_irq ();
+}
+
+#ifdef BARVIS_TRACE
+#define TRACE(event,arg0,arg1)  Trace::record ( event, ( arg0 ), ( arg1 ) )
+#else
+#define TRACE(event,arg0,arg1)
+#endif
+
+#endif
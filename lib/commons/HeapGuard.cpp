@@ -0,0 +1,40 @@
+#include "mbed.h"
+
+/*
+ Allocation guard for heap free builds ( -DBARVIS_NO_HEAP ).  Every object the
+ firmware needs is statically sized ( see Machine.h, StaticHM11 and main.cpp ),
+ so any call to new / delete means something slipped back onto the heap.
+ Halt right there instead of slowly fragmenting on a long running unit.
+ */
+
+#ifdef BARVIS_NO_HEAP
+
+void * operator new ( size_t size )
+{
+    error ( "[BARVIS_NO_HEAP] new of %u bytes\r\n", (unsigned int) size );
+    return NULL;
+}
+
+void * operator new [] ( size_t size )
+{
+    error ( "[BARVIS_NO_HEAP] new[] of %u bytes\r\n", (unsigned int) size );
+    return NULL;
+}
+
+void operator delete ( void * ptr )
+{
+    if ( ptr != NULL )
+    {
+        error ( "[BARVIS_NO_HEAP] delete of %p\r\n", ptr );
+    }
+}
+
+void operator delete [] ( void * ptr )
+{
+    if ( ptr != NULL )
+    {
+        error ( "[BARVIS_NO_HEAP] delete[] of %p\r\n", ptr );
+    }
+}
+
+#endif
@@ -1,12 +1,16 @@
 #ifndef COMMONS_SERVICESTATUS_H_
 #define COMMONS_SERVICESTATUS_H_
 
+#include "Format.h"
+
 class ServiceStatus
 {
     private:
-        static const int MAX_STATUS_MESSAGE_LENGTH;
+        static const int MAX_STATUS_MESSAGE_LENGTH = 256; // fits the STATS summary
+        static const int MAX_JSON_STRING_LENGTH = MAX_STATUS_MESSAGE_LENGTH + 48; // what toJsonString writes at most
         int statusCode;
-        char * message;
+        char message [ MAX_STATUS_MESSAGE_LENGTH ];
+        int orderId; // -1: the status isn't about an order
 
         ServiceStatus ( const ServiceStatus &other );
 
@@ -15,8 +19,15 @@ class ServiceStatus
         virtual ~ServiceStatus ();
 
         ServiceStatus * status ( const int code, const char * format ... );
+
+        /**
+         * Adds "order":id to the JSON of the current status, status ()
+         * clears it again
+         */
+        inline ServiceStatus * withOrderId ( const int id );
         inline const char * getMessage () const;
         inline int getCode () const;
+        inline int getOrderId () const;
         inline char * toJsonString ( char * buffer ) const;
 };
 
@@ -25,14 +36,32 @@ inline const char * ServiceStatus::getMessage () const
     return message;
 }
 
+inline ServiceStatus * ServiceStatus::withOrderId ( const int id )
+{
+    orderId = id;
+    return this;
+}
+
 inline int ServiceStatus::getCode () const
 {
     return statusCode;
 }
 
+inline int ServiceStatus::getOrderId () const
+{
+    return orderId;
+}
+
 inline char * ServiceStatus::toJsonString ( char * buffer ) const
 {
-    sprintf ( buffer, "{\"status\":%d,\"message\":\"%s\"}", statusCode, message );
+    if ( orderId >= 0 )
+    {
+        Format::print ( buffer, MAX_JSON_STRING_LENGTH, "{\"status\":%d,\"order\":%d,\"message\":\"%s\"}", statusCode, orderId, message );
+    }
+    else
+    {
+        Format::print ( buffer, MAX_JSON_STRING_LENGTH, "{\"status\":%d,\"message\":\"%s\"}", statusCode, message );
+    }
     return buffer;
 }
 
@@ -1,7 +1,9 @@
 // comment the following define statement to shut the built-in LED off
 #define USE_DEBUG_LED // set debug LED
-// comment the following define statement to shut the serial debug off
-#define SERIAL_DEBUG // set debug mode
+// LOG_LEVEL_DEBUG adds every command, LOG_LEVEL_NONE shuts the serial log off
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
 
 #include "mbed.h"
 #include "PumpControl.h"
@@ -11,6 +13,17 @@
 #include "ServiceStatus.h"
 #include "OrderQueue.h"
 #include "OrderManager.h"
+#include "Machine.h"
+#include "Eeprom.h"
+#include "IrSensorManager.h"
+#include "DeferredQueue.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "Log.h"
+#include "KvStore.h"
+#include "RecipeBook.h"
+#include "OrderNotifier.h"
+#include "Format.h"
 #include "USBSerial.h"
 #include "string.h"
 
@@ -33,14 +46,36 @@ void atDebugLedTimer ()
 #define setupDebugLed()
 #endif
 
-#ifdef SERIAL_DEBUG
 USBSerial * SERIAL_DEBUG_OUT = NULL;
-//#define error(code,fmt,...) if(SERIAL_DEBUG_OUT!=NULL){SERIAL_DEBUG_OUT->printf("[ERROR] ");SERIAL_DEBUG_OUT->printf(##__VA_ARGS__);SERIAL_DEBUG_OUT->printf("\n\r");}
-#define debug(fmt,...) if(SERIAL_DEBUG_OUT!=NULL){SERIAL_DEBUG_OUT->printf("[DEBUG] ");SERIAL_DEBUG_OUT->printf(fmt,##__VA_ARGS__);SERIAL_DEBUG_OUT->printf("\n\r");}
-#else
-#define debug(fmt,...)
-//#define error(code,fmt,...)
-#endif
+
+/**
+ * Writes a line to the USB serial right away, for the on demand dumps
+ */
+void writeLine ( const char * line )
+{
+    if ( SERIAL_DEBUG_OUT != NULL )
+    {
+        SERIAL_DEBUG_OUT->printf ( "%s\n\r", line );
+    }
+}
+
+/**
+ * Formats and writes the queued log records, called in idle time
+ */
+void flushLog ()
+{
+    char line [ LOG_LINE_SIZE ];
+    static unsigned int reportedDrops = 0;
+    while ( Log::pop ( line, sizeof ( line ) ) )
+    {
+        writeLine ( line );
+    }
+    if ( Log::getDroppedCount () != reportedDrops )
+    {
+        reportedDrops = Log::getDroppedCount ();
+        LOG_WARN( "%u log records dropped so far", reportedDrops );
+    }
+}
 
 using namespace std;
 
@@ -59,20 +94,43 @@ typedef enum
     ERROR_PUMP_INVALID_DURATION = ( ERROR_PUMP | 0x04 ),
     ERROR_ORDER = 0x9000, // 1001000000000000
     ERROR_ORDER_QUEUE_FULL = ( ERROR_ORDER | 0x01 ),
+    ERROR_ORDER_INVALID_STAGE = ( ERROR_ORDER | 0x02 ),
+    ERROR_ORDER_INVALID_RECIPE = ( ERROR_ORDER | 0x03 ),
+    ERROR_ORDER_INVALID_COUNT = ( ERROR_ORDER | 0x04 ),
+    ERROR_ORDER_UNKNOWN = ( ERROR_ORDER | 0x05 ),
+    ERROR_ORDER_RECIPE_NOT_PERSISTED = ( ERROR_ORDER | 0x06 ),
 } StatusCode;
 
-ServiceStatus * executeCommand ( char * jsonCommand, int commandLength, OrderManager * orderManager, PumpControl * pumpControl, HM11 * &ble, OrderQueue * orderQueue );
+// Where a command came in, its orders' notifications go back there ( see OrderInfo::replyTo )
+enum Transport
+{
+    TransportBle = 0,
+    TransportUsb = 1
+};
+
+ServiceStatus * executeCommand ( char * jsonCommand, int commandLength, OrderManager * orderManager, PumpControl * pumpControl, HM11 * &ble, OrderQueue * orderQueue, RecipeBook * recipeBook, const Transport replyTo );
 
 #define BARVIS_COMMAND_SIZE    1024
 #define TOTAL_CUPS             1
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+#define TOTAL_PUMPS            ( SHIFT_REGISTER_PARALLEL_CHAINS * 24 )
+#else
 #define TOTAL_PUMPS            24
+#endif
+#define ORDER_QUEUE_DEPTH      TOTAL_CUPS
+
+typedef Machine < TOTAL_PUMPS, TOTAL_CUPS, ORDER_QUEUE_DEPTH > BarMachine;
 
-int sendBleATCommand ( HM11 * &ble, const char * command, char * &responseBuffer, const int bufferSize )
+#define BLE_AT_COMMAND_SIZE    32
+#define BLE_AT_RESPONSE_SIZE   64
+
+int sendBleATCommand ( HM11 * &ble, const char * command, char * responseBuffer, const int bufferSize )
 {
     ble->sendDataToDevice ( command );
     ble->waitForData ( 1000 );
-    int dataLength = ble->copyAvailableDataToBuf ( responseBuffer, bufferSize );
-    debug( "Got a response for [%s] as: %s", command, responseBuffer );
+    int dataLength = ble->copyAvailableDataToBuf ( responseBuffer, bufferSize - 1 ); // leave room for the terminator
+    LOG_INFO( "AT command %s", command );
+    LOG_INFO( "AT response %s", responseBuffer );
     return dataLength;
 }
 
@@ -81,20 +139,200 @@ int sendBleATCommand ( HM11 * &ble, const char * command, char * &responseBuffer
 #define BLE_TX  D1
 #define BLE_RX  D0
 
+#if defined ( SHIFT_REGISTER_PARALLEL_CHAINS )
+// One 24 pump chain per DS line, all DS lines on PTD so they change with a single port write
+#define PUMP_CONTROL_DATA_PORT      PortD
+const uint8_t PUMP_CONTROL_DATA_PORT_BITS [ SHIFT_REGISTER_PARALLEL_CHAINS ] = { 0, 2, 5, 6 }; // D2, D7, D20, D21 -> 75HC595 Pin 14 of chain 0..3
+#define PUMP_CONTROL_CLOCK          D4  // 75HC595 Pin 11 - Yellow
+#define PUMP_CONTROL_CUP_DETECTOR   D14 // IR Sensor Pin0
+#elif defined ( SHIFT_REGISTER_USE_SPI )
+// SPI0 alternate pins, D11/D13 are taken by the dispenser DIR and the LED
+#define PUMP_CONTROL_DATA           D7  // SPI0 MOSI -> 75HC595 Pin 14 - Blue
+#define PUMP_CONTROL_CLOCK          D14 // SPI0 SCK  -> 75HC595 Pin 11 - Yellow
+#define PUMP_CONTROL_CUP_DETECTOR   D15 // IR Sensor Pin0
+#else
 #define PUMP_CONTROL_DATA           D2  // 75HC595 Pin 14 - Blue
-#define PUMP_CONTROL_LATCH          D3  // 75HC595 Pin 12 - Green
 #define PUMP_CONTROL_CLOCK          D4  // 75HC595 Pin 11 - Yellow
+#define PUMP_CONTROL_CUP_DETECTOR   D14 // IR Sensor Pin0
+#endif
+#define PUMP_CONTROL_LATCH          D3  // 75HC595 Pin 12 - Green
 #define PUMP_CONTROL_ENABLE         D5  // 75HC595 Pin 13 - White
 #define PUMP_CONTROL_RESET          D6  // 75HC595 Pin 10 - Grey/Gold
-#define PUMP_CONTROL_CUP_DETECTOR   D14 // IR Sensor Pin0
 
 #define DISPENSER_CONTROL_HOME  D8
 #define DISPENSER_CONTROL_END   D9
 #define DISPENSER_MOTOR_STEP    D12
 #define DISPENSER_MOTOR_DIR     D11
 
+// EEPROM layout, the dispenser calibration sits at DISPENSER_CALIBRATION_EEPROM_ADDRESS
+#define KV_STORE_EEPROM_ADDRESS 64
+#define KV_STORE_EEPROM_SIZE    ( EEPROM_SIZE - KV_STORE_EEPROM_ADDRESS )
+#if ( DISPENSER_CALIBRATION_EEPROM_ADDRESS + DISPENSER_CALIBRATION_EEPROM_SIZE > KV_STORE_EEPROM_ADDRESS ) && ( KV_STORE_EEPROM_ADDRESS + KV_STORE_EEPROM_SIZE > DISPENSER_CALIBRATION_EEPROM_ADDRESS )
+#error "The dispenser calibration and the KvStore region overlap"
+#endif
+#define KV_KEY_RECIPES          0  // RECIPE_BOOK_SIZE keys
+
 void pumpDurationsDebugString ( char * buffer, unsigned int * durations );
 
+/**
+ * Everything main () owns is static, so these sizes are the worst case RAM
+ * use per subsystem (stacks and mbed/USB internals excluded).  Build with
+ * BARVIS_NO_HEAP to trap any remaining heap allocation (see HeapGuard.cpp).
+ */
+void reportMemoryFootprint ()
+{
+    const struct
+    {
+            const char * subsystem;
+            unsigned int bytes;
+    } footprint [] =
+    {
+        { "PumpControl", sizeof(BarMachine::Pumps) },
+        { "OrderQueue", sizeof(BarMachine::Queue) },
+        { "OrderManager", sizeof(BarMachine::Manager) },
+        { "DispenserControl", sizeof(DispenserControl) },
+        { "Eeprom", sizeof(Eeprom) },
+        { "HM11", sizeof(StaticHM11) },
+        { "IrSensorManager", sizeof(IrSensorManager) },
+        { "DeferredQueue", sizeof(DeferredQueue) },
+        { "KvStore", sizeof(KvStore) },
+        { "RecipeBook", sizeof(RecipeBook) },
+        { "OrderNotifier", sizeof(OrderNotifier) },
+        { "CommandBuffer", BARVIS_COMMAND_SIZE },
+        { "JsonTokens", sizeof(jsmntok_t) * JSON_MAX_TOKENS },
+        { "ServiceStatus", sizeof(ServiceStatus) },
+    };
+
+    unsigned int total = 0;
+    for ( unsigned int i = 0; i < ( sizeof ( footprint ) / sizeof ( footprint [ 0 ] ) ); i++ )
+    {
+        LOG_INFO( "[RAM] %-16s %6u bytes", footprint [ i ].subsystem, footprint [ i ].bytes );
+        total += footprint [ i ].bytes;
+    }
+    LOG_INFO( "[RAM] %-16s %6u bytes", "Total", total );
+}
+
+/**
+ * Logs the worst case interrupt handler durations whenever one of them grows
+ */
+void reportIsrDurations ( PumpControl * pumpControl, OrderManager * orderManager, DispenserControl * dispenserControl )
+{
+    static uint32_t reported [ 3 ] = { 0, 0, 0 };
+    const struct
+    {
+            const char * isr;
+            const IsrDuration & duration;
+    } isrs [] =
+    {
+        { "PumpTimer", pumpControl->getPumpTimerIsrDuration () },
+        { "OrderTimer", orderManager->getProcessingTimerIsrDuration () },
+        { "StepTimer", dispenserControl->getStepTimerIsrDuration () },
+    };
+
+    for ( unsigned int i = 0; i < ( sizeof ( isrs ) / sizeof ( isrs [ 0 ] ) ); i++ )
+    {
+        uint32_t worstCase = isrs [ i ].duration.getWorstCase ();
+        if ( worstCase > reported [ i ] )
+        {
+            reported [ i ] = worstCase;
+            LOG_INFO( "[ISR] %-10s worst %6lu us over %lu runs", isrs [ i ].isr, (unsigned long) worstCase, (unsigned long) isrs [ i ].duration.getCount () );
+        }
+    }
+}
+
+/**
+ * Sends order notifications back over BLE or the USB serial
+ */
+class TransportNotificationSink : public OrderNotificationSink
+{
+    private:
+        HM11 * ble;
+        USBSerial * usbSerial;
+
+    public:
+        TransportNotificationSink ( HM11 * _ble, USBSerial * _usbSerial )
+                : ble ( _ble ), usbSerial ( _usbSerial )
+        {
+        }
+
+        virtual void sendNotification ( const uint8_t replyTo, const char * message )
+        {
+            if ( replyTo == TransportUsb )
+            {
+                usbSerial->printf ( "%s\n\r", message );
+            }
+            else
+            {
+                ble->sendDataToDevice ( message );
+            }
+            TRACE( TraceFrameTx, replyTo, strlen ( message ) );
+        }
+};
+
+/**
+ * Stands in for wait () in the main loop, the deferred interrupt work, the
+ * cup sensors, order notifications, the settings store and the log keep
+ * being served meanwhile
+ */
+void runFor ( const unsigned int microSeconds, DeferredQueue * deferredQueue, IrSensorManager * cupSensors, KvStore * settings, OrderNotifier * notifier )
+{
+    uint32_t start = us_ticker_read ();
+    do
+    {
+        deferredQueue->dispatchFor ( 1000 );
+        cupSensors->process ();
+        notifier->flush ();
+        settings->maintain ();
+        flushLog ();
+    } while ( ( us_ticker_read () - start ) < microSeconds );
+}
+
+/**
+ * Writes every PROFILE_SCOPE site to the USB serial
+ */
+int dumpProfile ()
+{
+    flushLog (); // keep the log in order with the dump
+    char line [ 80 ];
+    Format::print ( line, sizeof ( line ), "[PROFILE] %-12s %8s %8s %8s %8s ( %s )", "site", "count", "min", "avg", "max", PROFILE_TICK_UNIT );
+    writeLine ( line );
+    int siteCount = 0;
+    for ( ProfileSite * site = Profiler::firstSite (); site != NULL; site = site->next )
+    {
+        strcpy ( line, "[PROFILE] " );
+        Profiler::print ( site, line + 10, sizeof ( line ) - 10 );
+        writeLine ( line );
+        siteCount++;
+    }
+    return siteCount;
+}
+
+/**
+ * Writes the trace ring to the USB serial as a timeline, oldest record first
+ */
+int dumpTrace ()
+{
+    TraceRecord record;
+    if ( !Trace::get ( 0, record ) )
+    {
+        return 0;
+    }
+
+    flushLog (); // keep the log in order with the dump
+    const uint32_t origin = record.timestamp;
+    char line [ 80 ];
+    writeLine ( "[TRACE]       time    event       arg0       arg1" );
+    int recordCount = 0;
+    while ( Trace::get ( recordCount, record ) )
+    {
+        strcpy ( line, "[TRACE] " );
+        Trace::print ( record, origin, line + 8, sizeof ( line ) - 8 );
+        writeLine ( line );
+        recordCount++;
+    }
+    return recordCount;
+}
+
 void increment ( unsigned int * &array, const int index )
 {
     if ( index >= 0 && index < TOTAL_PUMPS )
@@ -119,15 +357,40 @@ int main ()
     USBSerial usbSerial ( USBTX, USBRX );
     SERIAL_DEBUG_OUT = &usbSerial;
 
-//    PinName             irSensorPins [ TOTAL_CUPS ] = { D14, D15, D16, D17 };
+    static const PinName irSensorPins [ TOTAL_CUPS ] = { PUMP_CONTROL_CUP_DETECTOR }; // one per cup, e.g. { D14, D15, D16, D17 }
+//    static const unsigned int cupPositions [ TOTAL_CUPS ] = { 400, 1200, 2000, 2800 }; // dispenser steps from home
+
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+    static BarMachine::Pumps pumps ( PUMP_CONTROL_DATA_PORT, PUMP_CONTROL_DATA_PORT_BITS, PUMP_CONTROL_LATCH, PUMP_CONTROL_CLOCK, PUMP_CONTROL_ENABLE, PUMP_CONTROL_RESET );
+#else
+    static BarMachine::Pumps pumps ( PUMP_CONTROL_DATA, PUMP_CONTROL_LATCH, PUMP_CONTROL_CLOCK, PUMP_CONTROL_ENABLE, PUMP_CONTROL_RESET );
+#endif
+    PumpControl * pumpControl = &pumps;
+    static Eeprom eeprom;
+    static DispenserControl dispenser ( DISPENSER_CONTROL_HOME, DISPENSER_CONTROL_END, DISPENSER_MOTOR_STEP, DISPENSER_MOTOR_DIR, &eeprom );
+    DispenserControl * dispenserControl = &dispenser;
+    static BarMachine::Queue queue;
+    OrderQueue * orderQueue = &queue;
+    static StaticHM11 bleDevice ( BLE_TX, BLE_RX );
+    HM11 * ble = &bleDevice;
+    static IrSensorManager cupSensors ( irSensorPins, TOTAL_CUPS );
+    static DeferredQueue deferredQueue;
+
+    static KvStore settings ( &eeprom, KV_STORE_EEPROM_ADDRESS, KV_STORE_EEPROM_SIZE );
+    if ( !settings.mount () )
+    {
+        LOG_ERROR( "Settings store unavailable" );
+    }
+    static RecipeBook recipes ( &settings, KV_KEY_RECIPES );
+    RecipeBook * recipeBook = &recipes;
+    LOG_INFO( "Loaded %u recipes", recipes.load () );
 
-    PumpControl * pumpControl = new PumpControl ( PUMP_CONTROL_DATA, PUMP_CONTROL_LATCH, PUMP_CONTROL_CLOCK, PUMP_CONTROL_ENABLE, PUMP_CONTROL_RESET, TOTAL_PUMPS );
-    DispenserControl * dispenserControl = new DispenserControl ( DISPENSER_CONTROL_HOME, DISPENSER_CONTROL_END, DISPENSER_MOTOR_STEP, DISPENSER_MOTOR_DIR );
-    OrderQueue * orderQueue = new OrderQueue ( TOTAL_CUPS, TOTAL_PUMPS );
-    HM11 * ble = new HM11 ( BLE_TX, BLE_RX );
-    IrSensorPin * cupDetectorPin = new IrSensorPin ( PUMP_CONTROL_CUP_DETECTOR, 0, pumpControl );
+    static char commandStorage [ BARVIS_COMMAND_SIZE ];
+    char * commandBuffer = commandStorage;
 
-    char * commandBuffer = new char [ BARVIS_COMMAND_SIZE ];
+    reportMemoryFootprint ();
+    flushLog ();
+    Profiler::start ();
 
     sendBleATCommand ( ble, "AT", commandBuffer, BARVIS_COMMAND_SIZE );
     sendBleATCommand ( ble, "AT+NOTI0", commandBuffer, BARVIS_COMMAND_SIZE );
@@ -136,8 +399,19 @@ int main ()
     sendBleATCommand ( ble, "AT+SHOW1", commandBuffer, BARVIS_COMMAND_SIZE );
     sendBleATCommand ( ble, "AT+IMME1", commandBuffer, BARVIS_COMMAND_SIZE );
     sendBleATCommand ( ble, "AT+NAMEBummButtler", commandBuffer, BARVIS_COMMAND_SIZE );
-
-    OrderManager * orderManager = new OrderManager ( TOTAL_CUPS, TOTAL_PUMPS, orderQueue, pumpControl, dispenserControl );
+    flushLog ();
+
+    static BarMachine::Manager manager ( orderQueue, pumpControl, dispenserControl );
+    OrderManager * orderManager = &manager;
+//    orderManager->setCupPositions ( cupPositions );
+//    orderManager->setCupSelectionPolicy ( Scan );
+//    orderManager->setOverlapMode ( true );
+    cupSensors.addListener ( orderManager );
+    static TransportNotificationSink notificationSink ( ble, &usbSerial );
+    static OrderNotifier notifier;
+    notifier.setSink ( &notificationSink );
+    orderManager->setProgressListener ( &notifier );
+    orderManager->setDeferredQueue ( &deferredQueue ); // comment out to measure with the order work in interrupt context
 
     ServiceStatus * status = NULL;
 
@@ -153,30 +427,34 @@ int main ()
 //    testDurations [ 3 ] = 1;
 //    testDurations [ 2 ] = 1;
 
-    char debugBuffer [ 256 ];
-
-    int count = 0;
     while ( true )
     {
 
         if ( ble->isRxDataAvailable () )
         {
             int length = ble->copyAvailableDataToBufWithTimeout ( commandBuffer, BARVIS_COMMAND_SIZE, 10 );
-            status = executeCommand ( commandBuffer, length, orderManager, pumpControl, ble, orderQueue );
+            TRACE( TraceFrameRx, 0, length );
+            status = executeCommand ( commandBuffer, length, orderManager, pumpControl, ble, orderQueue, recipeBook, TransportBle );
             status -> toJsonString ( commandBuffer );
-            debug( commandBuffer );
+            LOG_DEBUG( "%s", commandBuffer );
             ble->sendDataToDevice ( commandBuffer );
+            TRACE( TraceFrameTx, 0, strlen ( commandBuffer ) );
         }
         else if ( usbSerial.available () )
         {
             usbSerial.gets ( commandBuffer, BARVIS_COMMAND_SIZE );
-            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue );
+            TRACE( TraceFrameRx, 1, strlen ( commandBuffer ) );
+            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue, recipeBook, TransportUsb );
             status -> toJsonString ( commandBuffer );
-            debug( commandBuffer );
+            LOG_DEBUG( "%s", commandBuffer );
             ble->sendDataToDevice ( commandBuffer );
+            TRACE( TraceFrameTx, 0, strlen ( commandBuffer ) );
         }
 
-        wait_us ( 100000 );
+        dispenserControl->saveCalibration ();
+        reportIsrDurations ( pumpControl, orderManager, dispenserControl );
+
+        runFor ( 100000, &deferredQueue, &cupSensors, &settings, &notifier );
 
         /*
          {"type":"PUMP","run_pumps":[{"id":1,"for":40},{"id":2,"for":60}]}
@@ -190,34 +468,34 @@ int main ()
          */
 
         {
-            wait ( 2 );
+            runFor ( 2000000, &deferredQueue, &cupSensors, &settings, &notifier );
             strcpy ( commandBuffer, "{\"type\":\"PUMP\",\"run_pumps\":[{\"id\":1,\"for\":40},{\"id\":2,\"for\":60}]}" );
-            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue );
+            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue, recipeBook, TransportUsb );
             status -> toJsonString ( commandBuffer );
-            debug( commandBuffer );
+            LOG_DEBUG( "%s", commandBuffer );
         }
         {
-            wait ( 2 );
+            runFor ( 2000000, &deferredQueue, &cupSensors, &settings, &notifier );
             strcpy ( commandBuffer, "{\"type\":\"PAUSE\"}" );
-            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue );
+            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue, recipeBook, TransportUsb );
             status -> toJsonString ( commandBuffer );
-            debug( commandBuffer );
+            LOG_DEBUG( "%s", commandBuffer );
         }
         {
-            wait ( 2 );
+            runFor ( 2000000, &deferredQueue, &cupSensors, &settings, &notifier );
             strcpy ( commandBuffer, "{\"type\":\"RESUME\"}" );
-            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue );
+            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue, recipeBook, TransportUsb );
             status -> toJsonString ( commandBuffer );
-            debug( commandBuffer );
+            LOG_DEBUG( "%s", commandBuffer );
         }
         {
-            wait ( 2 );
+            runFor ( 2000000, &deferredQueue, &cupSensors, &settings, &notifier );
             strcpy ( commandBuffer, "{\"type\":\"CLEAR\"}" );
-            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue );
+            status = executeCommand ( commandBuffer, strlen ( commandBuffer ), orderManager, pumpControl, ble, orderQueue, recipeBook, TransportUsb );
             status -> toJsonString ( commandBuffer );
-            debug( commandBuffer );
+            LOG_DEBUG( "%s", commandBuffer );
         }
-        wait ( 5 );
+        runFor ( 5000000, &deferredQueue, &cupSensors, &settings, &notifier );
     }
 }
 
@@ -228,8 +506,9 @@ void pumpDurationsDebugString ( char * buffer, unsigned int * durations )
     buffer [ length++ ] = '[';
     for ( int i = ( TOTAL_PUMPS - 1 ); i >= 0; i-- )
     {
-        sprintf ( buffer + length, "(%3d)", durations [ i ] );
-        length += 5;
+        buffer [ length++ ] = '(';
+        length += Format::unsignedValue ( buffer + length, 11, durations [ i ], 3 );
+        buffer [ length++ ] = ')';
     }
     buffer [ length++ ] = ']';
     buffer [ length++ ] = '}';
@@ -239,11 +518,37 @@ void pumpDurationsDebugString ( char * buffer, unsigned int * durations )
 /*
  JSON Structure for Barvis Commands
  {
- "type" : { "AT" | "PUMP" | "SET" | "CLEAR" | "PING" },
+ "type" : { "AT" | "PUMP" | "SET" | "ORDER" | "CANCEL" | "AMEND" | "CLEAR" | "PING" | "STATS" | "PROFILE" | "TRACE" },
  "at_cmd" : "<ATCMD>",
  "run_pumps" : [ { "id" : <pumpID>, "for" : <runForUnits> }, ...  ]
- "set" : [ { "key" : "value" }, { "key2" : "value2" } ... ]
+ "recipe" : <recipeID>, "count" : <orders>
+ "order" : <orderID>
+ "stage" : "<stage>", "reset" : true
  }
+
+ SET stores "run_pumps" as recipe "recipe" ( see RecipeBook ), validated once
+ right there; an empty "run_pumps" removes the recipe.  ORDER queues "count"
+ ( default 1 ) orders of a stored recipe:
+ {"type":"SET","recipe":3,"run_pumps":[{"id":1,"for":40},{"id":2,"for":60}]}
+ {"type":"ORDER","recipe":3,"count":2}
+
+ PROFILE dumps the PROFILE_SCOPE sites over the USB serial, TRACE the trace
+ ring as a timeline ( see Trace.h ), "reset" clears either.
+
+ Accepted PUMP and ORDER commands answer with "order", the id of the
+ ( first ) order queued ( see OrderQueue ).  The progress of every order is
+ pushed to the transport it came in on as
+ {"order":<id>,"event":"DISPATCHED|POURING|PAUSED|DONE|FAILED|CANCELLED"},
+ see OrderNotifier.  CLEAR reports the order being poured as FAILED.
+
+ CANCEL drops "order" wherever it is, queued or in flight, AMEND replaces
+ the "run_pumps" of an order that is still queued:
+ {"type":"CANCEL","order":7}
+ {"type":"AMEND","order":7,"run_pumps":[{"id":1,"for":20}]}
+
+ STATS answers "stage:count,p50,p99,max;..." in micro seconds for every
+ order stage ( see OrderStats ), with "stage" the non empty histogram buckets
+ of that stage as "bucket:count,...", and with "reset" clears them all.
  */
 
 #define JSON_ROOT_INDEX         0
@@ -251,23 +556,149 @@ void pumpDurationsDebugString ( char * buffer, unsigned int * durations )
 #define JSON_ENUM_TYPE_PING     "PING"
 #define JSON_ENUM_TYPE_PUMP     "PUMP"
 #define JSON_ENUM_TYPE_SET      "SET"
+#define JSON_ENUM_TYPE_ORDER    "ORDER"
 #define JSON_ENUM_TYPE_CLEAR    "CLEAR"
 #define JSON_ENUM_TYPE_PAUSE    "PAUSE"
 #define JSON_ENUM_TYPE_RESUME   "RESUME"
 #define JSON_ENUM_TYPE_AT       "AT"
+#define JSON_ENUM_TYPE_STATS    "STATS"
+#define JSON_ENUM_TYPE_PROFILE  "PROFILE"
+#define JSON_ENUM_TYPE_TRACE    "TRACE"
+#define JSON_ENUM_TYPE_CANCEL   "CANCEL"
+#define JSON_ENUM_TYPE_AMEND    "AMEND"
 #define JSON_KEY_RUN_PUMPS      "run_pumps"
 #define JSON_KEY_RUN_PUMPS_ID   "id"
 #define JSON_KEY_RUN_PUMPS_FOR  "for"
 #define JSON_KEY_AT_CMD         "at_cmd"
-#define JSON_KEY_SET            "set"
+#define JSON_KEY_RECIPE         "recipe"
+#define JSON_KEY_COUNT          "count"
+#define JSON_KEY_ORDER          "order"
+#define JSON_KEY_STATS_STAGE    "stage"
+#define JSON_KEY_STATS_RESET    "reset"
 
-ServiceStatus * executeCommand ( char * jsonCommand, int commandLength, OrderManager * orderManager, PumpControl * pumpControl, HM11 * &ble, OrderQueue * orderQueue )
+
+/**
+ * Reads the "run_pumps" array of the root object into runPumpsFor, which
+ * must be all zero on entry.
+ * @return NULL on success, else the failed serviceStatus
+ */
+ServiceStatus * parseRunPumps ( Json & json, PumpControl * pumpControl, unsigned int * runPumpsFor, ServiceStatus * serviceStatus )
 {
-    static ServiceStatus * serviceStatus = new ServiceStatus ( SUCCESS, "Nothing executed and no error occurred" );
+    int runPumpsIndex = json.findKeyIndexIn ( JSON_KEY_RUN_PUMPS, JSON_ROOT_INDEX );
+    if ( runPumpsIndex == -1 )
+    {
+        return serviceStatus -> status ( ERROR_JSON_INVALID_OBJECT, "Invalid JSON ... '%s' should exist", JSON_KEY_RUN_PUMPS );
+    }
+
+    int runPumpsArrayIndex = json.findChildIndexOf ( runPumpsIndex, 0 ); // get the first child i.e. value of the "run_pumps" KEY
+    if ( runPumpsArrayIndex == -1 )
+    {
+        return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... '%s' should have an array element", JSON_KEY_RUN_PUMPS );
+    }
+    if ( json.type ( runPumpsArrayIndex ) != JSMN_ARRAY )
+    {
+        return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... '%s' arry should be none other than array type", JSON_KEY_RUN_PUMPS );
+    }
+
+    int numberOfInstructions = json.childCount ( runPumpsArrayIndex );
+    int childIndex = -1; // start iterating from the begining of the array
 
-    debug( "Executing %s", jsonCommand );
+    for ( int i = 0; i < numberOfInstructions; i++ )
+    {
+
+        childIndex = json.findChildIndexOf ( runPumpsArrayIndex, childIndex );
+        if ( json.type ( childIndex ) != JSMN_OBJECT )
+        {
+            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... '%s' array should have all 'object' elements", JSON_KEY_RUN_PUMPS );
+        }
 
-    Json json ( jsonCommand, commandLength );
+        int idIndex = json.findKeyIndexIn ( JSON_KEY_RUN_PUMPS_ID, childIndex );
+        if ( idIndex == -1 )
+        {
+            return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... object at %d is missing '%s' key", i, JSON_KEY_RUN_PUMPS_ID );
+        }
+
+        int durationIndex = json.findKeyIndexIn ( JSON_KEY_RUN_PUMPS_FOR, childIndex );
+        if ( durationIndex == -1 )
+        {
+            return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... object at %d is missing '%s' key", i, JSON_KEY_RUN_PUMPS_FOR );
+        }
+        // Now as we have both the keys of 'id' and 'for', get the values out
+
+        int idValueIndex = json.findChildIndexOf ( idIndex, 0 );
+        if ( idValueIndex == -1 )
+        {
+            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '&s' value is missing", i, JSON_KEY_RUN_PUMPS_ID );
+        }
+        if ( ( json.type ( idValueIndex ) != JSMN_PRIMITIVE ) )
+        {
+            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '%s' should have integer value", i, JSON_KEY_RUN_PUMPS_ID );
+        }
+
+        int durationValueIndex = json.findChildIndexOf ( durationIndex, 0 );
+        if ( durationValueIndex == -1 )
+        {
+            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '&s' value is missing", i, JSON_KEY_RUN_PUMPS_FOR );
+        }
+        if ( json.type ( durationValueIndex ) != JSMN_PRIMITIVE )
+        {
+            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '%s' should have integer value", i, JSON_KEY_RUN_PUMPS_FOR );
+        }
+
+        int pumpId = json.tokenIntegerValue ( idValueIndex );
+        if ( !pumpControl->isValidId ( pumpId ) )
+        {
+            return serviceStatus -> status ( ERROR_PUMP_INVALID_ID, "Invalid ID: %d provided for Instruction: %d", pumpId, i );
+        }
+
+        int duration = json.tokenIntegerValue ( durationValueIndex );
+        if ( !pumpControl->isValidDuration ( duration ) )
+        {
+            return serviceStatus -> status ( ERROR_PUMP_INVALID_DURATION, "Invalid Duration: %d provided for Instruction: %d", duration, i );
+        }
+
+        runPumpsFor [ pumpId ] = (unsigned int) duration;
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads the integer value of key in the root object
+ * @return false if the key is missing or its value isn't a primitive
+ */
+bool readRootInteger ( Json & json, const char * key, int & value )
+{
+    int keyIndex = json.findKeyIndexIn ( key, JSON_ROOT_INDEX );
+    if ( keyIndex == -1 )
+    {
+        return false;
+    }
+    int valueIndex = json.findChildIndexOf ( keyIndex, -1 );
+    if ( ( valueIndex == -1 ) || ( json.type ( valueIndex ) != JSMN_PRIMITIVE ) )
+    {
+        return false;
+    }
+    value = json.tokenIntegerValue ( valueIndex );
+    return true;
+}
+
+ServiceStatus * executeCommand ( char * jsonCommand, int commandLength, OrderManager * orderManager, PumpControl * pumpControl, HM11 * &ble, OrderQueue * orderQueue, RecipeBook * recipeBook, const Transport replyTo )
+{
+    static ServiceStatus serviceStatusStorage ( SUCCESS, "Nothing executed and no error occurred" );
+    static jsmntok_t jsonTokens [ JSON_MAX_TOKENS ];
+    ServiceStatus * serviceStatus = &serviceStatusStorage;
+    PROFILE_SCOPE ( "executeCmd" );
+    OrderStats & orderStats = orderManager->getOrderStats ();
+    OrderInfo orderInfo;
+    orderInfo.receivedAt = us_ticker_read ();
+    orderInfo.orderId = 0;
+    orderInfo.replyTo = replyTo;
+
+    LOG_DEBUG( "Executing %s", jsonCommand );
+
+    Json json ( jsonCommand, commandLength, jsonTokens, JSON_MAX_TOKENS );
+    const uint32_t parsedAt = us_ticker_read ();
 
     if ( !json.isValidJson () )
     {
@@ -299,121 +730,221 @@ ServiceStatus * executeCommand ( char * jsonCommand, int commandLength, OrderMan
     else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_PUMP ) )
     {
 
-        int runPumpsIndex = json.findKeyIndexIn ( JSON_KEY_RUN_PUMPS, JSON_ROOT_INDEX );
-        if ( runPumpsIndex == -1 )
+        unsigned int runPumpsFor [ TOTAL_PUMPS ] = { 0 };
+        if ( parseRunPumps ( json, pumpControl, runPumpsFor, serviceStatus ) != NULL )
         {
-            return serviceStatus -> status ( ERROR_JSON_INVALID_OBJECT, "Invalid JSON ... '%s' should exist", JSON_KEY_RUN_PUMPS );
+            return serviceStatus;
         }
 
-        int runPumpsArrayIndex = json.findChildIndexOf ( runPumpsIndex, 0 ); // get the first child i.e. value of the "run_pumps" KEY
-        if ( runPumpsArrayIndex == -1 )
+//        pumpControl -> runPumpsFor ( runPumpsFor );
+
+        // Queue the Pump Operation now, the order queue is lock free towards the OrderManager
+        int currSize = orderQueue->addOrder ( runPumpsFor, &orderInfo );
+        if ( currSize != -1 )
         {
-            return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... '%s' should have an array element", JSON_KEY_RUN_PUMPS );
+            TRACE( TraceOrderEnqueued, currSize, 0 );
+            LOG_DEBUG( "Order queued at %d of %d", currSize, orderQueue->getCapacity () );
+            orderStats.record ( StageParse, parsedAt - orderInfo.receivedAt );
+            orderStats.record ( StageEnqueue, us_ticker_read () - parsedAt );
         }
-        if ( json.type ( runPumpsArrayIndex ) != JSMN_ARRAY )
+
+        if ( currSize != -1 )
         {
-            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... '%s' arry should be none other than array type", JSON_KEY_RUN_PUMPS );
+            return serviceStatus -> status ( SUCCESS, "Command queued at %d of %d", currSize, orderQueue->getCapacity () ) -> withOrderId ( orderInfo.orderId );
         }
-
-        const int existingQueueSize = orderQueue->size ();
-        int numberOfInstructions = json.childCount ( runPumpsArrayIndex );
-        int childIndex = -1; // start iterating from the begining of the array
-        unsigned int runPumpsFor [ TOTAL_PUMPS ] = { 0 };
-
-        for ( int i = 0; i < numberOfInstructions; i++ )
+        else
         {
+            return serviceStatus -> status ( ERROR_ORDER_QUEUE_FULL, "Command NOT accepted. Orders exist %d of %d", orderQueue->size (), orderQueue->getCapacity () );
+        }
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_CLEAR ) )
+    {
+        orderManager->abortPour ();
+        return serviceStatus -> status ( SUCCESS, "All Pumps reset" );
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_PAUSE ) )
+    {
+        pumpControl->pausePumps ();
+        return serviceStatus -> status ( SUCCESS, "Pumps Paused" );
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_RESUME ) )
+    {
+        pumpControl->resumePumps ();
+        return serviceStatus -> status ( SUCCESS, "Pumps Resumed" );
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_STATS ) )
+    {
+        char statsBuffer [ 256 ];
 
-            childIndex = json.findChildIndexOf ( runPumpsArrayIndex, childIndex );
-            if ( json.type ( childIndex ) != JSMN_OBJECT )
+        int resetIndex = json.findKeyIndexIn ( JSON_KEY_STATS_RESET, JSON_ROOT_INDEX );
+        if ( resetIndex != -1 )
+        {
+            int resetValueIndex = json.findChildIndexOf ( resetIndex, -1 );
+            if ( ( resetValueIndex != -1 ) && json.matches ( resetValueIndex, "true" ) )
             {
-                return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... '%s' array should have all 'object' elements", JSON_KEY_RUN_PUMPS );
+                orderStats.reset ();
+                return serviceStatus -> status ( SUCCESS, "Stats reset" );
             }
+        }
 
-            int idIndex = json.findKeyIndexIn ( JSON_KEY_RUN_PUMPS_ID, childIndex );
-            if ( idIndex == -1 )
+        int stageIndex = json.findKeyIndexIn ( JSON_KEY_STATS_STAGE, JSON_ROOT_INDEX );
+        if ( stageIndex != -1 )
+        {
+            int stageValueIndex = json.findChildIndexOf ( stageIndex, -1 );
+            for ( int stage = 0; ( stageValueIndex != -1 ) && ( stage < ORDER_STAGE_COUNT ); stage++ )
             {
-                return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... object at %d is missing '%s' key", i, JSON_KEY_RUN_PUMPS_ID );
+                if ( json.matches ( stageValueIndex, OrderStats::stageName ( (OrderStage) stage ) ) )
+                {
+                    orderStats.getHistogram ( (OrderStage) stage ).print ( statsBuffer, sizeof ( statsBuffer ) );
+                    return serviceStatus -> status ( SUCCESS, "%s", statsBuffer );
+                }
             }
+            return serviceStatus -> status ( ERROR_ORDER_INVALID_STAGE, "Invalid JSON ... unknown '%s'", JSON_KEY_STATS_STAGE );
+        }
 
-            int durationIndex = json.findKeyIndexIn ( JSON_KEY_RUN_PUMPS_FOR, childIndex );
-            if ( durationIndex == -1 )
-            {
-                return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... object at %d is missing '%s' key", i, JSON_KEY_RUN_PUMPS_FOR );
-            }
-            // Now as we have both the keys of 'id' and 'for', get the values out
+        orderStats.printSummary ( statsBuffer, sizeof ( statsBuffer ) );
+        return serviceStatus -> status ( SUCCESS, "%s", statsBuffer );
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_PROFILE ) )
+    {
+#ifdef BARVIS_PROFILE
+        int resetIndex = json.findKeyIndexIn ( JSON_KEY_STATS_RESET, JSON_ROOT_INDEX );
+        if ( resetIndex != -1 )
+        {
+            Profiler::reset ();
+            return serviceStatus -> status ( SUCCESS, "Profile reset" );
+        }
+        int siteCount = dumpProfile ();
+        return serviceStatus -> status ( SUCCESS, "%d profile sites dumped to USB", siteCount );
+#else
+        return serviceStatus -> status ( SUCCESS, "Profiling not built in, see BARVIS_PROFILE" );
+#endif
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_TRACE ) )
+    {
+#ifdef BARVIS_TRACE
+        int resetIndex = json.findKeyIndexIn ( JSON_KEY_STATS_RESET, JSON_ROOT_INDEX );
+        if ( resetIndex != -1 )
+        {
+            Trace::clear ();
+            return serviceStatus -> status ( SUCCESS, "Trace cleared" );
+        }
+        int recordCount = dumpTrace ();
+        return serviceStatus -> status ( SUCCESS, "%d trace records dumped to USB", recordCount );
+#else
+        return serviceStatus -> status ( SUCCESS, "Tracing not built in, see BARVIS_TRACE" );
+#endif
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_SET ) )
+    {
+        int recipeId = -1;
+        if ( !readRootInteger ( json, JSON_KEY_RECIPE, recipeId ) )
+        {
+            return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... '%s' should have an integer value", JSON_KEY_RECIPE );
+        }
+        if ( ( recipeId < 0 ) || ( recipeId >= RECIPE_BOOK_SIZE ) )
+        {
+            return serviceStatus -> status ( ERROR_ORDER_INVALID_RECIPE, "Invalid recipe: %d, there are %d", recipeId, RECIPE_BOOK_SIZE );
+        }
 
-            int idValueIndex = json.findChildIndexOf ( idIndex, 0 );
-            if ( idValueIndex == -1 )
-            {
-                return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '&s' value is missing", i, JSON_KEY_RUN_PUMPS_ID );
-            }
-            if ( ( json.type ( idValueIndex ) != JSMN_PRIMITIVE ) )
-            {
-                return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '%s' should have integer value", i, JSON_KEY_RUN_PUMPS_ID );
-            }
+        unsigned int runPumpsFor [ TOTAL_PUMPS ] = { 0 };
+        if ( parseRunPumps ( json, pumpControl, runPumpsFor, serviceStatus ) != NULL )
+        {
+            return serviceStatus;
+        }
+        switch ( recipeBook->store ( recipeId, runPumpsFor, TOTAL_PUMPS ) )
+        {
+            case RecipeStored:
+                break;
+            case RecipeTooManySteps:
+                return serviceStatus -> status ( ERROR_ORDER_INVALID_RECIPE, "Recipe %d NOT stored, at most %d pumps", recipeId, RECIPE_MAX_STEPS );
+            case RecipeNotPersisted:
+                return serviceStatus -> status ( ERROR_ORDER_RECIPE_NOT_PERSISTED, "Recipe %d NOT stored, EEPROM write failed, the previous one is kept", recipeId );
+            default:
+                return serviceStatus -> status ( ERROR_ORDER_INVALID_RECIPE, "Invalid recipe: %d, there are %d", recipeId, RECIPE_BOOK_SIZE );
+        }
+        return serviceStatus -> status ( SUCCESS, recipeBook->isDefined ( recipeId ) ? "Recipe %d stored" : "Recipe %d removed", recipeId );
+    }
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_ORDER ) )
+    {
+        int recipeId = -1;
+        if ( !readRootInteger ( json, JSON_KEY_RECIPE, recipeId ) )
+        {
+            return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... '%s' should have an integer value", JSON_KEY_RECIPE );
+        }
+        int count = 1;
+        if ( ( json.findKeyIndexIn ( JSON_KEY_COUNT, JSON_ROOT_INDEX ) != -1 ) && !readRootInteger ( json, JSON_KEY_COUNT, count ) )
+        {
+            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... '%s' should have an integer value", JSON_KEY_COUNT );
+        }
+        if ( ( count < 1 ) || ( count > orderQueue->getCapacity () ) )
+        {
+            return serviceStatus -> status ( ERROR_ORDER_INVALID_COUNT, "Invalid count: %d, at most %d", count, orderQueue->getCapacity () );
+        }
 
-            int durationValueIndex = json.findChildIndexOf ( durationIndex, 0 );
-            if ( durationValueIndex == -1 )
-            {
-                return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '&s' value is missing", i, JSON_KEY_RUN_PUMPS_FOR );
-            }
-            if ( json.type ( durationValueIndex ) != JSMN_PRIMITIVE )
-            {
-                return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... object at %d: '%s' should have integer value", i, JSON_KEY_RUN_PUMPS_FOR );
-            }
+        unsigned int runPumpsFor [ TOTAL_PUMPS ];
+        if ( ( recipeId < 0 ) || !recipeBook->expand ( recipeId, runPumpsFor, TOTAL_PUMPS ) )
+        {
+            return serviceStatus -> status ( ERROR_ORDER_INVALID_RECIPE, "Recipe %d is not defined", recipeId );
+        }
+        orderStats.record ( StageParse, parsedAt - orderInfo.receivedAt );
 
-            int pumpId = json.tokenIntegerValue ( idValueIndex );
-            if ( !pumpControl->isValidId ( pumpId ) )
+        int queued = 0;
+        int currSize = -1;
+        int firstOrderId = -1;
+        for ( ; queued < count; queued++ )
+        {
+            uint32_t enqueueStart = ( queued == 0 ) ? parsedAt : us_ticker_read ();
+            currSize = orderQueue->addOrder ( runPumpsFor, &orderInfo );
+            if ( currSize == -1 )
             {
-                return serviceStatus -> status ( ERROR_PUMP_INVALID_ID, "Invalid ID: %d provided for Instruction: %d", pumpId, i );
+                break;
             }
-
-            int duration = json.tokenIntegerValue ( durationValueIndex );
-            if ( !pumpControl->isValidDuration ( duration ) )
+            TRACE( TraceOrderEnqueued, currSize, recipeId );
+            orderStats.record ( StageEnqueue, us_ticker_read () - enqueueStart );
+            if ( firstOrderId == -1 )
             {
-                return serviceStatus -> status ( ERROR_PUMP_INVALID_DURATION, "Invalid Duration: %d provided for Instruction: %d", duration, i );
+                firstOrderId = orderInfo.orderId;
             }
-
-            runPumpsFor [ pumpId ] = (unsigned int) duration;
         }
 
-//        pumpControl -> runPumpsFor ( runPumpsFor );
-
-        orderManager->lock ();
-        // Queue the Pump Operation now
-        int currSize = orderQueue->addOrder ( runPumpsFor );
-        char debugBuffer [ 250 ];
-        orderQueue->print ( debugBuffer );
-        debug( debugBuffer );
-        orderManager->release ();
-
-        if ( currSize > existingQueueSize )
-        {
-            return serviceStatus -> status ( SUCCESS, "Command queued at %d of %d", currSize, orderQueue->getCapacity () );
-        }
-        else
+        if ( queued == count )
         {
-            return serviceStatus -> status ( ERROR_ORDER_QUEUE_FULL, "Command NOT accepted. Orders exist %d of %d", currSize, orderQueue->getCapacity () );
+            return serviceStatus -> status ( SUCCESS, "Recipe %d queued %d times, %d of %d", recipeId, queued, currSize, orderQueue->getCapacity () ) -> withOrderId ( firstOrderId );
         }
+        return serviceStatus -> status ( ERROR_ORDER_QUEUE_FULL, "Recipe %d queued only %d of %d times, queue full", recipeId, queued, count ) -> withOrderId ( firstOrderId );
     }
-    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_CLEAR ) )
-    {
-        pumpControl->resetPumps ();
-        return serviceStatus -> status ( SUCCESS, "All Pumps reset" );
-    }
-    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_PAUSE ) )
-    {
-        pumpControl->pausePumps ();
-        return serviceStatus -> status ( SUCCESS, "Pumps Paused" );
-    }
-    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_RESUME ) )
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_CANCEL ) )
     {
-        pumpControl->resumePumps ();
-        return serviceStatus -> status ( SUCCESS, "Pumps Resumed" );
+        int orderId = 0;
+        if ( !readRootInteger ( json, JSON_KEY_ORDER, orderId ) )
+        {
+            return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... '%s' should have an integer value", JSON_KEY_ORDER );
+        }
+        if ( ( orderId <= 0 ) || ( orderId > 0xFFFF ) || !orderManager->cancelOrder ( orderId ) )
+        {
+            return serviceStatus -> status ( ERROR_ORDER_UNKNOWN, "Order %d is neither queued nor pouring", orderId );
+        }
+        return serviceStatus -> status ( SUCCESS, "Order %d cancelled", orderId ) -> withOrderId ( orderId );
     }
-    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_SET ) )
+    else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_AMEND ) )
     {
+        int orderId = 0;
+        if ( !readRootInteger ( json, JSON_KEY_ORDER, orderId ) )
+        {
+            return serviceStatus -> status ( ERROR_JSON_MISSING_ATTRIBUTE, "Invalid JSON ... '%s' should have an integer value", JSON_KEY_ORDER );
+        }
 
+        unsigned int runPumpsFor [ TOTAL_PUMPS ] = { 0 };
+        if ( parseRunPumps ( json, pumpControl, runPumpsFor, serviceStatus ) != NULL )
+        {
+            return serviceStatus;
+        }
+        if ( ( orderId <= 0 ) || ( orderId > 0xFFFF ) || !orderQueue->amendOrder ( orderId, runPumpsFor ) )
+        {
+            return serviceStatus -> status ( ERROR_ORDER_UNKNOWN, "Order %d is not queued ( any more )", orderId );
+        }
+        return serviceStatus -> status ( SUCCESS, "Order %d amended", orderId ) -> withOrderId ( orderId );
     }
     else if ( json.matches ( typeValueIndex, JSON_ENUM_TYPE_AT ) )
     {
@@ -430,16 +961,18 @@ ServiceStatus * executeCommand ( char * jsonCommand, int commandLength, OrderMan
         }
 
         int cmdLen = json.tokenLength ( atCmdValueIndex );
-        char * atCommand = new char [ cmdLen + 1 ];
+        if ( cmdLen > BLE_AT_COMMAND_SIZE )
+        {
+            return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... '%s' longer than %d characters", JSON_KEY_AT_CMD, BLE_AT_COMMAND_SIZE );
+        }
+        char atCommand [ BLE_AT_COMMAND_SIZE + 1 ];
         strncpy ( atCommand, json.tokenAddress ( atCmdValueIndex ), cmdLen );
         atCommand [ cmdLen ] = 0;
-        char * atResponse = new char [ 32 ];
-        sendBleATCommand ( ble, atCommand, atResponse, BARVIS_COMMAND_SIZE );
-        serviceStatus -> status ( SUCCESS, "[%s] response: [%s]", atCommand, atResponse );
-        delete [] atCommand;
-        delete [] atResponse;
-        return serviceStatus;
+        char atResponse [ BLE_AT_RESPONSE_SIZE ];
+        sendBleATCommand ( ble, atCommand, atResponse, BLE_AT_RESPONSE_SIZE );
+        return serviceStatus -> status ( SUCCESS, "[%s] response: [%s]", atCommand, atResponse );
     }
 
-    return serviceStatus;
+    // Not the reply of an earlier command, with its message and order id
+    return serviceStatus -> status ( ERROR_JSON_INVALID_VALUE_TYPE, "Invalid JSON ... unknown '%s'", JSON_KEY_TYPE );
 }
@@ -0,0 +1,125 @@
+#include "HostTest.h"
+#include "DispenserRail.h"
+#include "FlashImage.h"
+#include "DispenserControl.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define HOME_PIN        D14
+#define END_PIN         D15
+#define STEP_PIN        D16
+#define DIR_PIN         D17
+
+#define RAIL_LENGTH     1200
+#define IMAGE_PATH      "dispenser_calibration.img"
+
+class Arrivals : public DispenserControlListener
+{
+    public:
+        int count;
+        unsigned int position;
+
+        Arrivals ()
+                : count ( 0 ), position ( 0 )
+        {
+        }
+
+        virtual void reachedToPosition ( const unsigned int _position, const unsigned int stepsTaken )
+        {
+            count++;
+            position = _position;
+        }
+
+        virtual void moveFailed ( const unsigned int _position )
+        {
+        }
+};
+
+static void moveAndWait ( DispenserControl & dispenser, Arrivals & arrivals, const unsigned int position )
+{
+    const int before = arrivals.count;
+    CHECK ( dispenser.moveToPosition ( position ) );
+    while ( ( arrivals.count == before ) && Sim::runNextTimer () )
+    {
+    }
+    CHECK_EQUAL ( before + 1, arrivals.count );
+}
+
+int main ()
+{
+    Sim::reset ();
+    remove ( IMAGE_PATH );
+    DispenserRail rail ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN, RAIL_LENGTH, 400 );
+    Arrivals arrivals;
+    DispenserControlListener * listener = &arrivals;
+
+    // Nothing stored: full calibration, home, end and park mid rail
+    {
+        FlashImage image ( EEPROM_SIZE, IMAGE_PATH );
+        DispenserControl dispenser ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN, &image );
+        CHECK_EQUAL ( RAIL_LENGTH / 2, rail.getPosition () );
+        CHECK_EQUAL ( rail.getPosition (), dispenser.getCurrentPosition () );
+        CHECK ( rail.getStepCount () >= 400 + RAIL_LENGTH + RAIL_LENGTH / 2 );
+        CHECK ( image.getBytesWritten () > 0 );
+
+        dispenser.setListener ( listener );
+        moveAndWait ( dispenser, arrivals, 900 );
+        CHECK_EQUAL ( 900, rail.getPosition () );
+        CHECK ( dispenser.saveCalibration () );
+    }
+
+    // Reboot with the head where it was left: only the way home is checked
+    {
+        const unsigned int before = rail.getStepCount ();
+        FlashImage image ( EEPROM_SIZE, IMAGE_PATH );
+        DispenserControl dispenser ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN, &image );
+        CHECK ( rail.getStepCount () - before <= 900 + DISPENSER_CALIBRATION_TOLERANCE_STEPS );
+        CHECK_EQUAL ( 0, rail.getPosition () );
+        CHECK_EQUAL ( rail.getPosition (), dispenser.getCurrentPosition () );
+
+        // The stored travel is used without measuring it again
+        dispenser.setListener ( listener );
+        moveAndWait ( dispenser, arrivals, RAIL_LENGTH - 100 );
+        CHECK_EQUAL ( RAIL_LENGTH - 100, rail.getPosition () );
+        CHECK ( dispenser.saveCalibration () );
+    }
+
+    // Head pushed while powered down: verification fails, full calibration
+    rail.pushHeadTo ( 300 );
+    {
+        const unsigned int before = rail.getStepCount ();
+        FlashImage image ( EEPROM_SIZE, IMAGE_PATH );
+        DispenserControl dispenser ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN, &image );
+        CHECK ( rail.getStepCount () - before >= RAIL_LENGTH + RAIL_LENGTH / 2 );
+        CHECK_EQUAL ( RAIL_LENGTH / 2, rail.getPosition () );
+        CHECK_EQUAL ( rail.getPosition (), dispenser.getCurrentPosition () );
+    }
+
+    // Corrupt calibration data is ignored
+    {
+        FlashImage image ( EEPROM_SIZE, IMAGE_PATH );
+        const uint8_t garbage [ 4 ] = { 0x12, 0x34, 0x56, 0x78 };
+        image.write ( DISPENSER_CALIBRATION_EEPROM_ADDRESS + 4, garbage, sizeof ( garbage ) );
+        const unsigned int before = rail.getStepCount ();
+        DispenserControl dispenser ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN, &image );
+        CHECK ( rail.getStepCount () - before >= RAIL_LENGTH + RAIL_LENGTH / 2 );
+        CHECK_EQUAL ( rail.getPosition (), dispenser.getCurrentPosition () );
+    }
+
+    // Nothing is written outside the calibration's region, KvStore owns the rest
+    {
+        FlashImage image ( EEPROM_SIZE, IMAGE_PATH );
+        unsigned int outside = 0;
+        for ( unsigned int address = 0; address < EEPROM_SIZE; address++ )
+        {
+            uint8_t byte;
+            image.read ( address, &byte, 1 );
+            const bool inRegion = ( address >= DISPENSER_CALIBRATION_EEPROM_ADDRESS ) && ( address < DISPENSER_CALIBRATION_EEPROM_ADDRESS + DISPENSER_CALIBRATION_EEPROM_SIZE );
+            outside += ( !inRegion && ( byte != 0xFF ) ) ? 1 : 0;
+        }
+        CHECK_EQUAL ( 0, outside );
+    }
+
+    remove ( IMAGE_PATH );
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,107 @@
+#include "HostTest.h"
+#include "DispenserRail.h"
+#include "DispenserControl.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define HOME_PIN        D14
+#define END_PIN         D15
+#define STEP_PIN        D16
+#define DIR_PIN         D17
+
+#define RAIL_LENGTH     1200
+
+class MoveLog : public DispenserControlListener
+{
+    public:
+        int arrivals;
+        int failures;
+
+        MoveLog ()
+                : arrivals ( 0 ), failures ( 0 )
+        {
+        }
+
+        virtual void reachedToPosition ( const unsigned int position, const unsigned int stepsTaken )
+        {
+            arrivals++;
+        }
+
+        virtual void moveFailed ( const unsigned int position )
+        {
+            failures++;
+        }
+};
+
+static void moveAndWait ( DispenserControl & dispenser, const unsigned int position )
+{
+    CHECK ( dispenser.moveToPosition ( position ) );
+    while ( dispenser.isInMotion () && Sim::runNextTimer () )
+    {
+    }
+}
+
+/**
+ * A move either arrives where it was asked to or fails, it never reports
+ * an arrival the limit switches contradicted
+ */
+int main ()
+{
+    Sim::reset ();
+    DispenserRail rail ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN, RAIL_LENGTH, 400 );
+    DispenserControl dispenser ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN );
+    MoveLog log;
+    DispenserControlListener * listener = &log;
+    dispenser.setListener ( listener );
+    CHECK_EQUAL ( RAIL_LENGTH / 2, rail.getPosition () );
+
+    // Lost steps go unnoticed until a switch shows up early, then the head
+    // goes home and starts over
+    rail.loseSteps ( 200 );
+    moveAndWait ( dispenser, 900 );
+    CHECK_EQUAL ( 700, rail.getPosition () );
+    CHECK_EQUAL ( 1, log.arrivals );
+
+    moveAndWait ( dispenser, 100 );
+    CHECK_EQUAL ( 2, log.arrivals );
+    CHECK_EQUAL ( 0, log.failures );
+    CHECK_EQUAL ( 100, rail.getPosition () );
+    CHECK_EQUAL ( 100, dispenser.getCurrentPosition () );
+
+    // A switch that keeps triggering mid rail fails the move, the head
+    // doesn't claim to be anywhere
+    rail.triggerEndAt ( 500 );
+    moveAndWait ( dispenser, 900 );
+    CHECK_EQUAL ( 2, log.arrivals );
+    CHECK_EQUAL ( 1, log.failures );
+    CHECK ( dispenser.hasMoveFailed () );
+    CHECK_EQUAL ( 500, rail.getPosition () );
+
+    // Fixed, the next move homes first and gets there, with the calibrated
+    // travel intact
+    rail.triggerEndAt ( -1 );
+    const unsigned int before = rail.getStepCount ();
+    moveAndWait ( dispenser, RAIL_LENGTH - 50 );
+    CHECK_EQUAL ( 3, log.arrivals );
+    CHECK ( !dispenser.hasMoveFailed () );
+    CHECK_EQUAL ( RAIL_LENGTH - 50, rail.getPosition () );
+    CHECK_EQUAL ( 500 + RAIL_LENGTH - 50, rail.getStepCount () - before );
+
+    // A stalled motor never finds home, homing gives up after the rail
+    // length and then some
+    dispenser.requestHoming ();
+    rail.loseSteps ( 100000 );
+    const unsigned int stalledFrom = rail.getStepCount ();
+    moveAndWait ( dispenser, 300 );
+    CHECK_EQUAL ( 3, log.arrivals );
+    CHECK_EQUAL ( 2, log.failures );
+    CHECK_EQUAL ( 2, dispenser.getFailedMoves () );
+    CHECK ( rail.getStepCount () - stalledFrom <= RAIL_LENGTH + DISPENSER_CALIBRATION_TOLERANCE_STEPS + DISPENSER_HOMING_MARGIN_STEPS );
+
+    rail.loseSteps ( 0 );
+    moveAndWait ( dispenser, 300 );
+    CHECK_EQUAL ( 4, log.arrivals );
+    CHECK_EQUAL ( 300, rail.getPosition () );
+
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,61 @@
+#include "DispenserRail.h"
+#include "DispenserControl.h"
+
+/**
+ * Average dispenser travel per order for a few evenly spaced cup layouts,
+ * going home before every move ( what moveToPosition did before it moved
+ * relative to the current position ) against relative moves.  The cup of
+ * each order is pseudo random, the same sequence for both.
+ *
+ * Fails if relative moves ever take more steps than homing every time.
+ */
+#define HOME_PIN        D14
+#define END_PIN         D15
+#define STEP_PIN        D16
+#define DIR_PIN         D17
+
+#define RAIL_LENGTH     4000
+#define ORDER_COUNT     100
+
+static unsigned int averageSteps ( const int cupCount, const bool homeEveryMove )
+{
+    Sim::reset ();
+    DispenserRail rail ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN, RAIL_LENGTH, 0 );
+    DispenserControl dispenser ( HOME_PIN, END_PIN, STEP_PIN, DIR_PIN );
+
+    uint32_t seed = 12345;
+    for ( int i = 0; i < ORDER_COUNT; i++ )
+    {
+        seed = seed * 1103515245 + 12345;
+        const int cup = ( seed >> 16 ) % cupCount;
+        if ( homeEveryMove )
+        {
+            dispenser.requestHoming ();
+        }
+        dispenser.moveToPosition ( ( ( 2 * cup + 1 ) * RAIL_LENGTH ) / ( 2 * cupCount ) );
+        while ( dispenser.isInMotion () && Sim::runNextTimer () )
+        {
+        }
+    }
+    return dispenser.getTotalTravelSteps () / dispenser.getCompletedMoves ();
+}
+
+int main ()
+{
+    static const int layouts [] = { 2, 4, 8 };
+    int result = 0;
+
+    printf ( "%-6s %14s %14s\n", "cups", "home first", "relative" );
+    for ( unsigned int i = 0; i < sizeof ( layouts ) / sizeof ( layouts [ 0 ] ); i++ )
+    {
+        const unsigned int before = averageSteps ( layouts [ i ], true );
+        const unsigned int after = averageSteps ( layouts [ i ], false );
+        printf ( "%-6d %14u %14u\n", layouts [ i ], before, after );
+        if ( after > before )
+        {
+            result = 1;
+        }
+    }
+    printf ( "average travel steps per order, %d orders, %d step rail\n", ORDER_COUNT, RAIL_LENGTH );
+    return result;
+}
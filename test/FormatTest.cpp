@@ -0,0 +1,197 @@
+#include "HostTest.h"
+#include "Format.h"
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define BUFFER_SIZE     128
+#define SENTINEL        '#'
+
+/**
+ * Format::vprint against vsnprintf, at the full buffer size and at every
+ * size up to one past the output, where it must truncate and terminate
+ * like snprintf and leave the rest of the buffer alone
+ */
+static void checkPrint ( const int line, const char * format, ... )
+{
+    char expected [ BUFFER_SIZE ];
+    va_list args;
+    va_start ( args, format );
+    const int expectedLength = vsnprintf ( expected, sizeof ( expected ), format, args );
+    va_end ( args );
+
+    for ( int size = 0; size <= BUFFER_SIZE; size = ( size <= expectedLength ) ? size + 1 : BUFFER_SIZE + ( size == BUFFER_SIZE ) )
+    {
+        char actual [ BUFFER_SIZE + 1 ];
+        memset ( actual, SENTINEL, sizeof ( actual ) );
+        va_start ( args, format );
+        const int actualLength = Format::vprint ( actual, size, format, args );
+        va_end ( args );
+
+        bool matches = ( actualLength == expectedLength ) && ( actual [ size ] == SENTINEL );
+        if ( size > 0 )
+        {
+            const int kept = ( expectedLength < size ) ? expectedLength : ( size - 1 );
+            matches = matches && ( memcmp ( actual, expected, kept ) == 0 ) && ( actual [ kept ] == '\0' );
+        }
+        if ( !matches )
+        {
+            fprintf ( stderr, "line %d: \"%s\" at size %d gave %d \"%.*s\", snprintf %d \"%s\"\n", line, format, size, actualLength, ( size > 0 ) ? size - 1 : 0, actual, expectedLength,
+                    expected );
+            hostTestFailures++;
+            return;
+        }
+    }
+}
+
+static void printMatchesSnprintf ()
+{
+    checkPrint ( __LINE__, "plain text, no conversion" );
+    checkPrint ( __LINE__, "" );
+    checkPrint ( __LINE__, "%d %d %d %d %d", 0, 42, -42, INT_MIN, INT_MAX );
+    checkPrint ( __LINE__, "%i|%5d|%-5d|%05d|%-05d|%2d", -7, -42, -42, -42, -42, 123456 );
+    checkPrint ( __LINE__, "%*d|%-*d|%0*d", 6, 31, 6, 31, 6, -31 );
+    checkPrint ( __LINE__, "%u %u %x %X %08x %x", 0u, UINT_MAX, 0xdeadbeefu, 0xdeadbeefu, 0xbeefu, 0u );
+    checkPrint ( __LINE__, "%ld %lu %lx %li", -123456L, 4000000000UL, 0xcafeUL, 2147483647L );
+    checkPrint ( __LINE__, "%c|%3c|%-3c|", 'a', 'b', 'c' );
+    checkPrint ( __LINE__, "%s|%10s|%-10s|%.3s|%8.2s|%-8.2s|", "text", "text", "text", "text", "text", "text" );
+    checkPrint ( __LINE__, "%.*s|%.*s|%.0s|", 2, "abcdef", 10, "abc", "gone" );
+    checkPrint ( __LINE__, "%%|100%% done|%d%%", 50 );
+    checkPrint ( __LINE__, "{\"status\":%d,\"message\":\"[%s] %-12s %8lu\",\"order\":%u}", -3, "AT", "response", 123456UL, 65535u );
+}
+
+/**
+ * %p isn't snprintf's, it is always 0x and eight hex digits
+ */
+static void printPointer ()
+{
+    char buffer [ BUFFER_SIZE ];
+    CHECK_EQUAL ( 10, Format::print ( buffer, sizeof ( buffer ), "%p", (void *) 0xabcd ) );
+    CHECK ( strcmp ( buffer, "0x0000abcd" ) == 0 );
+}
+
+static void numbersTruncate ()
+{
+    char buffer [ 8 ];
+    memset ( buffer, SENTINEL, sizeof ( buffer ) );
+    CHECK_EQUAL ( 11, Format::integer ( buffer, 0, INT_MIN ) );
+    CHECK_EQUAL ( SENTINEL, buffer [ 0 ] );
+    CHECK_EQUAL ( 11, Format::integer ( buffer, 1, INT_MIN ) );
+    CHECK_EQUAL ( '\0', buffer [ 0 ] );
+    CHECK_EQUAL ( SENTINEL, buffer [ 1 ] );
+    CHECK_EQUAL ( 11, Format::integer ( buffer, 4, INT_MIN ) );
+    CHECK ( strcmp ( buffer, "-21" ) == 0 );
+    CHECK_EQUAL ( SENTINEL, buffer [ 4 ] );
+
+    CHECK_EQUAL ( 8, Format::unsignedValue ( buffer, sizeof ( buffer ), 0xbeef, 8, '0', 16 ) );
+    CHECK ( strcmp ( buffer, "0000bee" ) == 0 );
+    CHECK_EQUAL ( 10, Format::unsignedValue ( buffer, sizeof ( buffer ), UINT_MAX ) );
+    CHECK ( strcmp ( buffer, "4294967" ) == 0 );
+}
+
+static void checkDecimal ( const int32_t value, const int decimals, const char * expected )
+{
+    char buffer [ BUFFER_SIZE ];
+    const int length = Format::decimal ( buffer, sizeof ( buffer ), value, decimals );
+    CHECK_EQUAL ( strlen ( expected ), length );
+    if ( strcmp ( buffer, expected ) != 0 )
+    {
+        fprintf ( stderr, "decimal ( %d, %d ) gave \"%s\", not \"%s\"\n", value, decimals, buffer, expected );
+        hostTestFailures++;
+    }
+}
+
+static void decimal ()
+{
+    checkDecimal ( 1234, 3, "1.234" );
+    checkDecimal ( -5, 2, "-0.05" );
+    checkDecimal ( 0, 2, "0.00" );
+    checkDecimal ( 7, 0, "7" );
+    checkDecimal ( INT_MIN, 0, "-2147483648" );
+    checkDecimal ( INT_MIN, 3, "-2147483.648" );
+    checkDecimal ( INT_MIN, 9, "-2.147483648" );
+    checkDecimal ( INT_MAX, 9, "2.147483647" );
+
+    char buffer [ 6 ];
+    CHECK_EQUAL ( 12, Format::decimal ( buffer, sizeof ( buffer ), INT_MIN, 3 ) );
+    CHECK ( strcmp ( buffer, "-2147" ) == 0 );
+}
+
+static void checkInteger ( const char * text, const int length, const int expectedUsed, const int32_t expectedValue )
+{
+    int32_t value;
+    const int used = Format::parseInteger ( text, length, value );
+    if ( ( used != expectedUsed ) || ( ( used > 0 ) && ( value != expectedValue ) ) )
+    {
+        fprintf ( stderr, "parseInteger ( \"%.*s\" ) used %d gave %d, not %d and %d\n", length, text, used, value, expectedUsed, expectedValue );
+        hostTestFailures++;
+    }
+}
+
+static void parseInteger ()
+{
+    checkInteger ( "0", 1, 1, 0 );
+    checkInteger ( "+7", 2, 2, 7 );
+    checkInteger ( "-42,", 4, 3, -42 );
+    checkInteger ( "2147483647", 10, 10, INT_MAX );
+    checkInteger ( "2147483648", 10, 10, INT_MAX );
+    checkInteger ( "-2147483648", 11, 11, INT_MIN );
+    checkInteger ( "-2147483649", 11, 11, INT_MIN );
+    checkInteger ( "99999999999999999999", 20, 20, INT_MAX );
+    checkInteger ( "-99999999999999999999", 21, 21, INT_MIN );
+    checkInteger ( "12345", 3, 3, 123 ); // the span ends there
+    checkInteger ( "12ab", 4, 2, 12 );
+    checkInteger ( "-", 1, 0, 0 );
+    checkInteger ( "+", 1, 0, 0 );
+    checkInteger ( "", 0, 0, 0 );
+    checkInteger ( "x1", 2, 0, 0 );
+}
+
+/**
+ * Format::parseDecimal against strtof, same characters used and the same
+ * value to float precision
+ */
+static void checkDecimalText ( const char * text )
+{
+    float value;
+    const int used = Format::parseDecimal ( text, strlen ( text ), value );
+    char * end;
+    const float expected = strtof ( text, &end );
+    const bool sameValue = ( used == 0 ) || ( fabsf ( value - expected ) <= fabsf ( expected ) * 1e-6f );
+    if ( ( used != ( end - text ) ) || !sameValue )
+    {
+        fprintf ( stderr, "parseDecimal ( \"%s\" ) used %d gave %g, strtof %d and %g\n", text, used, value, (int) ( end - text ), expected );
+        hostTestFailures++;
+    }
+}
+
+static void parseDecimal ()
+{
+    static const char * texts [] = { "0", "1", "-1", "+2.5", "3.25", "12.", ".5", "-.5", "0.001", "1e", "1e+", "1e-", "1e3", "1E3", "1.5e3", "2.5E-2", "1e+2", "-7e-3x", ".", "-.", "+",
+            "", "e5", "123456789012", "0.000000000123456789", "1.17549435e-38", "3.4e38", "42,", "7.5.5" };
+    for ( unsigned int i = 0; i < sizeof ( texts ) / sizeof ( texts [ 0 ] ); i++ )
+    {
+        checkDecimalText ( texts [ i ] );
+    }
+
+    // Only length characters are looked at
+    float value;
+    CHECK_EQUAL ( 3, Format::parseDecimal ( "1.5e3", 3, value ) );
+    CHECK ( value == 1.5f );
+    CHECK_EQUAL ( 0, Format::parseDecimal ( "-.5", 2, value ) );
+}
+
+int main ()
+{
+    printMatchesSnprintf ();
+    printPointer ();
+    numbersTruncate ();
+    decimal ();
+    parseInteger ();
+    parseDecimal ();
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,180 @@
+#include "HostTest.h"
+#include "BarRig.h"
+#include "IrSensorManager.h"
+#include <vector>
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define MILLI_SECOND    1000ULL
+#define SECOND          1000000ULL
+
+static const PinName sensorPins [ 2 ] = { D2, D3 };
+
+class EventLog : public IrSensorListener
+{
+    public:
+        struct Event
+        {
+                int pinId;
+                bool value;
+                uint64_t at;
+        };
+        std::vector<Event> events;
+
+        virtual void pinStateChanged ( const PinName pin, const int pinId, const bool pinValue )
+        {
+            Event event = { pinId, pinValue, Sim::now () };
+            events.push_back ( event );
+        }
+};
+
+/**
+ * The main loop calling process () every millisecond
+ */
+static void runFor ( IrSensorManager & sensors, const uint64_t microSeconds )
+{
+    for ( uint64_t t = 0; t < microSeconds; t += MILLI_SECOND )
+    {
+        Sim::advance ( MILLI_SECOND );
+        sensors.process ();
+    }
+}
+
+/**
+ * Every sensor is reported on the first process (), a cup that is there
+ * at start up doesn't have to come back first
+ */
+static void firstReport ()
+{
+    Sim::reset ();
+    Sim::setPin ( D2, 1 );
+    IrSensorManager sensors ( sensorPins, 2 );
+    EventLog log;
+    sensors.addListener ( &log );
+
+    sensors.process ();
+    CHECK_EQUAL ( 2, log.events.size () );
+    CHECK ( sensors.isPresent ( 0 ) );
+    CHECK ( !sensors.isPresent ( 1 ) );
+    runFor ( sensors, SECOND );
+    CHECK_EQUAL ( 2, log.events.size () );
+}
+
+/**
+ * The first falling edge of a present cup is reported right from the
+ * interrupt, the bounces that follow aren't reported at all
+ */
+static void absentOnFirstEdge ()
+{
+    Sim::reset ();
+    Sim::setPin ( D2, 1 );
+    IrSensorManager sensors ( sensorPins, 2 );
+    EventLog log;
+    sensors.addListener ( &log );
+    runFor ( sensors, 100 * MILLI_SECOND );
+    log.events.clear ();
+
+    const uint64_t lostAt = Sim::now ();
+    Sim::setPin ( D2, 0 );
+    CHECK_EQUAL ( 1, log.events.size () );
+    CHECK_EQUAL ( 0, log.events [ 0 ].pinId );
+    CHECK ( !log.events [ 0 ].value );
+    CHECK_EQUAL ( lostAt, log.events [ 0 ].at );
+    CHECK ( !sensors.isPresent ( 0 ) );
+
+    for ( int i = 0; i < 5; i++ )
+    {
+        runFor ( sensors, 3 * MILLI_SECOND );
+        Sim::setPin ( D2, 1 );
+        runFor ( sensors, 2 * MILLI_SECOND );
+        Sim::setPin ( D2, 0 );
+    }
+    runFor ( sensors, SECOND );
+    CHECK_EQUAL ( 1, log.events.size () );
+}
+
+/**
+ * A cup coming back has to hold IR_SENSOR_RETURN_SETTLE_MS, a beam that
+ * flickers meanwhile starts it over
+ */
+static void presentAfterReturnSettle ()
+{
+    Sim::reset ();
+    Sim::setPin ( D2, 1 );
+    IrSensorManager sensors ( sensorPins, 2 );
+    EventLog log;
+    sensors.addListener ( &log );
+    runFor ( sensors, 100 * MILLI_SECOND );
+    Sim::setPin ( D2, 0 );
+    runFor ( sensors, 100 * MILLI_SECOND );
+    log.events.clear ();
+
+    Sim::setPin ( D2, 1 );
+    runFor ( sensors, ( IR_SENSOR_RETURN_SETTLE_MS - 50 ) * MILLI_SECOND );
+    Sim::setPin ( D2, 0 ); // not yet reported present, so not reported lost either
+    CHECK_EQUAL ( 0, log.events.size () );
+    runFor ( sensors, 5 * MILLI_SECOND );
+    Sim::setPin ( D2, 1 );
+    const uint64_t backAt = Sim::now ();
+
+    runFor ( sensors, ( IR_SENSOR_RETURN_SETTLE_MS - 10 ) * MILLI_SECOND );
+    CHECK_EQUAL ( 0, log.events.size () );
+    runFor ( sensors, 20 * MILLI_SECOND );
+    CHECK_EQUAL ( 1, log.events.size () );
+    CHECK ( log.events [ 0 ].value );
+    CHECK ( log.events [ 0 ].at >= backAt + IR_SENSOR_RETURN_SETTLE_MS * MILLI_SECOND );
+    CHECK ( sensors.isPresent ( 0 ) );
+}
+
+/**
+ * Wired to OrderManager, taking the cup away switches the pumps off on
+ * the edge, they come back on once the cup held still long enough
+ */
+static void pumpsPauseOnFirstEdge ()
+{
+    static const unsigned int positions [ 1 ] = { 2000 };
+    Sim::reset ();
+    BarRig rig ( 1, positions );
+    Sim::setPin ( D2, 1 );
+    IrSensorManager sensors ( sensorPins, 1 );
+    sensors.addListener ( &rig.manager );
+
+    const uint16_t orderId = rig.order ( 5 );
+    for ( int i = 0; ( i < 20000 ) && ( rig.progress.of ( orderId ) != OrderPouring ); i++ )
+    {
+        rig.runFor ( RIG_MAIN_LOOP_MICRO_SECS );
+        sensors.process ();
+    }
+    CHECK_EQUAL ( OrderPouring, rig.progress.of ( orderId ) );
+    CHECK_EQUAL ( RIG_PUMPS, rig.pumpsOn () );
+
+    Sim::setPin ( D2, 0 );
+    CHECK_EQUAL ( 0, rig.pumpsOn () );
+    CHECK_EQUAL ( Paused, rig.pumps.getState () );
+
+    Sim::setPin ( D2, 1 );
+    for ( int i = 0; i < IR_SENSOR_RETURN_SETTLE_MS - 10; i++ )
+    {
+        rig.runFor ( RIG_MAIN_LOOP_MICRO_SECS );
+        sensors.process ();
+    }
+    CHECK_EQUAL ( 0, rig.pumpsOn () );
+    for ( int i = 0; i < 20; i++ )
+    {
+        rig.runFor ( RIG_MAIN_LOOP_MICRO_SECS );
+        sensors.process ();
+    }
+    CHECK_EQUAL ( RIG_PUMPS, rig.pumpsOn () );
+
+    CHECK ( rig.runUntilFinished ( orderId, 10 * SECOND ) );
+    CHECK_EQUAL ( OrderDone, rig.progress.of ( orderId ) );
+}
+
+int main ()
+{
+    firstReport ();
+    absentOnFirstEdge ();
+    presentAfterReturnSettle ();
+    pumpsPauseOnFirstEdge ();
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,181 @@
+#include "HostTest.h"
+#include "FlashImage.h"
+#include "KvStore.h"
+#include <vector>
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+// Small enough that the workload compacts a few times, both from
+// maintain () and from a put () that runs out of space
+#define IMAGE_SIZE      512
+#define REGION_ADDRESS  64
+#define REGION_SIZE     400
+#define KEYS            6
+#define STEPS           200
+
+typedef std::vector<uint8_t> Value;
+
+struct Expected
+{
+        Value committed [ KEYS ];   // empty for not set
+        int inFlightKey;            // put () the power was cut in, -1 for none
+        Value inFlight;
+};
+
+static Value valueAt ( const int step )
+{
+    if ( step % 7 == 6 )
+    {
+        return Value (); // every now and then a remove ()
+    }
+    Value value ( 1 + ( step * 13 ) % 20 );
+    for ( size_t i = 0; i < value.size (); i++ )
+    {
+        value [ i ] = ( uint8_t ) ( step + i );
+    }
+    return value;
+}
+
+/**
+ * Runs the workload until it is done or the power fails
+ * @return bytes written
+ */
+static unsigned int runWorkload ( FlashImage & image, Expected & expected )
+{
+    KvStore store ( &image, REGION_ADDRESS, REGION_SIZE );
+    expected.inFlightKey = -1;
+    if ( !store.mount () )
+    {
+        CHECK ( image.isPowerCut () ); // while formatting
+        return image.getBytesWritten ();
+    }
+
+    for ( int step = 0; ( step < STEPS ) && !image.isPowerCut (); step++ )
+    {
+        const int key = step % KEYS;
+        const Value value = valueAt ( step );
+        const bool stored = store.put ( key, value.empty () ? NULL : &value [ 0 ], value.size () );
+        if ( stored )
+        {
+            expected.committed [ key ] = value;
+        }
+        else if ( image.isPowerCut () )
+        {
+            expected.inFlightKey = key;
+            expected.inFlight = value;
+        }
+        else
+        {
+            CHECK ( stored );
+        }
+        store.maintain ();
+    }
+    return image.getBytesWritten ();
+}
+
+/**
+ * Every key holds its last committed value, or the value of the put () the
+ * power failed in, nothing else
+ */
+static bool recovered ( FlashImage & image, const Expected & expected )
+{
+    KvStore store ( &image, REGION_ADDRESS, REGION_SIZE );
+    if ( !store.mount () )
+    {
+        return false;
+    }
+
+    bool matches = true;
+    for ( int key = 0; key < KEYS; key++ )
+    {
+        uint8_t buffer [ KV_STORE_MAX_VALUE_LENGTH ];
+        const int length = store.get ( key, buffer, sizeof ( buffer ) );
+        const Value stored = ( length < 0 ) ? Value () : Value ( buffer, buffer + length );
+        const bool isCommitted = ( stored == expected.committed [ key ] );
+        const bool isInFlight = ( key == expected.inFlightKey ) && ( stored == expected.inFlight );
+        matches = matches && ( isCommitted || isInFlight );
+    }
+    for ( int key = KEYS; key < KV_STORE_MAX_KEYS; key++ )
+    {
+        matches = matches && !store.contains ( key );
+    }
+
+    // and the store carries on where it left off
+    const uint8_t next = 0x5A;
+    matches = matches && store.put ( 0, &next, 1 );
+    KvStore again ( &image, REGION_ADDRESS, REGION_SIZE );
+    uint8_t readBack = 0;
+    matches = matches && again.mount () && ( again.get ( 0, &readBack, 1 ) == 1 ) && ( readBack == next );
+    return matches;
+}
+
+static bool outsideRegionUntouched ( const FlashImage & image )
+{
+    bool untouched = true;
+    for ( unsigned int address = 0; address < IMAGE_SIZE; address++ )
+    {
+        if ( ( address < REGION_ADDRESS ) || ( address >= REGION_ADDRESS + REGION_SIZE ) )
+        {
+            uint8_t byte;
+            image.read ( address, &byte, 1 );
+            untouched = untouched && ( byte == 0xFF );
+        }
+    }
+    return untouched;
+}
+
+static void workloadWithoutPowerCut ()
+{
+    FlashImage image ( IMAGE_SIZE );
+    Expected expected;
+    runWorkload ( image, expected );
+    CHECK ( !image.isPowerCut () );
+    CHECK ( recovered ( image, expected ) );
+    CHECK ( outsideRegionUntouched ( image ) );
+
+    KvStore store ( &image, REGION_ADDRESS, REGION_SIZE );
+    CHECK ( store.mount () );
+    CHECK ( store.getGeneration () > 2 ); // the workload did compact
+}
+
+/**
+ * Cuts the power after every single byte the workload writes and mounts
+ * what is left
+ */
+static void powerCutAtEveryByte ()
+{
+    unsigned int total;
+    {
+        FlashImage image ( IMAGE_SIZE );
+        Expected expected;
+        total = runWorkload ( image, expected );
+    }
+
+    unsigned int failures = 0;
+    for ( unsigned int cut = 0; cut < total; cut++ )
+    {
+        FlashImage image ( IMAGE_SIZE );
+        Expected expected;
+        image.cutPowerAfter ( cut );
+        runWorkload ( image, expected );
+        CHECK ( image.isPowerCut () );
+        image.restorePower ();
+
+        if ( !recovered ( image, expected ) )
+        {
+            if ( failures++ < 5 )
+            {
+                fprintf ( stderr, "power cut after %u of %u bytes didn't recover\n", cut, total );
+            }
+        }
+        CHECK ( outsideRegionUntouched ( image ) );
+    }
+    CHECK_EQUAL ( 0, failures );
+}
+
+int main ()
+{
+    workloadWithoutPowerCut ();
+    powerCutAtEveryByte ();
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,214 @@
+#include "HostTest.h"
+#include "BarRig.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define SECOND      1000000ULL
+
+/**
+ * A move that doesn't reach the cup fails the order, nothing is poured
+ * wherever the head ended up
+ */
+static void failedMoveFailsTheOrder ()
+{
+    static const unsigned int positions [ 1 ] = { 3500 };
+    Sim::reset ();
+    BarRig rig ( 1, positions );
+
+    rig.rail.triggerEndAt ( 2500 ); // between the head and the cup, both times
+    const uint16_t failing = rig.order ( 2 );
+    CHECK ( rig.runUntilFinished ( failing, 10 * SECOND ) );
+    CHECK_EQUAL ( OrderFailed, rig.progress.of ( failing ) );
+    CHECK_EQUAL ( 0, rig.progress.counts [ OrderPouring ] );
+    CHECK_EQUAL ( 0, rig.pumps.getShiftCount () );
+    CHECK_EQUAL ( WaitingForOrder, rig.manager.getState () );
+
+    rig.rail.triggerEndAt ( -1 );
+    const uint16_t next = rig.order ( 2 );
+    CHECK ( rig.runUntilFinished ( next, 20 * SECOND ) );
+    CHECK_EQUAL ( OrderDone, rig.progress.of ( next ) );
+    CHECK_EQUAL ( 3500, rig.rail.getPosition () );
+}
+
+/**
+ * RoundRobin only takes cups that are present and waiting, with none of
+ * them the order stays queued
+ */
+static void roundRobinSkipsMissingCups ()
+{
+    static const unsigned int positions [ 3 ] = { 500, 1500, 2500 };
+    Sim::reset ();
+    BarRig rig ( 3, positions );
+    rig.manager.setCupSelectionPolicy ( RoundRobin );
+    rig.manager.cupPresenceChanged ( 0, true );
+    rig.manager.cupPresenceChanged ( 2, true );
+
+    const uint16_t first = rig.order ( 1 );
+    CHECK ( rig.runUntilFinished ( first, 10 * SECOND ) );
+    CHECK_EQUAL ( 500, rig.rail.getPosition () );
+
+    const uint16_t second = rig.order ( 1 );
+    CHECK ( rig.runUntilFinished ( second, 10 * SECOND ) );
+    CHECK_EQUAL ( 2500, rig.rail.getPosition () );
+
+    // Both present cups are served, nothing to pour into
+    const uint16_t third = rig.order ( 1 );
+    rig.runFor ( 3 * SECOND );
+    CHECK_EQUAL ( ORDER_PROGRESS_COUNT, rig.progress.of ( third ) );
+    CHECK_EQUAL ( 1, rig.queue.size () );
+
+    rig.manager.cupPresenceChanged ( 1, true );
+    CHECK ( rig.runUntilFinished ( third, 10 * SECOND ) );
+    CHECK_EQUAL ( OrderDone, rig.progress.of ( third ) );
+    CHECK_EQUAL ( 1500, rig.rail.getPosition () );
+}
+
+static void runUntilState ( BarRig & rig, const OrderManagerState state )
+{
+    for ( int i = 0; ( i < 20000 ) && ( rig.manager.getState () != state ); i++ )
+    {
+        rig.runFor ( RIG_MAIN_LOOP_MICRO_SECS );
+    }
+    CHECK_EQUAL ( state, rig.manager.getState () );
+}
+
+/**
+ * A cup taken away while the head moves to it isn't poured into, the
+ * order waits at the cup until it is back
+ */
+static void missingCupIsWaitedFor ()
+{
+    static const unsigned int positions [ 1 ] = { 3500 };
+    Sim::reset ();
+    BarRig rig ( 1, positions );
+    rig.manager.cupPresenceChanged ( 0, true );
+
+    const uint16_t waiting = rig.order ( 2 );
+    runUntilState ( rig, MovingToCup );
+    rig.manager.pinStateChanged ( NC, 0, false );
+    runUntilState ( rig, WaitingForCup );
+    rig.runFor ( 3 * SECOND );
+    CHECK_EQUAL ( WaitingForCup, rig.manager.getState () );
+    CHECK_EQUAL ( 3500, rig.rail.getPosition () );
+    CHECK_EQUAL ( 0, rig.pumps.getShiftCount () );
+    CHECK_EQUAL ( OrderDispatched, rig.progress.of ( waiting ) );
+
+    rig.manager.pinStateChanged ( NC, 0, true );
+    CHECK_EQUAL ( OrderPouring, rig.progress.of ( waiting ) );
+    CHECK_EQUAL ( RIG_PUMPS, rig.pumpsOn () );
+    CHECK ( rig.runUntilFinished ( waiting, 5 * SECOND ) );
+    CHECK_EQUAL ( OrderDone, rig.progress.of ( waiting ) );
+    CHECK_EQUAL ( 1, rig.progress.counts [ OrderPouring ] );
+
+}
+
+static void cancelWhileWaitingForCup ()
+{
+    static const unsigned int positions [ 1 ] = { 3500 };
+    Sim::reset ();
+    BarRig rig ( 1, positions );
+    rig.manager.cupPresenceChanged ( 0, true );
+
+    const uint16_t cancelled = rig.order ( 2 );
+    runUntilState ( rig, MovingToCup );
+    rig.manager.pinStateChanged ( NC, 0, false );
+    runUntilState ( rig, WaitingForCup );
+    CHECK ( rig.manager.cancelOrder ( cancelled ) );
+    CHECK ( !rig.manager.cancelOrder ( cancelled ) );
+    CHECK_EQUAL ( OrderCancelled, rig.progress.of ( cancelled ) );
+    CHECK_EQUAL ( WaitingForOrder, rig.manager.getState () );
+
+    rig.manager.pinStateChanged ( NC, 0, true );
+    rig.runFor ( 3 * SECOND );
+    CHECK_EQUAL ( 0, rig.pumps.getShiftCount () );
+    CHECK_EQUAL ( OrderCancelled, rig.progress.of ( cancelled ) );
+}
+
+/**
+ * CLEAR while the head is on its way stops the order from pouring once it
+ * arrives, it is reported as failed
+ */
+static void abortWhileMovingToCup ()
+{
+    static const unsigned int positions [ 1 ] = { 3500 };
+    Sim::reset ();
+    BarRig rig ( 1, positions );
+    rig.manager.cupPresenceChanged ( 0, true );
+
+    const uint16_t aborted = rig.order ( 2 );
+    runUntilState ( rig, MovingToCup );
+    rig.manager.abortPour ();
+    runUntilState ( rig, WaitingForOrder );
+    rig.runFor ( 3 * SECOND );
+    CHECK_EQUAL ( 0, rig.pumpsOn () );
+    CHECK_EQUAL ( 0, rig.progress.counts [ OrderPouring ] );
+    CHECK_EQUAL ( OrderFailed, rig.progress.of ( aborted ) );
+    CHECK ( !rig.manager.cancelOrder ( aborted ) );
+
+    // and the next order pours as usual
+    const uint16_t next = rig.order ( 1 );
+    CHECK ( rig.runUntilFinished ( next, 10 * SECOND ) );
+    CHECK_EQUAL ( OrderDone, rig.progress.of ( next ) );
+}
+
+class IgnoredEvents : public DeferredHandler
+{
+    public:
+        virtual void handleDeferred ( const int event, const uint32_t arg )
+        {
+        }
+};
+
+/**
+ * Arrival and pumps idle posted into a full DeferredQueue aren't lost,
+ * the next dispatch tick handles them
+ */
+static void fullDeferredQueueLosesNothing ()
+{
+    static const unsigned int positions [ 2 ] = { 1000, 3000 };
+    Sim::reset ();
+    BarRig rig ( 2, positions );
+    rig.manager.setOverlapMode ( true );
+    IgnoredEvents ignored;
+
+    const uint16_t first = rig.order ( 1 );
+    const uint16_t second = rig.order ( 1 );
+    runUntilState ( rig, MovingToCup );
+    while ( rig.deferred.post ( &ignored, 0 ) )
+    {
+    }
+    const unsigned int dropped = rig.deferred.getDroppedCount ();
+    for ( int i = 0; ( i < 20000 ) && rig.dispenser.isInMotion (); i++ )
+    {
+        Sim::advance ( RIG_MAIN_LOOP_MICRO_SECS ); // main loop stalled
+    }
+    CHECK ( rig.deferred.getDroppedCount () > dropped );
+    CHECK_EQUAL ( MovingToCup, rig.manager.getState () );
+    rig.runFor ( ORDER_MANAGER_DISPATCH_PERIOD_MICRO_SECS + 10 * RIG_MAIN_LOOP_MICRO_SECS );
+    CHECK_EQUAL ( OrderPouring, rig.progress.of ( first ) );
+    CHECK_EQUAL ( RIG_PUMPS, rig.pumpsOn () );
+
+    while ( rig.deferred.post ( &ignored, 0 ) )
+    {
+    }
+    for ( int i = 0; ( i < 20000 ) && ( rig.progress.of ( first ) != OrderDone ); i++ )
+    {
+        Sim::advance ( RIG_MAIN_LOOP_MICRO_SECS );
+    }
+    rig.runFor ( ORDER_MANAGER_DISPATCH_PERIOD_MICRO_SECS + 10 * RIG_MAIN_LOOP_MICRO_SECS );
+    CHECK_EQUAL ( MovingToCup, rig.manager.getState () );
+    CHECK ( rig.runUntilFinished ( second, 10 * SECOND ) );
+    CHECK_EQUAL ( OrderDone, rig.progress.of ( second ) );
+    CHECK_EQUAL ( 2, rig.progress.counts [ OrderPouring ] );
+}
+
+int main ()
+{
+    failedMoveFailsTheOrder ();
+    roundRobinSkipsMissingCups ();
+    missingCupIsWaitedFor ();
+    cancelWhileWaitingForCup ();
+    abortWhileMovingToCup ();
+    fullDeferredQueueLosesNothing ();
+    return HOST_TEST_RESULT ();
+}
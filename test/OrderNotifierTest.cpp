@@ -0,0 +1,160 @@
+#include "HostTest.h"
+#include "OrderNotifier.h"
+#include <string>
+#include <vector>
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+class SinkLog : public OrderNotificationSink
+{
+    public:
+        std::vector<std::string> messages;
+        std::vector<uint8_t> replyTos;
+        std::vector<uint64_t> sentAt;
+
+        virtual void sendNotification ( const uint8_t replyTo, const char * message )
+        {
+            messages.push_back ( message );
+            replyTos.push_back ( replyTo );
+            sentAt.push_back ( Sim::now () );
+        }
+};
+
+static OrderInfo order ( const uint16_t orderId, const uint8_t replyTo = 0 )
+{
+    OrderInfo info;
+    info.receivedAt = 0;
+    info.enqueuedAt = 0;
+    info.orderId = orderId;
+    info.replyTo = replyTo;
+    return info;
+}
+
+/**
+ * flush () called on every pass of a 1 ms main loop still sends no more
+ * than one notification per ORDER_NOTIFIER_INTERVAL_US, oldest first
+ */
+static void rateLimited ()
+{
+    Sim::reset ();
+    Sim::advance ( 1000000 );
+    SinkLog sink;
+    OrderNotifier notifier;
+    CHECK ( !notifier.flush () ); // no sink yet
+    notifier.setSink ( &sink );
+    CHECK ( !notifier.flush () ); // nothing pending
+
+    for ( uint16_t id = 1; id <= 5; id++ )
+    {
+        notifier.orderProgress ( order ( id, id % 2 ), OrderDispatched );
+    }
+    CHECK_EQUAL ( 5, notifier.getPendingCount () );
+
+    for ( unsigned int pass = 0; pass < 5 * ORDER_NOTIFIER_INTERVAL_US / 1000; pass++ )
+    {
+        notifier.flush ();
+        Sim::advance ( 1000 );
+    }
+    CHECK_EQUAL ( 5, sink.messages.size () );
+    CHECK_EQUAL ( 5, notifier.getSentCount () );
+    CHECK_EQUAL ( 0, notifier.getPendingCount () );
+    for ( size_t i = 1; i < sink.sentAt.size (); i++ )
+    {
+        CHECK ( sink.sentAt [ i ] - sink.sentAt [ i - 1 ] >= ORDER_NOTIFIER_INTERVAL_US );
+    }
+    CHECK ( sink.messages [ 0 ] == "{\"order\":1,\"event\":\"DISPATCHED\"}" );
+    CHECK ( sink.messages [ 4 ] == "{\"order\":5,\"event\":\"DISPATCHED\"}" );
+    CHECK_EQUAL ( 1, sink.replyTos [ 0 ] );
+    CHECK_EQUAL ( 0, sink.replyTos [ 1 ] );
+
+    // Quiet for longer than the interval, the next one goes out at once
+    Sim::advance ( ORDER_NOTIFIER_INTERVAL_US );
+    notifier.orderProgress ( order ( 6 ), OrderPouring );
+    CHECK ( notifier.flush () );
+    notifier.orderProgress ( order ( 7 ), OrderPouring );
+    CHECK ( !notifier.flush () );
+    Sim::advance ( ORDER_NOTIFIER_INTERVAL_US - 1 );
+    CHECK ( !notifier.flush () );
+    Sim::advance ( 1 );
+    CHECK ( notifier.flush () );
+}
+
+/**
+ * Events for an order still pending replace its state in place, it keeps
+ * its slot and only the newest state goes out
+ */
+static void eventsCollapse ()
+{
+    Sim::reset ();
+    SinkLog sink;
+    OrderNotifier notifier;
+    notifier.setSink ( &sink );
+
+    notifier.orderProgress ( order ( 3 ), OrderDispatched );
+    notifier.orderProgress ( order ( 4 ), OrderDispatched );
+    notifier.orderProgress ( order ( 3 ), OrderPouring );
+    notifier.orderProgress ( order ( 3 ), OrderDone );
+    CHECK_EQUAL ( 2, notifier.getPendingCount () );
+
+    CHECK ( notifier.flush () );
+    Sim::advance ( ORDER_NOTIFIER_INTERVAL_US );
+    CHECK ( notifier.flush () );
+    Sim::advance ( ORDER_NOTIFIER_INTERVAL_US );
+    CHECK ( !notifier.flush () );
+    CHECK_EQUAL ( 2, sink.messages.size () );
+    CHECK ( sink.messages [ 0 ] == "{\"order\":3,\"event\":\"DONE\"}" );
+    CHECK ( sink.messages [ 1 ] == "{\"order\":4,\"event\":\"DISPATCHED\"}" );
+
+    // Once sent, the next event of the order is a notification of its own
+    notifier.orderProgress ( order ( 4 ), OrderFailed );
+    CHECK ( notifier.flush () );
+    CHECK ( sink.messages [ 2 ] == "{\"order\":4,\"event\":\"FAILED\"}" );
+    CHECK_EQUAL ( 0, notifier.getDroppedCount () );
+}
+
+/**
+ * With ORDER_NOTIFIER_CAPACITY orders waiting, a new order's event is
+ * dropped and counted, those of waiting orders still collapse
+ */
+static void overflowIsCounted ()
+{
+    Sim::reset ();
+    SinkLog sink;
+    OrderNotifier notifier;
+    notifier.setSink ( &sink );
+
+    for ( uint16_t id = 1; id <= ORDER_NOTIFIER_CAPACITY; id++ )
+    {
+        notifier.orderProgress ( order ( id ), OrderDispatched );
+    }
+    CHECK_EQUAL ( 0, notifier.getDroppedCount () );
+    notifier.orderProgress ( order ( ORDER_NOTIFIER_CAPACITY + 1 ), OrderDispatched );
+    notifier.orderProgress ( order ( ORDER_NOTIFIER_CAPACITY + 2 ), OrderCancelled );
+    CHECK_EQUAL ( 2, notifier.getDroppedCount () );
+    notifier.orderProgress ( order ( 1 ), OrderDone );
+    CHECK_EQUAL ( 2, notifier.getDroppedCount () );
+    CHECK_EQUAL ( ORDER_NOTIFIER_CAPACITY, notifier.getPendingCount () );
+
+    // A flush frees a slot
+    CHECK ( notifier.flush () );
+    CHECK ( sink.messages [ 0 ] == "{\"order\":1,\"event\":\"DONE\"}" );
+    notifier.orderProgress ( order ( ORDER_NOTIFIER_CAPACITY + 3 ), OrderDispatched );
+    CHECK_EQUAL ( 2, notifier.getDroppedCount () );
+    CHECK_EQUAL ( ORDER_NOTIFIER_CAPACITY, notifier.getPendingCount () );
+}
+
+static void progressNames ()
+{
+    CHECK ( std::string ( OrderNotifier::progressName ( OrderPaused ) ) == "PAUSED" );
+    CHECK ( std::string ( OrderNotifier::progressName ( OrderCancelled ) ) == "CANCELLED" );
+    CHECK ( std::string ( OrderNotifier::progressName ( ORDER_PROGRESS_COUNT ) ) == "?" );
+}
+
+int main ()
+{
+    rateLimited ();
+    eventsCollapse ();
+    overflowIsCounted ();
+    progressNames ();
+    return HOST_TEST_RESULT ();
+}
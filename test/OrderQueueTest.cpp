@@ -0,0 +1,103 @@
+#include "HostTest.h"
+#include "OrderQueue.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define CAPACITY    4
+#define PUMPS       5
+
+static void fill ( unsigned int * durations, const unsigned int seed )
+{
+    for ( unsigned int i = 0; i < PUMPS; i++ )
+    {
+        durations [ i ] = seed * 10 + i;
+    }
+}
+
+static bool holds ( const unsigned int * durations, const unsigned int seed )
+{
+    for ( unsigned int i = 0; i < PUMPS; i++ )
+    {
+        if ( durations [ i ] != seed * 10 + i )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Same checks for the heap backed queue and StaticOrderQueue, which
+ * copies orders with its own fixed bound loop
+ */
+static void exercise ( OrderQueue & queue )
+{
+    unsigned int durations [ PUMPS ];
+    OrderInfo info;
+
+    CHECK ( queue.isEmpty () );
+    CHECK_EQUAL ( CAPACITY, queue.getCapacity () );
+
+    // FIFO over several wraps of the ring
+    for ( unsigned int seed = 1; seed <= 3 * CAPACITY; seed++ )
+    {
+        fill ( durations, seed );
+        CHECK_EQUAL ( 1, queue.addOrder ( durations ) );
+        fill ( durations, 0 );
+        CHECK ( queue.hasOrder () );
+        CHECK_EQUAL ( 0, queue.removeOrder ( durations ) );
+        CHECK ( holds ( durations, seed ) );
+    }
+
+    // Full is full, every slot keeps its own order
+    uint16_t ids [ CAPACITY ];
+    for ( unsigned int seed = 0; seed < CAPACITY; seed++ )
+    {
+        fill ( durations, seed );
+        CHECK_EQUAL ( seed + 1, queue.addOrder ( durations, &info ) );
+        ids [ seed ] = info.orderId;
+        CHECK ( info.orderId != 0 );
+    }
+    CHECK ( queue.isFull () );
+    CHECK_EQUAL ( -1, queue.addOrder ( durations ) );
+
+    // Amend the second, cancel the third
+    fill ( durations, 7 );
+    CHECK ( queue.amendOrder ( ids [ 1 ], durations ) );
+    CHECK ( queue.cancelOrder ( ids [ 2 ] ) );
+    CHECK ( !queue.cancelOrder ( ids [ 2 ] ) );
+    CHECK ( !queue.amendOrder ( ids [ 2 ], durations ) );
+
+    queue.removeOrder ( durations );
+    CHECK ( holds ( durations, 0 ) );
+    queue.removeOrder ( durations );
+    CHECK ( holds ( durations, 7 ) );
+    queue.removeOrder ( durations ); // skips the cancelled one
+    CHECK ( holds ( durations, 3 ) );
+    CHECK ( !queue.hasOrder () );
+    CHECK ( queue.isEmpty () );
+
+    // A reused slot gets a new id, the old one no longer matches
+    fill ( durations, 9 );
+    queue.addOrder ( durations, &info );
+    for ( unsigned int i = 0; i < CAPACITY; i++ )
+    {
+        CHECK ( info.orderId != ids [ i ] );
+        CHECK ( !queue.cancelOrder ( ids [ i ] ) );
+    }
+    CHECK ( queue.cancelOrder ( info.orderId ) );
+    CHECK ( !queue.hasOrder () );
+}
+
+int main ()
+{
+    Sim::reset ();
+
+    OrderQueue heapQueue ( CAPACITY, PUMPS );
+    exercise ( heapQueue );
+
+    StaticOrderQueue<CAPACITY, PUMPS> staticQueue;
+    exercise ( staticQueue );
+
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,89 @@
+#include "HostTest.h"
+#include "FlashImage.h"
+#include "RecipeBook.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define PUMPS       12
+#define IMAGE_SIZE  1024
+
+/**
+ * A plan that is rejected or can't be written leaves the stored recipe
+ * alone, in RAM and after a reboot
+ */
+static void failedStoreKeepsThePreviousRecipe ()
+{
+    FlashImage image ( IMAGE_SIZE );
+    KvStore store ( &image, 0, IMAGE_SIZE );
+    CHECK ( store.mount () );
+    RecipeBook book ( &store );
+
+    unsigned int plan [ PUMPS ] = { 0 };
+    plan [ 1 ] = 40;
+    plan [ 2 ] = 60;
+    CHECK_EQUAL ( RecipeStored, book.store ( 3, plan, PUMPS ) );
+    CHECK_EQUAL ( RecipeInvalidId, book.store ( RECIPE_BOOK_SIZE, plan, PUMPS ) );
+
+    unsigned int tooMany [ PUMPS ];
+    for ( int pump = 0; pump < PUMPS; pump++ )
+    {
+        tooMany [ pump ] = 10;
+    }
+    CHECK_EQUAL ( RecipeTooManySteps, book.store ( 3, tooMany, PUMPS ) );
+
+    unsigned int other [ PUMPS ] = { 0 };
+    other [ 5 ] = 90;
+    image.cutPowerAfter ( 0 );
+    CHECK_EQUAL ( RecipeNotPersisted, book.store ( 3, other, PUMPS ) );
+    image.restorePower ();
+
+    unsigned int expanded [ PUMPS ];
+    CHECK ( book.expand ( 3, expanded, PUMPS ) );
+    CHECK_EQUAL ( 40, expanded [ 1 ] );
+    CHECK_EQUAL ( 60, expanded [ 2 ] );
+    CHECK_EQUAL ( 0, expanded [ 5 ] );
+
+    KvStore rebooted ( &image, 0, IMAGE_SIZE );
+    CHECK ( rebooted.mount () );
+    RecipeBook reloaded ( &rebooted );
+    CHECK_EQUAL ( 1, reloaded.load () );
+    CHECK ( reloaded.expand ( 3, expanded, PUMPS ) );
+    CHECK_EQUAL ( 40, expanded [ 1 ] );
+    CHECK_EQUAL ( 60, expanded [ 2 ] );
+    CHECK_EQUAL ( 0, expanded [ 5 ] );
+
+    CHECK_EQUAL ( RecipeStored, reloaded.store ( 3, other, PUMPS ) );
+    CHECK ( reloaded.expand ( 3, expanded, PUMPS ) );
+    CHECK_EQUAL ( 90, expanded [ 5 ] );
+}
+
+/**
+ * Removing a recipe that can't be persisted keeps it defined
+ */
+static void failedRemoveKeepsTheRecipe ()
+{
+    FlashImage image ( IMAGE_SIZE );
+    KvStore store ( &image, 0, IMAGE_SIZE );
+    CHECK ( store.mount () );
+    RecipeBook book ( &store );
+
+    unsigned int plan [ PUMPS ] = { 0 };
+    plan [ 0 ] = 25;
+    CHECK_EQUAL ( RecipeStored, book.store ( 7, plan, PUMPS ) );
+
+    const unsigned int nothing [ PUMPS ] = { 0 };
+    image.cutPowerAfter ( 0 );
+    CHECK_EQUAL ( RecipeNotPersisted, book.store ( 7, nothing, PUMPS ) );
+    image.restorePower ();
+    CHECK ( book.isDefined ( 7 ) );
+
+    CHECK_EQUAL ( RecipeStored, book.store ( 7, nothing, PUMPS ) );
+    CHECK ( !book.isDefined ( 7 ) );
+}
+
+int main ()
+{
+    failedStoreKeepsThePreviousRecipe ();
+    failedRemoveKeepsTheRecipe ();
+    return HOST_TEST_RESULT ();
+}
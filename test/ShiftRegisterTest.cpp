@@ -0,0 +1,152 @@
+#include "HostTest.h"
+#include "ShiftRegisterChain.h"
+#include "PumpControl.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+/**
+ * PumpControl driving a simulated 74HC595 chain, built once per output
+ * path: bit-banged, SHIFT_REGISTER_USE_SPI and SHIFT_REGISTER_PARALLEL_CHAINS.
+ * What the chain latches must be exactly the pumps with time left.
+ */
+#ifdef SHIFT_REGISTER_PARALLEL_CHAINS
+#define PUMP_COUNT          22 // the last chain has two pad stages
+#define CHAIN_COUNT         SHIFT_REGISTER_PARALLEL_CHAINS
+#else
+#define PUMP_COUNT          20 // the SPI path pads to 24 bits
+#define CHAIN_COUNT         1
+#endif
+#define CHAIN_LENGTH        ( ( PUMP_COUNT + CHAIN_COUNT - 1 ) / CHAIN_COUNT )
+
+#define DATA_PIN            D11
+#define LATCH_PIN           D10
+#define CLOCK_PIN           D13
+#define ENABLE_PIN          D9
+#define RESET_PIN           D8
+
+#define SECOND              1000000
+
+class IdleCounter : public PumpControlListener
+{
+    public:
+        int count;
+
+        IdleCounter ()
+                : count ( 0 )
+        {
+        }
+
+        virtual void pumpsIdle ()
+        {
+            count++;
+        }
+};
+
+static bool outputsMatch ( const ShiftRegisterChain & chain, const unsigned int * remaining )
+{
+    for ( unsigned int i = 0; i < PUMP_COUNT; i++ )
+    {
+        // Pump i sits on chain i / CHAIN_LENGTH, stage i % CHAIN_LENGTH
+        if ( chain.output ( i ) != ( remaining [ i ] > 0 ) )
+        {
+            fprintf ( stderr, "pump %u is %d, expected %d\n", i, chain.output ( i ), remaining [ i ] > 0 );
+            return false;
+        }
+    }
+    return true;
+}
+
+static void tick ( unsigned int * remaining )
+{
+    Sim::advance ( SECOND );
+    for ( unsigned int i = 0; i < PUMP_COUNT; i++ )
+    {
+        remaining [ i ] -= ( remaining [ i ] > 0 ) ? 1 : 0;
+    }
+}
+
+int main ()
+{
+    Sim::reset ();
+    ShiftRegisterChain chain ( CHAIN_LENGTH, CLOCK_PIN, LATCH_PIN, ENABLE_PIN, RESET_PIN, CHAIN_COUNT );
+#if defined ( SHIFT_REGISTER_USE_SPI )
+    chain.connectSpi ();
+    StaticPumpControl<PUMP_COUNT> pumps ( DATA_PIN, LATCH_PIN, CLOCK_PIN, ENABLE_PIN, RESET_PIN );
+#elif defined ( SHIFT_REGISTER_PARALLEL_CHAINS )
+    static const uint8_t dataPortBits [ CHAIN_COUNT ] = { 0, 1, 16, 31 }; // up to the top bit of the port
+    chain.connectDataPort ( dataPortBits );
+    StaticPumpControl<PUMP_COUNT> pumps ( PortC, dataPortBits, LATCH_PIN, CLOCK_PIN, ENABLE_PIN, RESET_PIN );
+#else
+    chain.connectDataPin ( DATA_PIN );
+    StaticPumpControl<PUMP_COUNT> pumps ( DATA_PIN, LATCH_PIN, CLOCK_PIN, ENABLE_PIN, RESET_PIN );
+#endif
+    IdleCounter idle;
+    pumps.setListener ( &idle );
+
+    // Reset leaves every output LOW and enabled
+    CHECK ( chain.isOutputEnabled () );
+    CHECK_EQUAL ( 0, chain.outputsHigh () );
+    CHECK_EQUAL ( Idle, pumps.getState () );
+
+    // A pour latches exactly the pumps with time left, they drop out one
+    // timer tick ( second ) at a time
+    unsigned int durations [ PUMP_COUNT ];
+    unsigned int remaining [ PUMP_COUNT ];
+    unsigned int longest = 0;
+    for ( unsigned int i = 0; i < PUMP_COUNT; i++ )
+    {
+        durations [ i ] = ( i * 7 ) % 5;
+        remaining [ i ] = durations [ i ];
+        longest = ( durations [ i ] > longest ) ? durations [ i ] : longest;
+    }
+
+    Sim::advance ( SECOND / 2 );
+    CHECK ( pumps.runPumpsFor ( durations ) );
+    CHECK_EQUAL ( Executing, pumps.getState () );
+    CHECK ( outputsMatch ( chain, remaining ) );
+    CHECK ( !pumps.runPumpsFor ( durations ) ); // one pour at a time
+    CHECK_EQUAL ( longest, pumps.getRemainingTime () );
+
+    tick ( remaining );
+    CHECK ( outputsMatch ( chain, remaining ) );
+
+    // Paused the outputs are off and the countdown stands still
+    pumps.pausePumps ();
+    CHECK_EQUAL ( Paused, pumps.getState () );
+    CHECK ( !chain.isOutputEnabled () );
+    CHECK_EQUAL ( 0, chain.outputsHigh () );
+    Sim::advance ( 3 * SECOND );
+    CHECK_EQUAL ( longest - 1, pumps.getRemainingTime () );
+
+    pumps.resumePumps ();
+    CHECK ( chain.isOutputEnabled () );
+    CHECK ( outputsMatch ( chain, remaining ) );
+
+    const unsigned int latches = chain.getLatchCount ();
+    for ( unsigned int t = 1; t < longest; t++ )
+    {
+        tick ( remaining );
+        CHECK ( outputsMatch ( chain, remaining ) );
+    }
+    CHECK_EQUAL ( 0, chain.outputsHigh () );
+    CHECK_EQUAL ( Idle, pumps.getState () );
+    CHECK_EQUAL ( 1, idle.count );
+    CHECK_EQUAL ( longest - 1, chain.getLatchCount () - latches );
+
+    // Idle ticks don't touch the chain
+    Sim::advance ( 5 * SECOND );
+    CHECK_EQUAL ( longest - 1, chain.getLatchCount () - latches );
+
+    // Cancelling switches everything off and still reports the pour idle
+    CHECK ( pumps.runPumpsFor ( durations ) );
+    CHECK ( chain.outputsHigh () > 0 );
+    pumps.pausePumps ();
+    CHECK ( pumps.cancelPumps () );
+    CHECK ( chain.isOutputEnabled () );
+    CHECK_EQUAL ( 0, chain.outputsHigh () );
+    CHECK_EQUAL ( Idle, pumps.getState () );
+    CHECK_EQUAL ( 2, idle.count );
+    CHECK ( !pumps.cancelPumps () );
+
+    return HOST_TEST_RESULT ();
+}
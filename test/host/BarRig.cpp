@@ -0,0 +1,75 @@
+#include "BarRig.h"
+
+ProgressLog::ProgressLog ()
+{
+    for ( int i = 0; i < ORDER_PROGRESS_COUNT; i++ )
+    {
+        counts [ i ] = 0;
+    }
+}
+
+void ProgressLog::orderProgress ( const OrderInfo & order, const OrderProgress progress )
+{
+    last [ order.orderId ] = progress;
+    counts [ progress ]++;
+}
+
+OrderProgress ProgressLog::of ( const uint16_t orderId ) const
+{
+    std::map<uint16_t, OrderProgress>::const_iterator found = last.find ( orderId );
+    return ( found != last.end () ) ? found->second : ORDER_PROGRESS_COUNT;
+}
+
+BarRig::BarRig ( const int cupCount, const unsigned int * cupPositions )
+        : chain ( RIG_PUMPS, RIG_CLOCK_PIN, RIG_LATCH_PIN, RIG_ENABLE_PIN, RIG_RESET_PIN ), rail ( RIG_HOME_PIN, RIG_END_PIN, RIG_STEP_PIN, RIG_DIR_PIN, RIG_RAIL_LENGTH, RIG_RAIL_LENGTH / 3 ), pumps (
+                RIG_DATA_PIN, RIG_LATCH_PIN, RIG_CLOCK_PIN, RIG_ENABLE_PIN, RIG_RESET_PIN ), dispenser ( RIG_HOME_PIN, RIG_END_PIN, RIG_STEP_PIN, RIG_DIR_PIN ), manager ( cupCount, RIG_PUMPS, &queue, &pumps,
+                &dispenser )
+{
+    chain.connectDataPin ( RIG_DATA_PIN );
+    manager.setCupPositions ( cupPositions );
+    manager.setDeferredQueue ( &deferred );
+    manager.setProgressListener ( &progress );
+}
+
+uint16_t BarRig::order ( const unsigned int seconds )
+{
+    unsigned int durations [ RIG_PUMPS ];
+    for ( unsigned int i = 0; i < RIG_PUMPS; i++ )
+    {
+        durations [ i ] = seconds;
+    }
+    OrderInfo info;
+    info.receivedAt = us_ticker_read ();
+    info.replyTo = 0;
+    return ( queue.addOrder ( durations, &info ) < 0 ) ? 0 : info.orderId;
+}
+
+void BarRig::runFor ( const uint64_t microSeconds )
+{
+    const uint64_t end = Sim::now () + microSeconds;
+    while ( Sim::now () < end )
+    {
+        Sim::advance ( RIG_MAIN_LOOP_MICRO_SECS );
+        deferred.dispatch ();
+    }
+}
+
+bool BarRig::runUntilFinished ( const uint16_t orderId, const uint64_t limit )
+{
+    const uint64_t end = Sim::now () + limit;
+    while ( Sim::now () < end )
+    {
+        const OrderProgress state = progress.of ( orderId );
+        if ( ( state == OrderDone ) || ( state == OrderFailed ) || ( state == OrderCancelled ) )
+        {
+            return true;
+        }
+        runFor ( RIG_MAIN_LOOP_MICRO_SECS );
+    }
+    return false;
+}
+
+unsigned int BarRig::pumpsOn () const
+{
+    return chain.outputsHigh ();
+}
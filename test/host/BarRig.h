@@ -0,0 +1,84 @@
+#ifndef BARVIS_HOST_BAR_RIG_H_
+#define BARVIS_HOST_BAR_RIG_H_
+
+#include "ShiftRegisterChain.h"
+#include "DispenserRail.h"
+#include "OrderManager.h"
+#include <map>
+
+#define RIG_PUMPS           8
+#define RIG_QUEUE_DEPTH     8
+#define RIG_RAIL_LENGTH     4000
+#define RIG_MAIN_LOOP_MICRO_SECS    1000
+
+#define RIG_DATA_PIN        D11
+#define RIG_LATCH_PIN       D10
+#define RIG_CLOCK_PIN       D13
+#define RIG_ENABLE_PIN      D9
+#define RIG_RESET_PIN       D8
+#define RIG_HOME_PIN        D20
+#define RIG_END_PIN         D21
+#define RIG_STEP_PIN        D22
+#define RIG_DIR_PIN         D23
+
+/**
+ * Progress of every order as OrderManager reported it
+ */
+class ProgressLog : public OrderProgressListener
+{
+    public:
+        std::map<uint16_t, OrderProgress> last;
+        unsigned int counts [ ORDER_PROGRESS_COUNT ];
+
+        ProgressLog ();
+
+        virtual void orderProgress ( const OrderInfo & order, const OrderProgress progress );
+
+        OrderProgress of ( const uint16_t orderId ) const;
+};
+
+/**
+ * The real order path on the simulated board: OrderQueue, OrderManager
+ * with its DeferredQueue, PumpControl on a 74HC595 chain and
+ * DispenserControl on a rail, wired like main.cpp wires them.  runFor
+ * stands in for the main loop, it dispatches deferred work every
+ * RIG_MAIN_LOOP_MICRO_SECS of simulated time.
+ *
+ * Call Sim::reset () before building one, the calibration runs in the
+ * constructor.
+ */
+class BarRig
+{
+    public:
+        ShiftRegisterChain chain;
+        DispenserRail rail;
+        StaticPumpControl<RIG_PUMPS> pumps;
+        DispenserControl dispenser;
+        StaticOrderQueue<RIG_QUEUE_DEPTH, RIG_PUMPS> queue;
+        DeferredQueue deferred;
+        OrderManager manager;
+        ProgressLog progress;
+
+        BarRig ( const int cupCount, const unsigned int * cupPositions = NULL );
+
+        /**
+         * Queues an order running every pump for seconds
+         * @return its orderId, 0 if the queue is full
+         */
+        uint16_t order ( const unsigned int seconds );
+
+        void runFor ( const uint64_t microSeconds );
+
+        /**
+         * Runs the main loop until orderId is done, failed or cancelled
+         * @return false if that didn't happen within limit
+         */
+        bool runUntilFinished ( const uint16_t orderId, const uint64_t limit );
+
+        /**
+         * Pumps on the chain that are on right now
+         */
+        unsigned int pumpsOn () const;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "DispenserRail.h"
+
+DispenserRail::DispenserRail ( const PinName _homePin, const PinName _endPin, const PinName stepPin, const PinName dirPin, const int _length, const int startPosition )
+        : homePin ( _homePin ), endPin ( _endPin ), length ( _length )
+{
+    position = startPosition;
+    direction = 0;
+    stepLevel = 0;
+    stepCount = 0;
+    stepsToLose = 0;
+    spuriousHomeAt = -1;
+    spuriousEndAt = -1;
+
+    Sim::onPinWrite ( dirPin, [this] ( const int level )
+    {
+        direction = level;
+    } );
+    Sim::onPinWrite ( stepPin, [this] ( const int level )
+    {
+        if ( level && !stepLevel )
+        {
+            stepCount++;
+            if ( stepsToLose > 0 )
+            {
+                stepsToLose--;
+            }
+            else if ( direction && ( position < length ) )
+            {
+                position++;
+            }
+            else if ( !direction && ( position > 0 ) )
+            {
+                position--;
+            }
+            updateSwitches ();
+        }
+        stepLevel = level;
+    } );
+    updateSwitches ();
+}
+
+void DispenserRail::updateSwitches ()
+{
+    Sim::setPin ( homePin, ( position == 0 ) || ( position == spuriousHomeAt ) );
+    Sim::setPin ( endPin, ( position == length ) || ( position == spuriousEndAt ) );
+}
+
+void DispenserRail::pushHeadTo ( const int _position )
+{
+    position = _position;
+    updateSwitches ();
+}
+
+void DispenserRail::loseSteps ( const unsigned int steps )
+{
+    stepsToLose = steps;
+}
+
+void DispenserRail::triggerHomeAt ( const int _position )
+{
+    spuriousHomeAt = _position;
+    updateSwitches ();
+}
+
+void DispenserRail::triggerEndAt ( const int _position )
+{
+    spuriousEndAt = _position;
+    updateSwitches ();
+}
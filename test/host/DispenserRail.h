@@ -0,0 +1,64 @@
+#ifndef BARVIS_HOST_DISPENSER_RAIL_H_
+#define BARVIS_HOST_DISPENSER_RAIL_H_
+
+#include "mbed.h"
+
+/**
+ * The dispenser head on its rail, as seen through the pins
+ * DispenserControl uses.  Every rising edge on the step pin moves the head
+ * one step, towards the end switch while the direction pin is HIGH.  The
+ * home switch reads HIGH at position 0, the end switch at the far end of
+ * the rail, the head can't go past either.
+ *
+ * Faults to inject: the head pushed by hand ( pushHeadTo ), steps the
+ * motor loses ( loseSteps ) and a switch that triggers where it shouldn't
+ * ( triggerHomeAt / triggerEndAt ).
+ */
+class DispenserRail
+{
+    private:
+        const PinName homePin;
+        const PinName endPin;
+        const int length;
+        int position;
+        int direction;
+        int stepLevel;
+        unsigned int stepCount;
+        unsigned int stepsToLose;
+        int spuriousHomeAt;
+        int spuriousEndAt;
+
+        void updateSwitches ();
+
+    public:
+        DispenserRail ( const PinName _homePin, const PinName _endPin, const PinName stepPin, const PinName dirPin, const int _length, const int startPosition );
+
+        void pushHeadTo ( const int _position );
+        void loseSteps ( const unsigned int steps );
+
+        /**
+         * The switch also reads HIGH with the head at position, -1 clears
+         */
+        void triggerHomeAt ( const int _position );
+        void triggerEndAt ( const int _position );
+
+        inline int getPosition () const
+        {
+            return position;
+        }
+
+        inline int getLength () const
+        {
+            return length;
+        }
+
+        /**
+         * Step pulses seen, lost ones and ones against a stop included
+         */
+        inline unsigned int getStepCount () const
+        {
+            return stepCount;
+        }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "FlashImage.h"
+
+FlashImage::FlashImage ( const unsigned int size, const std::string & _path )
+        : bytes ( size, 0xFF ), path ( _path ), bytesWritten ( 0 )
+{
+    powerCutArmed = false;
+    powerBudget = 0;
+    powerCut = false;
+    if ( !path.empty () )
+    {
+        FILE * file = fopen ( path.c_str (), "rb" );
+        if ( file != NULL )
+        {
+            size_t loaded = fread ( &bytes [ 0 ], 1, bytes.size (), file );
+            (void) loaded; // a short file leaves the rest erased
+            fclose ( file );
+        }
+    }
+}
+
+FlashImage::~FlashImage ()
+{
+}
+
+void FlashImage::flush () const
+{
+    if ( path.empty () )
+    {
+        return;
+    }
+    FILE * file = fopen ( path.c_str (), "wb" );
+    if ( file != NULL )
+    {
+        fwrite ( &bytes [ 0 ], 1, bytes.size (), file );
+        fclose ( file );
+    }
+}
+
+bool FlashImage::read ( const unsigned int address, void * data, const unsigned int length ) const
+{
+    if ( ( address > bytes.size () ) || ( length > ( bytes.size () - address ) ) )
+    {
+        return false;
+    }
+    memcpy ( data, &bytes [ address ], length );
+    return true;
+}
+
+bool FlashImage::write ( const unsigned int address, const void * data, const unsigned int length )
+{
+    if ( ( address > bytes.size () ) || ( length > ( bytes.size () - address ) ) )
+    {
+        return false;
+    }
+    if ( powerCut )
+    {
+        return false;
+    }
+
+    unsigned int count = length;
+    if ( powerCutArmed && ( length > powerBudget ) )
+    {
+        count = powerBudget;
+        powerCut = true;
+    }
+    powerBudget -= powerCutArmed ? count : 0;
+
+    memcpy ( &bytes [ address ], data, count );
+    bytesWritten += count;
+    flush ();
+    return !powerCut;
+}
+
+unsigned int FlashImage::getSize () const
+{
+    return bytes.size ();
+}
+
+void FlashImage::erase ()
+{
+    bytes.assign ( bytes.size (), 0xFF );
+    flush ();
+}
+
+void FlashImage::cutPowerAfter ( const unsigned int bytes )
+{
+    powerCutArmed = true;
+    powerBudget = bytes;
+    powerCut = false;
+}
+
+void FlashImage::restorePower ()
+{
+    powerCutArmed = false;
+    powerCut = false;
+}
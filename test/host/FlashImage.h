@@ -0,0 +1,61 @@
+#ifndef BARVIS_HOST_FLASH_IMAGE_H_
+#define BARVIS_HOST_FLASH_IMAGE_H_
+
+#include "Eeprom.h"
+#include <vector>
+#include <string>
+
+/**
+ * NonVolatileStorage in host memory, optionally backed by a file so the
+ * contents outlive the objects using them like the Teensy's EEPROM
+ * outlives a reboot.  Erased bytes read 0xFF.
+ */
+class FlashImage : public NonVolatileStorage
+{
+    private:
+        std::vector<uint8_t> bytes;
+        const std::string path;
+        unsigned int bytesWritten;
+        bool powerCutArmed;
+        unsigned int powerBudget; // bytes still written before the cut
+        bool powerCut;
+
+        FlashImage ( const FlashImage &other );
+
+        void flush () const;
+
+    public:
+        /**
+         * @param _path file the image is loaded from ( if it exists ) and
+         * saved to after every write, empty for memory only
+         */
+        FlashImage ( const unsigned int size, const std::string & _path = std::string () );
+        virtual ~FlashImage ();
+
+        virtual bool read ( const unsigned int address, void * data, const unsigned int length ) const;
+        virtual bool write ( const unsigned int address, const void * data, const unsigned int length );
+        virtual unsigned int getSize () const;
+
+        void erase ();
+
+        /**
+         * Power fails once bytes more bytes are written: the write that
+         * crosses the budget only stores its first bytes, in order like the
+         * EEPROM commits them, and it and every later write return false
+         * without storing anything until restorePower ()
+         */
+        void cutPowerAfter ( const unsigned int bytes );
+        void restorePower ();
+
+        inline bool isPowerCut () const
+        {
+            return powerCut;
+        }
+
+        inline unsigned int getBytesWritten () const
+        {
+            return bytesWritten;
+        }
+};
+
+#endif
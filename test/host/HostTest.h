@@ -0,0 +1,41 @@
+#ifndef BARVIS_HOST_TEST_H_
+#define BARVIS_HOST_TEST_H_
+
+#include <stdio.h>
+
+/**
+ * Just enough of a test framework for the host tests: CHECK reports a
+ * failed condition and carries on, the test's main returns
+ * HOST_TEST_RESULT () so ctest sees the failure.
+ */
+extern int hostTestFailures;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if ( !( condition ) ) \
+        { \
+            fprintf ( stderr, "%s:%d: CHECK ( %s ) failed\n", __FILE__, __LINE__, #condition ); \
+            hostTestFailures++; \
+        } \
+    } while ( 0 )
+
+#define CHECK_EQUAL(expected, actual) \
+    do \
+    { \
+        const long long expectedValue = (long long) ( expected ); \
+        const long long actualValue = (long long) ( actual ); \
+        if ( expectedValue != actualValue ) \
+        { \
+            fprintf ( stderr, "%s:%d: CHECK_EQUAL ( %s, %s ) failed, %lld != %lld\n", __FILE__, __LINE__, #expected, #actual, expectedValue, actualValue ); \
+            hostTestFailures++; \
+        } \
+    } while ( 0 )
+
+#define HOST_TEST_MAIN_DEFINITIONS \
+    int hostTestFailures = 0
+
+#define HOST_TEST_RESULT() \
+    ( ( hostTestFailures == 0 ) ? 0 : 1 )
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef BARVIS_HOST_PIN_NAMES_H_
+#define BARVIS_HOST_PIN_NAMES_H_
+
+/**
+ * Teensy 3.1 pin names of the host build.  Any value below SIM_PIN_COUNT
+ * is a valid pin of the simulated board, so tests may cast plain numbers
+ * when they need more pins than the header names.
+ */
+#define SIM_PIN_COUNT   64
+
+typedef enum
+{
+    D0 = 0, D1, D2, D3, D4, D5, D6, D7, D8, D9, D10, D11, D12, D13, D14, D15, D16,
+    D17, D18, D19, D20, D21, D22, D23, D24, D25, D26, D27, D28, D29, D30, D31, D32, D33,
+    LED1 = D13,
+    USBTX = 40,
+    USBRX = 41,
+    NC = -1
+} PinName;
+
+typedef enum
+{
+    PortA = 0,
+    PortB,
+    PortC,
+    PortD,
+    PortE
+} PortName;
+
+typedef enum
+{
+    PullNone = 0,
+    PullUp,
+    PullDown,
+    OpenDrain
+} PinMode;
+
+#endif
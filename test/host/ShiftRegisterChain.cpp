@@ -0,0 +1,121 @@
+#include "ShiftRegisterChain.h"
+
+ShiftRegisterChain::ShiftRegisterChain ( const unsigned int _chainLength, const PinName clockPin, const PinName latchPin, const PinName enablePin, const PinName resetPin, const unsigned int chains )
+        : chainLength ( _chainLength ), stages ( chains, std::vector<bool> ( _chainLength, false ) ), storage ( chains, std::vector<bool> ( _chainLength, false ) ), dataPortBits ( chains, 0 )
+{
+    dataPin = NC;
+    portValue = 0;
+    clockLevel = 0;
+    latchLevel = 0;
+    resetHeld = false;
+    outputEnabled = false;
+    clockCount = 0;
+    latchCount = 0;
+
+    Sim::onPinWrite ( clockPin, [this] ( const int level )
+    {
+        if ( level && !clockLevel )
+        {
+            clockIn ();
+        }
+        clockLevel = level;
+    } );
+    Sim::onPinWrite ( latchPin, [this] ( const int level )
+    {
+        if ( level && !latchLevel )
+        {
+            storage = stages;
+            latchCount++;
+        }
+        latchLevel = level;
+    } );
+    Sim::onPinWrite ( enablePin, [this] ( const int level )
+    {
+        outputEnabled = ( level == 0 );
+    } );
+    Sim::onPinWrite ( resetPin, [this] ( const int level )
+    {
+        resetHeld = ( level == 0 );
+        for ( size_t c = 0; resetHeld && ( c < stages.size () ); c++ )
+        {
+            stages [ c ].assign ( chainLength, false );
+        }
+    } );
+}
+
+void ShiftRegisterChain::connectDataPin ( const PinName pin )
+{
+    dataPin = pin;
+}
+
+void ShiftRegisterChain::connectSpi ()
+{
+    Sim::onSpiWrite ( [this] ( const uint8_t value )
+    {
+        for ( int bit = 7; bit >= 0; bit-- )
+        {
+            portValue = ( value >> bit ) & 0x01;
+            clockIn ();
+        }
+    } );
+}
+
+void ShiftRegisterChain::connectDataPort ( const uint8_t * bitNumbers )
+{
+    for ( size_t c = 0; c < dataPortBits.size (); c++ )
+    {
+        dataPortBits [ c ] = 1UL << bitNumbers [ c ];
+    }
+    Sim::onPortWrite ( [this] ( const int port, const uint32_t value )
+    {
+        portValue = value;
+    } );
+}
+
+void ShiftRegisterChain::clockIn ()
+{
+    clockCount++;
+    if ( resetHeld )
+    {
+        return;
+    }
+    for ( size_t c = 0; c < stages.size (); c++ )
+    {
+        bool data;
+        if ( dataPin != NC )
+        {
+            data = Sim::pinLevel ( dataPin );
+        }
+        else if ( dataPortBits [ c ] != 0 )
+        {
+            data = ( portValue & dataPortBits [ c ] ) != 0;
+        }
+        else
+        {
+            data = ( portValue != 0 ); // SPI, the bit being clocked
+        }
+
+        std::vector<bool> & chain = stages [ c ];
+        for ( unsigned int i = chainLength - 1; i > 0; i-- )
+        {
+            chain [ i ] = chain [ i - 1 ];
+        }
+        chain [ 0 ] = data;
+    }
+}
+
+bool ShiftRegisterChain::output ( const unsigned int n ) const
+{
+    const unsigned int chain = n / chainLength;
+    return outputEnabled && ( chain < storage.size () ) && storage [ chain ] [ n % chainLength ];
+}
+
+unsigned int ShiftRegisterChain::outputsHigh () const
+{
+    unsigned int count = 0;
+    for ( unsigned int n = 0; n < storage.size () * chainLength; n++ )
+    {
+        count += output ( n ) ? 1 : 0;
+    }
+    return count;
+}
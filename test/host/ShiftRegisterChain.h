@@ -0,0 +1,68 @@
+#ifndef BARVIS_HOST_SHIFT_REGISTER_CHAIN_H_
+#define BARVIS_HOST_SHIFT_REGISTER_CHAIN_H_
+
+#include "mbed.h"
+#include <vector>
+
+/**
+ * One or more daisy chained 74HC595s as seen from the pins ShiftRegister
+ * drives, the simulated device the pump outputs are read back from.
+ *
+ * SHCP rising shifts DS into stage 0 of every chain, STCP rising copies
+ * the stages into the storage registers, MR held LOW clears the stages
+ * and OE HIGH switches the outputs off.  DS comes from a GPIO, from the
+ * SPI MOSI line ( 8 clocks per byte, MSB first, mode 0 ) or, for parallel
+ * chains, from one bit of a GPIO port per chain.
+ */
+class ShiftRegisterChain
+{
+    private:
+        const unsigned int chainLength;
+        std::vector<std::vector<bool> > stages;
+        std::vector<std::vector<bool> > storage;
+        std::vector<uint32_t> dataPortBits;
+        PinName dataPin;
+        uint32_t portValue;
+        int clockLevel;
+        int latchLevel;
+        bool resetHeld;
+        bool outputEnabled;
+        unsigned int clockCount;
+        unsigned int latchCount;
+
+        void clockIn ();
+
+    public:
+        /**
+         * @param chains number of parallel chains, each chainLength stages
+         */
+        ShiftRegisterChain ( const unsigned int _chainLength, const PinName clockPin, const PinName latchPin, const PinName enablePin, const PinName resetPin, const unsigned int chains = 1 );
+
+        void connectDataPin ( const PinName pin );
+        void connectSpi ();
+        void connectDataPort ( const uint8_t * bitNumbers );
+
+        /**
+         * Output n of the whole array, chain ( n / chainLength ) stage
+         * ( n % chainLength ), false while OE is HIGH
+         */
+        bool output ( const unsigned int n ) const;
+        unsigned int outputsHigh () const;
+
+        inline bool isOutputEnabled () const
+        {
+            return outputEnabled;
+        }
+
+        inline unsigned int getClockCount () const
+        {
+            return clockCount;
+        }
+
+        inline unsigned int getLatchCount () const
+        {
+            return latchCount;
+        }
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "mbed.h"
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    struct Board
+    {
+            uint64_t now;
+            uint64_t nextSequence;
+            std::vector<Ticker *> armed;
+            int levels [ SIM_PIN_COUNT ];
+            Sim::PinHook pinHooks [ SIM_PIN_COUNT ];
+            std::vector<InterruptIn *> edgeHandlers [ SIM_PIN_COUNT ];
+            Sim::SpiHook spiHook;
+            Sim::PortHook portHook;
+
+            Board ()
+                    : now ( 0 ), nextSequence ( 0 )
+            {
+                for ( int i = 0; i < SIM_PIN_COUNT; i++ )
+                {
+                    levels [ i ] = 0;
+                }
+            }
+    };
+
+    thread_local Board board;
+
+    bool validPin ( const int pin )
+    {
+        return ( pin >= 0 ) && ( pin < SIM_PIN_COUNT );
+    }
+}
+
+void Sim::reset ()
+{
+    board.now = 0;
+    board.nextSequence = 0;
+    board.armed.clear ();
+    for ( int i = 0; i < SIM_PIN_COUNT; i++ )
+    {
+        board.levels [ i ] = 0;
+        board.pinHooks [ i ] = PinHook ();
+        board.edgeHandlers [ i ].clear ();
+    }
+    board.spiHook = SpiHook ();
+    board.portHook = PortHook ();
+}
+
+uint64_t Sim::now ()
+{
+    return board.now;
+}
+
+uint64_t Sim::nextTimerAt ()
+{
+    uint64_t earliest = UINT64_MAX;
+    for ( size_t i = 0; i < board.armed.size (); i++ )
+    {
+        earliest = std::min ( earliest, board.armed [ i ]->due );
+    }
+    return earliest;
+}
+
+/**
+ * Runs the earliest timer if it is due by limit, periodic ones are
+ * rearmed before their handler runs like mbed's Ticker does
+ */
+bool Sim::runTimerDueBy ( const uint64_t limit )
+{
+    Ticker * next = NULL;
+    for ( size_t i = 0; i < board.armed.size (); i++ )
+    {
+        Ticker * ticker = board.armed [ i ];
+        if ( ( next == NULL ) || ( ticker->due < next->due ) || ( ( ticker->due == next->due ) && ( ticker->sequence < next->sequence ) ) )
+        {
+            next = ticker;
+        }
+    }
+    if ( ( next == NULL ) || ( next->due > limit ) )
+    {
+        return false;
+    }
+
+    board.now = next->due;
+    if ( next->periodic && ( next->period > 0 ) )
+    {
+        next->due += next->period;
+        next->sequence = board.nextSequence++;
+    }
+    else
+    {
+        disarm ( next );
+    }
+
+    // The handler may detach or reattach its own ticker, run a copy
+    std::function<void ()> handler = next->handler;
+    handler ();
+    return true;
+}
+
+void Sim::advanceTo ( const uint64_t time )
+{
+    while ( runTimerDueBy ( time ) )
+    {
+    }
+    if ( time > board.now )
+    {
+        board.now = time;
+    }
+}
+
+void Sim::advance ( const uint64_t microSeconds )
+{
+    advanceTo ( board.now + microSeconds );
+}
+
+bool Sim::runNextTimer ()
+{
+    return runTimerDueBy ( UINT64_MAX );
+}
+
+void Sim::waitForInterrupt ()
+{
+    if ( !runNextTimer () )
+    {
+        error ( "[SIM] __WFI with no timer armed, nothing would ever wake it\n" );
+    }
+}
+
+void Sim::arm ( Ticker * ticker, const uint64_t delay )
+{
+    ticker->due = board.now + delay;
+    ticker->sequence = board.nextSequence++;
+    if ( !ticker->armed )
+    {
+        ticker->armed = true;
+        board.armed.push_back ( ticker );
+    }
+}
+
+void Sim::disarm ( Ticker * ticker )
+{
+    if ( ticker->armed )
+    {
+        ticker->armed = false;
+        std::vector<Ticker *>::iterator position = std::find ( board.armed.begin (), board.armed.end (), ticker );
+        if ( position != board.armed.end () )
+        {
+            board.armed.erase ( position );
+        }
+    }
+}
+
+void Sim::setPin ( const int pin, const int level )
+{
+    if ( !validPin ( pin ) )
+    {
+        return;
+    }
+    const int previous = board.levels [ pin ];
+    board.levels [ pin ] = level ? 1 : 0;
+    if ( previous == board.levels [ pin ] )
+    {
+        return;
+    }
+
+    // Copied, a handler may construct or destroy InterruptIns
+    std::vector<InterruptIn *> handlers = board.edgeHandlers [ pin ];
+    for ( size_t i = 0; i < handlers.size (); i++ )
+    {
+        const std::function<void ()> & handler = level ? handlers [ i ]->riseHandler : handlers [ i ]->fallHandler;
+        if ( handler )
+        {
+            handler ();
+        }
+    }
+}
+
+int Sim::pinLevel ( const int pin )
+{
+    return validPin ( pin ) ? board.levels [ pin ] : 0;
+}
+
+void Sim::onPinWrite ( const int pin, const PinHook & hook )
+{
+    if ( validPin ( pin ) )
+    {
+        board.pinHooks [ pin ] = hook;
+    }
+}
+
+void Sim::onSpiWrite ( const SpiHook & hook )
+{
+    board.spiHook = hook;
+}
+
+void Sim::onPortWrite ( const PortHook & hook )
+{
+    board.portHook = hook;
+}
+
+void Sim::writePin ( const int pin, const int level )
+{
+    if ( !validPin ( pin ) )
+    {
+        return;
+    }
+    board.levels [ pin ] = level;
+    if ( board.pinHooks [ pin ] )
+    {
+        board.pinHooks [ pin ] ( level );
+    }
+}
+
+void Sim::writeSpi ( const uint8_t value )
+{
+    if ( board.spiHook )
+    {
+        board.spiHook ( value );
+    }
+}
+
+void Sim::writePort ( const int port, const uint32_t value )
+{
+    if ( board.portHook )
+    {
+        board.portHook ( port, value );
+    }
+}
+
+void Sim::addEdgeHandler ( const int pin, InterruptIn * handler )
+{
+    if ( validPin ( pin ) )
+    {
+        board.edgeHandlers [ pin ].push_back ( handler );
+    }
+}
+
+void Sim::removeEdgeHandler ( const int pin, InterruptIn * handler )
+{
+    if ( validPin ( pin ) )
+    {
+        std::vector<InterruptIn *> & handlers = board.edgeHandlers [ pin ];
+        handlers.erase ( std::remove ( handlers.begin (), handlers.end (), handler ), handlers.end () );
+    }
+}
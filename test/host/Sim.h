@@ -0,0 +1,88 @@
+#ifndef BARVIS_HOST_SIM_H_
+#define BARVIS_HOST_SIM_H_
+
+#include <stdint.h>
+#include <functional>
+
+class Ticker;
+class InterruptIn;
+
+/**
+ * The simulated board behind the host mbed.h: a micro second clock, the
+ * timers armed on it and the level of every pin.
+ *
+ * Time only moves when told to.  advance () moves the clock forward and
+ * runs every Ticker / Timeout falling due on the way, in time order, the
+ * way the timer interrupt would.  Firmware busy waits ( __WFI, wait_us )
+ * move it on to the next timer.  Pin writes, SPI bytes and port writes go
+ * to the device models hooked onto them ( ShiftRegisterChain,
+ * DispenserRail ), setPin drives an input and runs its InterruptIn edges.
+ *
+ * The board is per thread, so independent simulations can run side by
+ * side on several cores ( see CapacityModel ).  reset () before building
+ * the objects of the next one.
+ */
+class Sim
+{
+    public:
+        typedef std::function<void ( const int level )> PinHook;
+        typedef std::function<void ( const uint8_t value )> SpiHook;
+        typedef std::function<void ( const int port, const uint32_t value )> PortHook;
+
+        /**
+         * Clock back to 0, every pin LOW and no hooks.  Objects still
+         * holding timers or edges must be gone by then.
+         */
+        static void reset ();
+
+        static uint64_t now ();
+
+        /**
+         * Runs the timers due within microSeconds from now, then sets the
+         * clock to the end of that span
+         */
+        static void advance ( const uint64_t microSeconds );
+        static void advanceTo ( const uint64_t time );
+
+        /**
+         * Moves the clock to the earliest armed timer and runs it
+         * @return false if no timer is armed
+         */
+        static bool runNextTimer ();
+
+        /**
+         * @return when the earliest armed timer fires, UINT64_MAX if none is
+         */
+        static uint64_t nextTimerAt ();
+
+        /**
+         * Drives an input, InterruptIn handlers on the pin run right away
+         * for a rising or falling edge
+         */
+        static void setPin ( const int pin, const int level );
+        static int pinLevel ( const int pin );
+
+        /**
+         * Device models see every write to a pin, the SPI MOSI line or a
+         * GPIO port, a later hook for the same pin replaces the earlier one
+         */
+        static void onPinWrite ( const int pin, const PinHook & hook );
+        static void onSpiWrite ( const SpiHook & hook );
+        static void onPortWrite ( const PortHook & hook );
+
+        // Used by the mbed.h stand ins only
+        static void arm ( Ticker * ticker, const uint64_t delay );
+        static void disarm ( Ticker * ticker );
+        static void writePin ( const int pin, const int level );
+        static void writeSpi ( const uint8_t value );
+        static void writePort ( const int port, const uint32_t value );
+        static void addEdgeHandler ( const int pin, InterruptIn * handler );
+        static void removeEdgeHandler ( const int pin, InterruptIn * handler );
+        static void waitForInterrupt ();
+
+    private:
+        Sim ();
+        static bool runTimerDueBy ( const uint64_t limit );
+};
+
+#endif
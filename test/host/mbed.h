@@ -0,0 +1,370 @@
+#ifndef BARVIS_HOST_MBED_H_
+#define BARVIS_HOST_MBED_H_
+
+/**
+ * The part of mbed 2 the firmware libraries use, on top of the simulated
+ * board in Sim.h, so they build and run unchanged on the host.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <functional>
+#include "PinNames.h"
+#include "Sim.h"
+
+typedef uint32_t timestamp_t;
+
+class Ticker
+{
+    private:
+        std::function<void ()> handler;
+        uint64_t period;
+        uint64_t due;
+        uint64_t sequence; // orders timers due at the same time
+        bool armed;
+        const bool periodic;
+
+        Ticker ( const Ticker &other );
+
+        friend class Sim;
+
+    protected:
+        explicit Ticker ( const bool _periodic )
+                : period ( 0 ), due ( 0 ), sequence ( 0 ), armed ( false ), periodic ( _periodic )
+        {
+        }
+
+    public:
+        Ticker ()
+                : period ( 0 ), due ( 0 ), sequence ( 0 ), armed ( false ), periodic ( true )
+        {
+        }
+
+        virtual ~Ticker ()
+        {
+            detach ();
+        }
+
+        template <typename T>
+        void attach_us ( T * object, void (T::*method) (), const timestamp_t microSeconds )
+        {
+            attachHandler ( std::bind ( method, object ), microSeconds );
+        }
+
+        void attach_us ( void (*function) (), const timestamp_t microSeconds )
+        {
+            attachHandler ( function, microSeconds );
+        }
+
+        template <typename T>
+        void attach ( T * object, void (T::*method) (), const float seconds )
+        {
+            attachHandler ( std::bind ( method, object ), (uint64_t) ( seconds * 1000000.0f ) );
+        }
+
+        void attach ( void (*function) (), const float seconds )
+        {
+            attachHandler ( function, (uint64_t) ( seconds * 1000000.0f ) );
+        }
+
+        void detach ()
+        {
+            Sim::disarm ( this );
+        }
+
+    private:
+        void attachHandler ( const std::function<void ()> & _handler, const uint64_t microSeconds )
+        {
+            detach ();
+            handler = _handler;
+            period = microSeconds;
+            Sim::arm ( this, microSeconds );
+        }
+};
+
+class Timeout : public Ticker
+{
+    public:
+        Timeout ()
+                : Ticker ( false )
+        {
+        }
+};
+
+class Timer
+{
+    private:
+        uint64_t startedAt;
+        uint64_t elapsed;
+        bool running;
+
+    public:
+        Timer ()
+                : startedAt ( 0 ), elapsed ( 0 ), running ( false )
+        {
+        }
+
+        void start ()
+        {
+            if ( !running )
+            {
+                startedAt = Sim::now ();
+                running = true;
+            }
+        }
+
+        void stop ()
+        {
+            elapsed = read_high_resolution_us ();
+            running = false;
+        }
+
+        void reset ()
+        {
+            startedAt = Sim::now ();
+            elapsed = 0;
+        }
+
+        uint64_t read_high_resolution_us () const
+        {
+            return running ? ( elapsed + Sim::now () - startedAt ) : elapsed;
+        }
+
+        int read_us () const
+        {
+            return (int) read_high_resolution_us ();
+        }
+
+        int read_ms () const
+        {
+            return (int) ( read_high_resolution_us () / 1000 );
+        }
+
+        float read () const
+        {
+            return read_high_resolution_us () / 1000000.0f;
+        }
+};
+
+class DigitalOut
+{
+    private:
+        const PinName pin;
+
+    public:
+        DigitalOut ( const PinName _pin, const int value = 0 )
+                : pin ( _pin )
+        {
+            write ( value );
+        }
+
+        void write ( const int value )
+        {
+            Sim::writePin ( pin, value ? 1 : 0 );
+        }
+
+        int read () const
+        {
+            return Sim::pinLevel ( pin );
+        }
+
+        DigitalOut & operator= ( const int value )
+        {
+            write ( value );
+            return *this;
+        }
+
+        operator int () const
+        {
+            return read ();
+        }
+};
+
+class DigitalIn
+{
+    private:
+        const PinName pin;
+
+    public:
+        DigitalIn ( const PinName _pin )
+                : pin ( _pin )
+        {
+        }
+
+        int read () const
+        {
+            return Sim::pinLevel ( pin );
+        }
+
+        void mode ( const PinMode pull )
+        {
+        }
+
+        operator int () const
+        {
+            return read ();
+        }
+};
+
+class InterruptIn
+{
+    private:
+        const PinName pin;
+        std::function<void ()> riseHandler;
+        std::function<void ()> fallHandler;
+
+        InterruptIn ( const InterruptIn &other );
+
+        friend class Sim;
+
+    public:
+        InterruptIn ( const PinName _pin )
+                : pin ( _pin )
+        {
+            Sim::addEdgeHandler ( pin, this );
+        }
+
+        virtual ~InterruptIn ()
+        {
+            Sim::removeEdgeHandler ( pin, this );
+        }
+
+        int read () const
+        {
+            return Sim::pinLevel ( pin );
+        }
+
+        void mode ( const PinMode pull )
+        {
+        }
+
+        template <typename T>
+        void rise ( T * object, void (T::*method) () )
+        {
+            riseHandler = std::bind ( method, object );
+        }
+
+        void rise ( void (*function) () )
+        {
+            riseHandler = function;
+        }
+
+        template <typename T>
+        void fall ( T * object, void (T::*method) () )
+        {
+            fallHandler = std::bind ( method, object );
+        }
+
+        void fall ( void (*function) () )
+        {
+            fallHandler = function;
+        }
+
+        operator int () const
+        {
+            return read ();
+        }
+};
+
+/**
+ * Only MOSI matters to the simulated devices, every byte written is handed
+ * to Sim::onSpiWrite MSB first as the 74HC595 would clock it in ( mode 0 )
+ */
+class SPI
+{
+    public:
+        SPI ( const PinName mosi, const PinName miso, const PinName sclk, const PinName ssel = NC )
+        {
+        }
+
+        void format ( const int bits, const int mode = 0 )
+        {
+        }
+
+        void frequency ( const int hz )
+        {
+        }
+
+        int write ( const int value )
+        {
+            Sim::writeSpi ( (uint8_t) value );
+            return 0;
+        }
+};
+
+class PortOut
+{
+    private:
+        const PortName port;
+        const uint32_t mask;
+        uint32_t value;
+
+    public:
+        PortOut ( const PortName _port, const int _mask = 0xFFFFFFFF )
+                : port ( _port ), mask ( _mask ), value ( 0 )
+        {
+        }
+
+        void write ( const int _value )
+        {
+            value = _value & mask;
+            Sim::writePort ( port, value );
+        }
+
+        int read () const
+        {
+            return value;
+        }
+};
+
+inline uint32_t us_ticker_read ()
+{
+    return (uint32_t) Sim::now ();
+}
+
+inline void wait_us ( const int microSeconds )
+{
+    Sim::advance ( microSeconds );
+}
+
+inline void wait_ms ( const int milliSeconds )
+{
+    Sim::advance ( (uint64_t) milliSeconds * 1000 );
+}
+
+inline void wait ( const float seconds )
+{
+    Sim::advance ( (uint64_t) ( seconds * 1000000.0f ) );
+}
+
+inline void error ( const char * format, ... )
+{
+    va_list args;
+    va_start ( args, format );
+    vfprintf ( stderr, format, args );
+    va_end ( args );
+    abort ();
+}
+
+// Interrupts are simulated synchronously, nothing can preempt anything
+inline void __disable_irq ()
+{
+}
+
+inline void __enable_irq ()
+{
+}
+
+inline void __DMB ()
+{
+}
+
+inline void __WFI ()
+{
+    Sim::waitForInterrupt ();
+}
+
+#endif
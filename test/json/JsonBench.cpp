@@ -0,0 +1,125 @@
+#include "JsonHarness.h"
+#include <chrono>
+#include <stdio.h>
+
+#define DEFAULT_ROUNDS          20000
+#define REGRESSION_PERCENT      10
+
+/**
+ * Parse throughput of jsmn / Json over the corpus, read back the way
+ * executeCommand reads a command, against the baseline kept in
+ * json/json_bench.baseline:
+ *
+ *   json_bench [ --rounds <n> ] [ --baseline <file> [ --update ] ]
+ *
+ * Fails if a corpus entry parses differently than recorded, or the bytes
+ * per second fall more than REGRESSION_PERCENT below the baseline.  The
+ * baseline only means something on the machine it was taken on, --update
+ * rewrites it there.  Timing is wall clock, so ctest only runs it with
+ * BARVIS_PERF_TESTS.
+ */
+int main ( int argc, char * argv [] )
+{
+    unsigned int rounds = DEFAULT_ROUNDS;
+    const char * baselinePath = NULL;
+    bool update = false;
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( ( strcmp ( argv [ i ], "--rounds" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            rounds = strtoul ( argv [ ++i ], NULL, 10 );
+        }
+        else if ( ( strcmp ( argv [ i ], "--baseline" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            baselinePath = argv [ ++i ];
+        }
+        else if ( strcmp ( argv [ i ], "--update" ) == 0 )
+        {
+            update = true;
+        }
+        else
+        {
+            fprintf ( stderr, "usage: %s [ --rounds <n> ] [ --baseline <file> [ --update ] ]\n", argv [ 0 ] );
+            return 2;
+        }
+    }
+
+    std::vector<JsonCorpusEntry> corpus;
+    if ( !JsonHarness::loadCorpus ( corpus ) )
+    {
+        return 1;
+    }
+
+    jsmntok_t tokens [ JSON_MAX_TOKENS ];
+    unsigned int mismatches = 0;
+    for ( size_t i = 0; i < corpus.size (); i++ )
+    {
+        if ( JsonHarness::fingerprint ( corpus [ i ].json.data (), corpus [ i ].json.size (), tokens, JSON_MAX_TOKENS ) != corpus [ i ].expectedFingerprint )
+        {
+            fprintf ( stderr, "%s parses differently than recorded\n", corpus [ i ].name.c_str () );
+            mismatches++;
+        }
+    }
+    if ( mismatches > 0 )
+    {
+        return 1; // a faster parser that parses differently isn't faster
+    }
+
+    uint64_t bytes = 0;
+    uint64_t tokenCount = 0;
+    volatile int sink = 0;
+    const std::chrono::steady_clock::time_point startedAt = std::chrono::steady_clock::now ();
+    for ( unsigned int round = 0; round < rounds; round++ )
+    {
+        for ( size_t i = 0; i < corpus.size (); i++ )
+        {
+            const std::string & source = corpus [ i ].json;
+            Json json ( source.data (), source.size (), tokens, JSON_MAX_TOKENS );
+            sink += JsonHarness::readAll ( json );
+            bytes += source.size ();
+            tokenCount += ( json.getTokenCount () > 0 ) ? json.getTokenCount () : 0;
+        }
+    }
+    const double seconds = std::chrono::duration<double> ( std::chrono::steady_clock::now () - startedAt ).count ();
+    const uint64_t bytesPerSecond = ( seconds > 0 ) ? ( uint64_t ) ( bytes / seconds ) : 0;
+    const uint64_t tokensPerSecond = ( seconds > 0 ) ? ( uint64_t ) ( tokenCount / seconds ) : 0;
+    printf ( "%u rounds, %llu bytes/s, %llu tokens/s\n", rounds, ( unsigned long long ) bytesPerSecond, ( unsigned long long ) tokensPerSecond );
+
+    if ( baselinePath == NULL )
+    {
+        return 0;
+    }
+    if ( update )
+    {
+        FILE * file = fopen ( baselinePath, "w" );
+        if ( file == NULL )
+        {
+            return 1;
+        }
+        fprintf ( file, "%llu\n", ( unsigned long long ) bytesPerSecond );
+        fclose ( file );
+        printf ( "baseline updated\n" );
+        return 0;
+    }
+
+    unsigned long long baseline = 0;
+    FILE * file = fopen ( baselinePath, "r" );
+    const bool read = ( file != NULL ) && ( fscanf ( file, "%llu", &baseline ) == 1 );
+    if ( file != NULL )
+    {
+        fclose ( file );
+    }
+    if ( !read )
+    {
+        fprintf ( stderr, "no baseline in %s, take one with --update\n", baselinePath );
+        return 1;
+    }
+
+    printf ( "baseline %llu bytes/s, %+.1f%%\n", baseline, ( ( double ) bytesPerSecond - baseline ) * 100.0 / baseline );
+    if ( bytesPerSecond * 100 < baseline * ( 100 - REGRESSION_PERCENT ) )
+    {
+        fprintf ( stderr, "more than %d%% below the baseline\n", REGRESSION_PERCENT );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include "HostTest.h"
+#include "JsonHarness.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+/**
+ * Every corpus entry still parses to the tokens recorded for it, so a
+ * change to jsmn that alters a single token, or where a failing parse
+ * stops, shows up before any throughput number is trusted
+ */
+int main ()
+{
+    std::vector<JsonCorpusEntry> corpus;
+    CHECK ( JsonHarness::loadCorpus ( corpus ) );
+
+    jsmntok_t tokens [ JSON_MAX_TOKENS ];
+    for ( size_t i = 0; i < corpus.size (); i++ )
+    {
+        const JsonCorpusEntry & entry = corpus [ i ];
+        jsmn_parser parser;
+        jsmn_init ( &parser );
+        const int result = jsmn_parse ( &parser, entry.json.data (), entry.json.size (), tokens, JSON_MAX_TOKENS );
+        const uint32_t fingerprint = JsonHarness::fingerprint ( entry.json.data (), entry.json.size (), tokens, JSON_MAX_TOKENS );
+        if ( ( result != entry.expectedResult ) || ( fingerprint != entry.expectedFingerprint ) )
+        {
+            fprintf ( stderr, "%s parses to %d 0x%08X, expected %d 0x%08X\n", entry.name.c_str (), result, ( unsigned int ) fingerprint, entry.expectedResult,
+                    ( unsigned int ) entry.expectedFingerprint );
+            hostTestFailures++;
+        }
+    }
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,103 @@
+#include "HostTest.h"
+#include "JsonHarness.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define MUTATIONS_PER_ENTRY     200
+
+extern "C" int LLVMFuzzerTestOneInput ( const uint8_t * data, size_t size );
+
+// Bytes mutations are drawn from, jsmn's structural characters first
+static const char mutationBytes [] = "{}[]\":,\\ \t\r\nu0-9tfn@\x01\x7f\x80";
+
+static inline uint32_t xorShift ( uint32_t & state )
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void runInput ( const std::string & input, unsigned int & parses )
+{
+    // A copy of exactly the input's size, so ASan catches reads past it
+    std::vector<uint8_t> data ( input.begin (), input.end () );
+    LLVMFuzzerTestOneInput ( data.empty () ? NULL : &data [ 0 ], data.size () );
+    parses++;
+}
+
+/**
+ * Without clang's libFuzzer the fuzz target still runs here, over every
+ * prefix of every corpus entry ( the frames a flaky link delivers ) and
+ * MUTATIONS_PER_ENTRY copies with a few bytes replaced by a fixed pseudo
+ * random sequence.  Files given on the command line, crashes the fuzzer
+ * kept, are replayed as they are.
+ */
+int main ( int argc, char * argv [] )
+{
+    std::vector<JsonCorpusEntry> corpus;
+    CHECK ( JsonHarness::loadCorpus ( corpus ) );
+
+    unsigned int parses = 0;
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string crash;
+        FILE * file = fopen ( argv [ i ], "rb" );
+        CHECK ( file != NULL );
+        int c;
+        while ( ( file != NULL ) && ( ( c = fgetc ( file ) ) != EOF ) )
+        {
+            crash.push_back ( ( char ) c );
+        }
+        if ( file != NULL )
+        {
+            fclose ( file );
+        }
+        runInput ( crash, parses );
+    }
+
+    uint32_t random = 0x2545F491;
+    unsigned int truncatedComplete = 0;
+    for ( size_t i = 0; i < corpus.size (); i++ )
+    {
+        const std::string & json = corpus [ i ].json;
+
+        // Up to here a valid command is cut short, must never parse as complete
+        size_t closedAt = json.size ();
+        while ( ( closedAt > 0 ) && ( strchr ( " \t\r\n", json [ closedAt - 1 ] ) != NULL ) )
+        {
+            closedAt--;
+        }
+
+        for ( size_t prefix = 0; prefix <= json.size (); prefix++ )
+        {
+            runInput ( json.substr ( 0, prefix ), parses );
+
+            jsmntok_t tokens [ JSON_MAX_TOKENS ];
+            jsmn_parser parser;
+            jsmn_init ( &parser );
+            const int result = jsmn_parse ( &parser, json.data (), prefix, tokens, JSON_MAX_TOKENS );
+            if ( ( corpus [ i ].expectedResult > 0 ) && ( prefix > 0 ) && ( prefix < closedAt ) && ( result > 0 ) )
+            {
+                truncatedComplete++;
+                fprintf ( stderr, "%s cut after %u bytes parses as complete\n", corpus [ i ].name.c_str (), ( unsigned int ) prefix );
+            }
+        }
+
+        for ( unsigned int m = 0; ( m < MUTATIONS_PER_ENTRY ) && !json.empty (); m++ )
+        {
+            std::string mutated = json;
+            const unsigned int changes = 1 + ( xorShift ( random ) % 3 );
+            for ( unsigned int c = 0; c < changes; c++ )
+            {
+                const uint32_t pick = xorShift ( random );
+                mutated [ pick % mutated.size () ] = mutationBytes [ ( pick >> 16 ) % ( sizeof ( mutationBytes ) - 1 ) ];
+            }
+            runInput ( mutated, parses );
+        }
+    }
+
+    CHECK_EQUAL ( 0, truncatedComplete );
+    printf ( "%u parses replayed through the fuzz target\n", parses );
+    return HOST_TEST_RESULT ();
+}
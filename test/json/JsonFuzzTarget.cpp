@@ -0,0 +1,19 @@
+#include "JsonHarness.h"
+#include <stdlib.h>
+
+/**
+ * libFuzzer entry point over jsmn_parse and Json, built as json_fuzzer
+ * with clang ( -fsanitize=fuzzer ), and replayed by json_fuzz_replay with
+ * any other compiler.  Unsound tokens abort so the fuzzer keeps the input.
+ *
+ *   mkdir -p findings
+ *   ./json_fuzzer findings ../test/json/corpus
+ */
+extern "C" int LLVMFuzzerTestOneInput ( const uint8_t * data, size_t size )
+{
+    if ( !JsonHarness::checkInput ( ( const char * ) data, size ) )
+    {
+        abort ();
+    }
+    return 0;
+}
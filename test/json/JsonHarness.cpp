@@ -0,0 +1,167 @@
+#include "JsonHarness.h"
+#include <stdio.h>
+
+#define FNV_OFFSET_BASIS        2166136261UL
+#define FNV_PRIME               16777619UL
+
+static inline uint32_t fnvAdd ( uint32_t hash, const int value )
+{
+    const uint32_t bits = (uint32_t) value;
+    for ( int shift = 0; shift < 32; shift += 8 )
+    {
+        hash ^= ( bits >> shift ) & 0xFF;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool readFile ( const std::string & path, std::string & contents )
+{
+    FILE * file = fopen ( path.c_str (), "rb" );
+    if ( file == NULL )
+    {
+        return false;
+    }
+    contents.clear ();
+    char buffer [ 512 ];
+    size_t count;
+    while ( ( count = fread ( buffer, 1, sizeof ( buffer ), file ) ) > 0 )
+    {
+        contents.append ( buffer, count );
+    }
+    fclose ( file );
+    return true;
+}
+
+bool JsonHarness::loadCorpus ( std::vector<JsonCorpusEntry> & corpus, const std::string & directory )
+{
+    FILE * manifest = fopen ( ( directory + "/corpus.expected" ).c_str (), "r" );
+    if ( manifest == NULL )
+    {
+        return false;
+    }
+
+    bool loaded = true;
+    char line [ 256 ];
+    corpus.clear ();
+    while ( loaded && ( fgets ( line, sizeof ( line ), manifest ) != NULL ) )
+    {
+        if ( ( line [ 0 ] == '#' ) || ( line [ 0 ] == '\n' ) )
+        {
+            continue;
+        }
+
+        char name [ 64 ];
+        JsonCorpusEntry entry;
+        unsigned int fingerprint;
+        loaded = ( sscanf ( line, "%63s %d %x", name, &entry.expectedResult, &fingerprint ) == 3 );
+        entry.name = name;
+        entry.expectedFingerprint = fingerprint;
+        loaded = loaded && readFile ( directory + "/corpus/" + entry.name + ".json", entry.json );
+        if ( loaded )
+        {
+            corpus.push_back ( entry );
+        }
+        else
+        {
+            fprintf ( stderr, "corpus entry '%s' can't be loaded\n", line );
+        }
+    }
+    fclose ( manifest );
+    return loaded && !corpus.empty ();
+}
+
+uint32_t JsonHarness::fingerprint ( const char * json, const size_t length, jsmntok_t * tokenStorage, const int tokenCapacity )
+{
+    jsmn_parser parser;
+    jsmn_init ( &parser );
+    const int result = jsmn_parse ( &parser, json, length, tokenStorage, tokenCapacity );
+
+    uint32_t hash = FNV_OFFSET_BASIS;
+    hash = fnvAdd ( hash, result );
+    hash = fnvAdd ( hash, parser.pos );
+    hash = fnvAdd ( hash, parser.toknext );
+    for ( unsigned int i = 0; i < parser.toknext; i++ )
+    {
+        const jsmntok_t & token = tokenStorage [ i ];
+        hash = fnvAdd ( hash, token.type );
+        hash = fnvAdd ( hash, token.start );
+        hash = fnvAdd ( hash, token.end );
+        hash = fnvAdd ( hash, token.parent );
+        hash = fnvAdd ( hash, token.childCount );
+    }
+    return hash;
+}
+
+bool JsonHarness::tokensSound ( const int result, const jsmn_parser & parser, const size_t length, const jsmntok_t * tokens, const int tokenCapacity )
+{
+    if ( ( result < JSMN_ERROR_PART ) || ( (int) parser.toknext > tokenCapacity ) || ( parser.pos > length ) )
+    {
+        return false;
+    }
+    for ( int i = 0; i < (int) parser.toknext; i++ )
+    {
+        const jsmntok_t & token = tokens [ i ];
+        if ( ( token.parent < -1 ) || ( token.parent >= i ) || ( token.childCount < 0 ) )
+        {
+            return false;
+        }
+        if ( ( token.start < -1 ) || ( token.start > (int) length ) || ( token.end < -1 ) || ( token.end > (int) length ) )
+        {
+            return false;
+        }
+        if ( ( token.end != -1 ) && ( token.end < token.start ) )
+        {
+            return false;
+        }
+        if ( ( result >= 0 ) && ( ( token.start == -1 ) || ( token.end == -1 ) ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int JsonHarness::readAll ( const Json & json )
+{
+    int sum = 0;
+    if ( json.isValidJson () && ( json.type ( 0 ) == JSMN_OBJECT ) )
+    {
+        sum += json.findKeyIndexIn ( "type", 0 );
+    }
+    for ( int i = 0; i < json.getTokenCount (); i++ )
+    {
+        switch ( json.type ( i ) )
+        {
+            case JSMN_KEY:
+                sum += json.findChildIndexOf ( i, -1 );
+                break;
+            case JSMN_PRIMITIVE:
+                sum += json.tokenIntegerValue ( i );
+                break;
+            default:
+                sum += json.tokenLength ( i );
+                break;
+        }
+    }
+    return sum;
+}
+
+bool JsonHarness::checkInput ( const char * data, const size_t length )
+{
+    jsmntok_t tokens [ JSON_MAX_TOKENS ];
+    jsmn_parser parser;
+    jsmn_init ( &parser );
+    const int result = jsmn_parse ( &parser, data, length, tokens, JSON_MAX_TOKENS );
+    if ( !tokensSound ( result, parser, length, tokens, JSON_MAX_TOKENS ) )
+    {
+        return false;
+    }
+    if ( result > 0 )
+    {
+        Json json ( data, length, tokens, JSON_MAX_TOKENS );
+        volatile int sink = readAll ( json );
+        (void) sink;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef BARVIS_JSON_HARNESS_H_
+#define BARVIS_JSON_HARNESS_H_
+
+#include "Json.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * What the JSON host tests, the fuzz target and the bench share: the
+ * corpus in json/corpus ( real commands, synthetic ones up to a 24 pump
+ * order, malformed input ) with the parse recorded for every entry in
+ * json/corpus.expected, and the checks run on a parse.
+ */
+struct JsonCorpusEntry
+{
+        std::string name;
+        std::string json;
+        int expectedResult;            // jsmn_parse with JSON_MAX_TOKENS tokens
+        uint32_t expectedFingerprint;  // see JsonHarness::fingerprint
+};
+
+class JsonHarness
+{
+    private:
+        JsonHarness ();
+
+    public:
+        /**
+         * Reads corpus.expected and the corpus file of every entry in it
+         * from directory ( JSON_CORPUS_DIR by default )
+         * @return false if a file is missing or the manifest is malformed
+         */
+        static bool loadCorpus ( std::vector<JsonCorpusEntry> & corpus, const std::string & directory = JSON_CORPUS_DIR );
+
+        /**
+         * FNV-1a over the jsmn_parse result, where the parser stopped, and
+         * every token it allocated
+         */
+        static uint32_t fingerprint ( const char * json, const size_t length, jsmntok_t * tokenStorage, const int tokenCapacity );
+
+        /**
+         * Token bounds within the input, parents before children and every
+         * container closed on success
+         */
+        static bool tokensSound ( const int result, const jsmn_parser & parser, const size_t length, const jsmntok_t * tokens, const int tokenCapacity );
+
+        /**
+         * Reads a parsed command the way executeCommand does, and every
+         * primitive as a number.  The sum only keeps the compiler from
+         * dropping the reads.
+         */
+        static int readAll ( const Json & json );
+
+        /**
+         * The fuzz property: parses length bytes of data into
+         * JSON_MAX_TOKENS tokens, checks the tokens are sound and reads a
+         * successful parse through Json
+         * @return false if the tokens are not sound
+         */
+        static bool checkInput ( const char * data, const size_t length );
+};
+
+#endif
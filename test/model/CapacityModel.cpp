@@ -0,0 +1,393 @@
+#include "CapacityModel.h"
+#include "ShiftRegisterChain.h"
+#include "DispenserRail.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+
+#define MODEL_DATA_PIN      D11
+#define MODEL_LATCH_PIN     D10
+#define MODEL_CLOCK_PIN     D13
+#define MODEL_ENABLE_PIN    D9
+#define MODEL_RESET_PIN     D8
+#define MODEL_HOME_PIN      D20
+#define MODEL_END_PIN       D21
+#define MODEL_STEP_PIN      D22
+#define MODEL_DIR_PIN       D23
+
+#define MICRO_SECS_PER_MS   1000ULL
+
+static const PinName cupSensorPins [ CAPACITY_MODEL_MAX_CUPS ] = { D24, D25, D26, D27, D28, D29, D30, D31 };
+
+static uint32_t xorShift ( uint32_t & state )
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/**
+ * Exponential inter arrival time, xorshift32 driven so a seed replays
+ */
+static uint32_t nextArrival ( uint32_t & random, const uint32_t meanMs )
+{
+    const double uniform = ( (double) ( xorShift ( random ) >> 8 ) + 1.0 ) / 16777216.0; // ( 0, 1 ]
+    return (uint32_t) ( -log ( uniform ) * meanMs );
+}
+
+CapacityModelConfig::CapacityModelConfig ()
+        : cupCount ( 4 ), queueDepth ( 8 ), pumpCount ( 24 ), firstCupPosition ( 400 ), cupSpacing ( 800 ), policy ( RoundRobin ), overlapMode ( false ), cupSwapMs ( 15000 ), meanArrivalMs (
+                60000 ), orderCount ( 200 ), seed ( 1 )
+{
+}
+
+CapacityModelResult::CapacityModelResult ()
+        : simulatedMs ( 0 ), served ( 0 ), rejected ( 0 ), failed ( 0 ), pumpOnMs ( 0 ), pumpCount ( 0 ), headTravelSteps ( 0 ), deferredHighWater ( 0 )
+{
+}
+
+uint32_t CapacityModelResult::drinksPerHour () const
+{
+    return ( simulatedMs == 0 ) ? 0 : (uint32_t) ( ( (uint64_t) served * 3600000 ) / simulatedMs );
+}
+
+unsigned int CapacityModelResult::pumpUtilisation () const
+{
+    return ( ( simulatedMs == 0 ) || ( pumpCount == 0 ) ) ? 0 : (unsigned int) ( ( pumpOnMs * 100 ) / ( simulatedMs * pumpCount ) );
+}
+
+/**
+ * The order path of one run, and the customers around it
+ */
+class CapacityModel::Machine : public OrderProgressListener
+{
+    private:
+        Machine ( const Machine & other );
+
+    public:
+        const CapacityModelConfig & config;
+        CapacityModelResult & result;
+        std::vector<unsigned int> cupPositions;
+        ShiftRegisterChain chain;
+        DispenserRail rail;
+        PumpControl pumps;
+        DispenserControl dispenser;
+        OrderQueue queue;
+        DeferredQueue deferred;
+        OrderManager manager;
+        IrSensorManager sensors;
+
+        std::map<uint16_t, int> cupOf;    // order -> cup it is poured into
+        std::vector<int> cupsDone;        // taken away on the next main loop pass
+        std::vector<uint64_t> cupBackAt;  // 0: in place
+        unsigned int finished;
+        uint64_t lastProgressAt;
+
+        Machine ( const CapacityModelConfig & _config, CapacityModelResult & _result );
+
+        virtual void orderProgress ( const OrderInfo & order, const OrderProgress progress );
+
+        /**
+         * One pass of the main loop: the deferred order work, the cup
+         * sensors and the customers
+         */
+        void mainLoop ();
+
+        int cupAt ( const int position ) const;
+        static unsigned int railLength ( const CapacityModelConfig & config );
+};
+
+unsigned int CapacityModel::Machine::railLength ( const CapacityModelConfig & config )
+{
+    // as much room behind the last cup as in front of the first
+    return ( 2 * config.firstCupPosition ) + ( ( config.cupCount - 1 ) * config.cupSpacing ) + 1;
+}
+
+CapacityModel::Machine::Machine ( const CapacityModelConfig & _config, CapacityModelResult & _result )
+        : config ( _config ), result ( _result ), cupPositions ( _config.cupCount ), chain ( _config.pumpCount, MODEL_CLOCK_PIN, MODEL_LATCH_PIN, MODEL_ENABLE_PIN, MODEL_RESET_PIN ), rail (
+                MODEL_HOME_PIN, MODEL_END_PIN, MODEL_STEP_PIN, MODEL_DIR_PIN, railLength ( _config ), 0 ), pumps ( MODEL_DATA_PIN, MODEL_LATCH_PIN, MODEL_CLOCK_PIN, MODEL_ENABLE_PIN,
+                MODEL_RESET_PIN, _config.pumpCount ), dispenser ( MODEL_HOME_PIN, MODEL_END_PIN, MODEL_STEP_PIN, MODEL_DIR_PIN ), queue ( _config.queueDepth, _config.pumpCount ), manager (
+                _config.cupCount, _config.pumpCount, &queue, &pumps, &dispenser ), sensors ( cupSensorPins, _config.cupCount ), cupBackAt ( _config.cupCount, 0 ), finished ( 0 ), lastProgressAt (
+                0 )
+{
+    chain.connectDataPin ( MODEL_DATA_PIN );
+    for ( unsigned int i = 0; i < config.cupCount; i++ )
+    {
+        cupPositions [ i ] = config.firstCupPosition + ( i * config.cupSpacing );
+    }
+    manager.setCupPositions ( &cupPositions [ 0 ] );
+    manager.setCupSelectionPolicy ( config.policy );
+    manager.setOverlapMode ( config.overlapMode );
+    manager.setDeferredQueue ( &deferred );
+    manager.setProgressListener ( this );
+    sensors.addListener ( &manager );
+
+    // Every cup in place, the first process () reports them all
+    for ( unsigned int i = 0; i < config.cupCount; i++ )
+    {
+        Sim::setPin ( cupSensorPins [ i ], 1 );
+    }
+    sensors.process ();
+}
+
+int CapacityModel::Machine::cupAt ( const int position ) const
+{
+    for ( unsigned int i = 0; i < cupPositions.size (); i++ )
+    {
+        if ( (int) cupPositions [ i ] == position )
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Interrupt context as well, only takes notes
+ */
+void CapacityModel::Machine::orderProgress ( const OrderInfo & order, const OrderProgress progress )
+{
+    const uint32_t sinceArrival = us_ticker_read () - order.receivedAt;
+    lastProgressAt = Sim::now ();
+    switch ( progress )
+    {
+        case OrderDispatched:
+            result.queueWait.record ( sinceArrival );
+            break;
+        case OrderPouring:
+            cupOf [ order.orderId ] = cupAt ( dispenser.getCurrentPosition () );
+            break;
+        case OrderDone:
+            result.served++;
+            result.total.record ( sinceArrival );
+            if ( cupOf.count ( order.orderId ) != 0 )
+            {
+                cupsDone.push_back ( cupOf [ order.orderId ] );
+            }
+            break;
+        case OrderFailed:
+        case OrderCancelled:
+            result.failed++;
+            break;
+        default:
+            return;
+    }
+    if ( ( progress == OrderDone ) || ( progress == OrderFailed ) || ( progress == OrderCancelled ) )
+    {
+        cupOf.erase ( order.orderId );
+        finished++;
+    }
+}
+
+void CapacityModel::Machine::mainLoop ()
+{
+    Sim::advance ( CAPACITY_MODEL_MAIN_LOOP_MICRO_SECS );
+    deferred.dispatch ();
+    sensors.process ();
+
+    const uint64_t now = Sim::now ();
+    for ( size_t i = 0; i < cupsDone.size (); i++ )
+    {
+        const int cup = cupsDone [ i ];
+        if ( cup != -1 )
+        {
+            Sim::setPin ( cupSensorPins [ cup ], 0 );
+            cupBackAt [ cup ] = now + ( config.cupSwapMs * MICRO_SECS_PER_MS );
+        }
+    }
+    cupsDone.clear ();
+    for ( unsigned int cup = 0; cup < config.cupCount; cup++ )
+    {
+        if ( ( cupBackAt [ cup ] != 0 ) && ( cupBackAt [ cup ] <= now ) )
+        {
+            cupBackAt [ cup ] = 0;
+            Sim::setPin ( cupSensorPins [ cup ], 1 );
+        }
+    }
+
+    result.pumpOnMs += chain.outputsHigh (); // sampled once per milli second
+}
+
+bool CapacityModel::run ( const CapacityModelConfig & config, CapacityModelResult & result )
+{
+    result.simulatedMs = 0;
+    result.served = 0;
+    result.rejected = 0;
+    result.failed = 0;
+    result.queueWait.reset ();
+    result.total.reset ();
+    result.pumpOnMs = 0;
+    result.pumpCount = config.pumpCount;
+    result.headTravelSteps = 0;
+    result.deferredHighWater = 0;
+
+    if ( ( config.cupCount == 0 ) || ( config.cupCount > CAPACITY_MODEL_MAX_CUPS ) || ( config.queueDepth == 0 ) || ( config.pumpCount == 0 ) || config.recipes.empty () )
+    {
+        return false;
+    }
+    if ( ( config.cupCount > 1 ) && ( config.cupSpacing == 0 ) )
+    {
+        return false;
+    }
+    for ( size_t r = 0; r < config.recipes.size (); r++ )
+    {
+        const std::vector<unsigned int> & recipe = config.recipes [ r ];
+        if ( recipe.size () > config.pumpCount )
+        {
+            return false;
+        }
+        for ( size_t i = 0; i < recipe.size (); i++ )
+        {
+            if ( recipe [ i ] > __PUMPCONTROL_DURATION_MAX_SECS__ )
+            {
+                return false;
+            }
+        }
+    }
+
+    // The arrivals up front, from the trace or drawn from the seed
+    std::vector<CapacityModelArrival> arrivals;
+    uint32_t random = ( config.seed != 0 ) ? config.seed : 0x2545F491;
+    if ( !config.trace.empty () )
+    {
+        arrivals = config.trace;
+    }
+    else
+    {
+        uint32_t at = 0;
+        for ( unsigned int i = 0; i < config.orderCount; i++ )
+        {
+            at += nextArrival ( random, config.meanArrivalMs );
+            CapacityModelArrival arrival = { at, -1 };
+            arrivals.push_back ( arrival );
+        }
+    }
+    for ( size_t i = 0; i < arrivals.size (); i++ )
+    {
+        CapacityModelArrival & arrival = arrivals [ i ];
+        if ( ( arrival.recipe >= (int) config.recipes.size () ) || ( ( i > 0 ) && ( arrival.atMs < arrivals [ i - 1 ].atMs ) ) )
+        {
+            return false;
+        }
+        if ( arrival.recipe < 0 )
+        {
+            arrival.recipe = ( config.recipes.size () == 1 ) ? 0 : ( xorShift ( random ) % config.recipes.size () );
+        }
+    }
+
+    Sim::reset ();
+    bool completed = true;
+    {
+        Machine machine ( config, result );
+        const uint64_t start = Sim::now (); // after the calibration
+        const unsigned int railStart = machine.rail.getStepCount ();
+        machine.lastProgressAt = start;
+
+        std::vector<unsigned int> durations ( config.pumpCount );
+        size_t next = 0;
+        while ( machine.finished + result.rejected < arrivals.size () )
+        {
+            machine.mainLoop ();
+
+            for ( ; ( next < arrivals.size () ) && ( start + ( arrivals [ next ].atMs * MICRO_SECS_PER_MS ) <= Sim::now () ); next++ )
+            {
+                const std::vector<unsigned int> & recipe = config.recipes [ arrivals [ next ].recipe ];
+                std::fill ( durations.begin (), durations.end (), 0 );
+                std::copy ( recipe.begin (), recipe.end (), durations.begin () );
+                OrderInfo info;
+                info.receivedAt = us_ticker_read ();
+                info.replyTo = 0;
+                if ( machine.queue.addOrder ( &durations [ 0 ], &info ) == -1 )
+                {
+                    result.rejected++;
+                }
+                machine.lastProgressAt = Sim::now ();
+            }
+
+            if ( Sim::now () - machine.lastProgressAt > CAPACITY_MODEL_STALL_LIMIT_MS * MICRO_SECS_PER_MS )
+            {
+                completed = false;
+                break;
+            }
+        }
+
+        result.simulatedMs = ( Sim::now () - start ) / MICRO_SECS_PER_MS;
+        result.headTravelSteps = machine.rail.getStepCount () - railStart;
+        result.deferredHighWater = machine.deferred.getHighWaterMark ();
+    }
+    Sim::reset ();
+    return completed;
+}
+
+void CapacityModel::sweep ( const std::vector<CapacityModelConfig> & configs, std::vector<CapacityModelResult> & results, std::vector<bool> & succeeded, const unsigned int threads )
+{
+    results.resize ( configs.size () );
+    std::vector<char> ran ( configs.size (), 0 ); // vector<bool> elements share bytes across threads
+    std::atomic<size_t> next ( 0 );
+
+    // Every worker has a board of its own, it takes the next configuration
+    // until there is none left
+    std::vector<std::thread> workers;
+    const unsigned int workerCount = ( threads == 0 ) ? 1 : threads;
+    for ( unsigned int w = 0; w < workerCount; w++ )
+    {
+        workers.push_back ( std::thread ( [ & ] ()
+        {
+            for ( size_t i = next++; i < configs.size (); i = next++ )
+            {
+                ran [ i ] = CapacityModel::run ( configs [ i ], results [ i ] );
+            }
+        } ) );
+    }
+    for ( size_t w = 0; w < workers.size (); w++ )
+    {
+        workers [ w ].join ();
+    }
+    succeeded.assign ( ran.begin (), ran.end () );
+}
+
+bool CapacityModel::loadTrace ( const std::string & path, std::vector<CapacityModelArrival> & trace )
+{
+    FILE * file = fopen ( path.c_str (), "r" );
+    if ( file == NULL )
+    {
+        return false;
+    }
+
+    bool loaded = true;
+    char line [ 128 ];
+    trace.clear ();
+    while ( loaded && ( fgets ( line, sizeof ( line ), file ) != NULL ) )
+    {
+        char * comment = strchr ( line, '#' );
+        if ( comment != NULL )
+        {
+            *comment = '\0';
+        }
+        unsigned long atMs;
+        int recipe = -1;
+        char rest;
+        const int fields = sscanf ( line, "%lu %d %c", &atMs, &recipe, &rest );
+        if ( fields == EOF )
+        {
+            continue; // blank or comment only
+        }
+        CapacityModelArrival arrival = { (uint32_t) atMs, recipe };
+        loaded = ( ( fields == 1 ) || ( fields == 2 ) ) && ( recipe >= -1 ) && ( trace.empty () || ( trace.back ().atMs <= arrival.atMs ) );
+        if ( loaded )
+        {
+            trace.push_back ( arrival );
+        }
+        else
+        {
+            fprintf ( stderr, "%s: malformed line '%s'\n", path.c_str (), line );
+        }
+    }
+    fclose ( file );
+    return loaded;
+}
@@ -0,0 +1,121 @@
+#ifndef BARVIS_CAPACITY_MODEL_H_
+#define BARVIS_CAPACITY_MODEL_H_
+
+#include "OrderManager.h"
+#include "IrSensorManager.h"
+#include "OrderStats.h"
+#include <string>
+#include <vector>
+
+#define CAPACITY_MODEL_MAX_CUPS             IR_SENSOR_MANAGER_MAX_PINS // a sensor per cup
+#define CAPACITY_MODEL_MAIN_LOOP_MICRO_SECS 1000
+
+// A run that reports no progress for this long is stuck, it fails
+#define CAPACITY_MODEL_STALL_LIMIT_MS       3600000
+
+/**
+ * An order arriving at atMs after the start, recipe indexes
+ * CapacityModelConfig::recipes, -1 picks one at random
+ */
+struct CapacityModelArrival
+{
+        uint32_t atMs;
+        int recipe;
+};
+
+/**
+ * A machine configuration and the load it is put under
+ */
+struct CapacityModelConfig
+{
+        unsigned int cupCount;
+        unsigned int queueDepth;
+        unsigned int pumpCount;
+        unsigned int firstCupPosition; // dispenser steps from home
+        unsigned int cupSpacing;       // steps between neighbouring cups
+        CupSelectionPolicy policy;
+        bool overlapMode;
+        uint32_t cupSwapMs;            // a served cup is taken away at once and replaced after this long
+
+        // Pump durations ( seconds ) per recipe, shorter ones run the
+        // remaining pumps for 0
+        std::vector<std::vector<unsigned int> > recipes;
+
+        // Without a trace orderCount orders arrive as a Poisson process,
+        // seed replays it and the recipe picks
+        uint32_t meanArrivalMs;
+        unsigned int orderCount;
+        uint32_t seed;
+        std::vector<CapacityModelArrival> trace;
+
+        CapacityModelConfig ();
+};
+
+/**
+ * Latencies are in micro seconds in LatencyHistogram's power of two
+ * buckets, the percentiles are bucket upper bounds like those of STATS.
+ */
+struct CapacityModelResult
+{
+        uint64_t simulatedMs;          // first arrival possible -> last order finished
+        unsigned int served;
+        unsigned int rejected;         // arrivals that found the queue full
+        unsigned int failed;
+        LatencyHistogram queueWait;    // arrival -> dispatched
+        LatencyHistogram total;        // arrival -> pumps idle
+        uint64_t pumpOnMs;             // summed over all pumps
+        unsigned int pumpCount;
+        unsigned int headTravelSteps;  // homing included
+        unsigned int deferredHighWater;
+
+        CapacityModelResult ();
+
+        uint32_t drinksPerHour () const;
+        unsigned int pumpUtilisation () const; // percent of pumpCount * simulatedMs
+};
+
+/**
+ * Capacity model of the whole machine for sizing cups, queue depth and
+ * cup layout against an order rate.  Host only.
+ *
+ * run () builds the real order path on the simulated board the way
+ * main.cpp wires it: OrderQueue, OrderManager with its DeferredQueue,
+ * PumpControl on a 74HC595 chain, DispenserControl on a rail and an
+ * IrSensorManager with a sensor per cup.  Orders are put on the queue as
+ * they arrive, a customer takes a cup away the moment it is done and puts
+ * the next one in place cupSwapMs later, and a main loop runs every
+ * CAPACITY_MODEL_MAIN_LOOP_MICRO_SECS of simulated time until every order
+ * finished.
+ *
+ * The board is per thread, sweep () runs configurations on several cores
+ * with the same results as one after the other.
+ */
+class CapacityModel
+{
+    private:
+        class Machine;
+
+        CapacityModel ();
+
+    public:
+        /**
+         * @return false if the configuration is out of range, or the run
+         * stalled
+         */
+        static bool run ( const CapacityModelConfig & config, CapacityModelResult & result );
+
+        /**
+         * Runs every configuration on up to threads threads
+         * @param succeeded run () of every configuration
+         */
+        static void sweep ( const std::vector<CapacityModelConfig> & configs, std::vector<CapacityModelResult> & results, std::vector<bool> & succeeded, const unsigned int threads );
+
+        /**
+         * Reads a trace, a line per order: arrival ms after the start and
+         * optionally the recipe index, # starts a comment
+         * @return false if the file is missing or a line is malformed
+         */
+        static bool loadTrace ( const std::string & path, std::vector<CapacityModelArrival> & trace );
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "HostTest.h"
+#include "CapacityModel.h"
+
+HOST_TEST_MAIN_DEFINITIONS;
+
+#define SECOND_MICRO_SECS   1000000UL
+
+/**
+ * Two cups, short pours on four of eight pumps, light enough load that
+ * every order is served
+ */
+static CapacityModelConfig lightLoad ()
+{
+    CapacityModelConfig config;
+    config.cupCount = 2;
+    config.queueDepth = 4;
+    config.pumpCount = 8;
+    config.cupSpacing = 600;
+    config.cupSwapMs = 2000;
+    config.recipes.clear ();
+    config.recipes.push_back ( std::vector<unsigned int> ( 4, 3 ) );
+    config.recipes.push_back ( std::vector<unsigned int> ( 2, 5 ) );
+    config.meanArrivalMs = 20000;
+    config.orderCount = 30;
+    config.seed = 7;
+    return config;
+}
+
+static bool sameResult ( const CapacityModelResult & a, const CapacityModelResult & b )
+{
+    return ( a.simulatedMs == b.simulatedMs ) && ( a.served == b.served ) && ( a.rejected == b.rejected ) && ( a.failed == b.failed ) && ( a.pumpOnMs == b.pumpOnMs )
+            && ( a.headTravelSteps == b.headTravelSteps ) && ( a.queueWait.getCount () == b.queueWait.getCount () ) && ( a.queueWait.getMaximum () == b.queueWait.getMaximum () )
+            && ( a.total.percentile ( 50 ) == b.total.percentile ( 50 ) ) && ( a.total.getMaximum () == b.total.getMaximum () );
+}
+
+/**
+ * Every order is served and none waits for long.  A pump runs its last
+ * second in full, the first one only up to the next tick of the free
+ * running pump timer.
+ */
+static void lightLoadIsServed ()
+{
+    const CapacityModelConfig config = lightLoad ();
+    CapacityModelResult result;
+    CHECK ( CapacityModel::run ( config, result ) );
+    CHECK_EQUAL ( config.orderCount, result.served );
+    CHECK_EQUAL ( 0, result.rejected );
+    CHECK_EQUAL ( 0, result.failed );
+    CHECK_EQUAL ( config.orderCount, result.total.getCount () );
+    CHECK ( result.queueWait.percentile ( 50 ) < SECOND_MICRO_SECS );
+    CHECK ( result.total.getMaximum () >= 3 * SECOND_MICRO_SECS );
+    CHECK ( result.headTravelSteps > 0 );
+    CHECK ( result.pumpUtilisation () > 0 );
+    CHECK ( result.drinksPerHour () > 0 );
+
+    // a recipe pours 4 pumps for 3 seconds, the other 2 for 5
+    CHECK ( result.pumpOnMs >= 8000ULL * config.orderCount );
+    CHECK ( result.pumpOnMs <= 12000ULL * config.orderCount + config.orderCount );
+}
+
+/**
+ * Orders arriving faster than they pour fill a shallow queue, the rest
+ * is rejected, and a deeper queue turns rejections into waiting
+ */
+static void overloadFillsTheQueue ()
+{
+    CapacityModelConfig config = lightLoad ();
+    config.queueDepth = 1;
+    config.meanArrivalMs = 1000;
+    CapacityModelResult shallow;
+    CHECK ( CapacityModel::run ( config, shallow ) );
+    CHECK ( shallow.rejected > 0 );
+    CHECK_EQUAL ( config.orderCount, shallow.served + shallow.rejected + shallow.failed );
+
+    config.queueDepth = 32;
+    CapacityModelResult deep;
+    CHECK ( CapacityModel::run ( config, deep ) );
+    CHECK_EQUAL ( 0, deep.rejected );
+    CHECK ( deep.served > shallow.served );
+    CHECK ( deep.queueWait.getMaximum () > shallow.queueWait.getMaximum () );
+}
+
+/**
+ * The arrivals of a trace replace the Poisson ones
+ */
+static void traceDrivesTheArrivals ()
+{
+    CapacityModelConfig config = lightLoad ();
+    CHECK ( CapacityModel::loadTrace ( CAPACITY_MODEL_TRACE_DIR "/rush.trace", config.trace ) );
+    CHECK_EQUAL ( 15, config.trace.size () );
+    CHECK_EQUAL ( 61000, config.trace [ 2 ].atMs );
+    CHECK_EQUAL ( -1, config.trace [ 2 ].recipe );
+
+    CapacityModelResult result;
+    CHECK ( CapacityModel::run ( config, result ) );
+    CHECK_EQUAL ( config.trace.size (), result.served + result.rejected );
+    CHECK ( result.simulatedMs >= 400000 );
+
+    config.trace [ 3 ].recipe = 2; // there are two recipes
+    CHECK ( !CapacityModel::run ( config, result ) );
+    CHECK ( !CapacityModel::loadTrace ( CAPACITY_MODEL_TRACE_DIR "/missing.trace", config.trace ) );
+}
+
+static void outOfRangeIsRejected ()
+{
+    CapacityModelResult result;
+    CapacityModelConfig config = lightLoad ();
+    config.cupCount = 0;
+    CHECK ( !CapacityModel::run ( config, result ) );
+    config.cupCount = CAPACITY_MODEL_MAX_CUPS + 1;
+    CHECK ( !CapacityModel::run ( config, result ) );
+
+    config = lightLoad ();
+    config.queueDepth = 0;
+    CHECK ( !CapacityModel::run ( config, result ) );
+
+    config = lightLoad ();
+    config.recipes [ 0 ] = std::vector<unsigned int> ( config.pumpCount + 1, 1 );
+    CHECK ( !CapacityModel::run ( config, result ) );
+}
+
+/**
+ * A sweep on several threads comes out the same as one after the other,
+ * every run on a board of its own
+ */
+static void sweepIsDeterministic ()
+{
+    std::vector<CapacityModelConfig> configs;
+    for ( unsigned int cups = 1; cups <= 4; cups++ )
+    {
+        for ( int policy = RoundRobin; policy <= Scan; policy++ )
+        {
+            CapacityModelConfig config = lightLoad ();
+            config.cupCount = cups;
+            config.policy = (CupSelectionPolicy) policy;
+            config.overlapMode = ( ( cups % 2 ) == 0 );
+            config.meanArrivalMs = 6000;
+            configs.push_back ( config );
+        }
+    }
+
+    std::vector<CapacityModelResult> serial;
+    std::vector<CapacityModelResult> parallel;
+    std::vector<bool> serialSucceeded;
+    std::vector<bool> parallelSucceeded;
+    CapacityModel::sweep ( configs, serial, serialSucceeded, 1 );
+    CapacityModel::sweep ( configs, parallel, parallelSucceeded, 4 );
+
+    CHECK_EQUAL ( configs.size (), serial.size () );
+    CHECK_EQUAL ( configs.size (), parallel.size () );
+    for ( size_t i = 0; i < configs.size (); i++ )
+    {
+        CHECK ( serialSucceeded [ i ] );
+        CHECK ( parallelSucceeded [ i ] );
+        CHECK ( sameResult ( serial [ i ], parallel [ i ] ) );
+    }
+
+    CapacityModelResult again;
+    CHECK ( CapacityModel::run ( configs.back (), again ) );
+    CHECK ( sameResult ( serial.back (), again ) );
+}
+
+int main ()
+{
+    lightLoadIsServed ();
+    overloadFillsTheQueue ();
+    traceDrivesTheArrivals ();
+    outOfRangeIsRejected ();
+    sweepIsDeterministic ();
+    return HOST_TEST_RESULT ();
+}
@@ -0,0 +1,244 @@
+#include "CapacityModel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+/**
+ * Sizes the machine against an order rate on the host:
+ *
+ *   capacity_sweep --cups 2,4,6 --depth 4,8 --policy ROUND_ROBIN,SCAN
+ *           --overlap 0,1 --arrival 20000,40000 --count 500
+ *
+ * Every option that takes a list sweeps it, a line per combination of
+ * them.  The runs go to --threads worker threads ( all cores by default ),
+ * the table comes out the same either way.
+ *
+ *   --cups N,...          cups, at most CAPACITY_MODEL_MAX_CUPS
+ *   --depth N,...         order queue depth
+ *   --spacing N,...       dispenser steps between neighbouring cups
+ *   --first N             dispenser steps from home to the first cup
+ *   --policy P,...        ROUND_ROBIN | NEAREST | SCAN
+ *   --overlap 0|1,...     OrderManager overlap mode
+ *   --swap MS,...         time for a customer to replace a served cup
+ *   --pumps N             pump outputs
+ *   --recipe S,S,...      pump durations ( seconds ) of a recipe, repeat
+ *                         the option for more, each order picks one
+ *   --arrival MS,...      mean time between Poisson arrivals
+ *   --count N             orders per run
+ *   --seed N              replays the arrivals and recipe picks
+ *   --trace FILE          arrivals from a trace instead ( see loadTrace )
+ *   --threads N
+ */
+
+static std::vector<unsigned long> parseList ( const char * text, bool & valid )
+{
+    std::vector<unsigned long> values;
+    const char * at = text;
+    while ( valid )
+    {
+        char * end;
+        values.push_back ( strtoul ( at, &end, 10 ) );
+        valid = ( end != at ) && ( ( *end == ',' ) || ( *end == '\0' ) );
+        if ( *end != ',' )
+        {
+            break;
+        }
+        at = end + 1;
+    }
+    return values;
+}
+
+static bool parsePolicy ( const char * text, std::vector<CupSelectionPolicy> & policies )
+{
+    policies.clear ();
+    std::string list ( text );
+    size_t start = 0;
+    while ( start <= list.size () )
+    {
+        size_t end = list.find ( ',', start );
+        const std::string name = list.substr ( start, ( end == std::string::npos ) ? std::string::npos : end - start );
+        if ( name == "ROUND_ROBIN" )
+        {
+            policies.push_back ( RoundRobin );
+        }
+        else if ( name == "NEAREST" )
+        {
+            policies.push_back ( NearestFirst );
+        }
+        else if ( name == "SCAN" )
+        {
+            policies.push_back ( Scan );
+        }
+        else
+        {
+            return false;
+        }
+        if ( end == std::string::npos )
+        {
+            break;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+static const char * policyName ( const CupSelectionPolicy policy )
+{
+    switch ( policy )
+    {
+        case NearestFirst:
+            return "NEAREST";
+        case Scan:
+            return "SCAN";
+        default:
+            return "ROUND_ROBIN";
+    }
+}
+
+static int usage ( const char * program )
+{
+    fprintf ( stderr, "usage: %s [ --cups N,... ] [ --depth N,... ] [ --spacing N,... ] [ --first N ] [ --policy ROUND_ROBIN|NEAREST|SCAN,... ] [ --overlap 0|1,... ]\n"
+            "        [ --swap MS,... ] [ --pumps N ] [ --recipe S,S,... ]... [ --arrival MS,... ] [ --count N ] [ --seed N ] [ --trace FILE ] [ --threads N ]\n", program );
+    return 2;
+}
+
+int main ( int argc, char ** argv )
+{
+    CapacityModelConfig base;
+    base.recipes.clear ();
+    std::vector<unsigned long> cups ( 1, base.cupCount );
+    std::vector<unsigned long> depths ( 1, base.queueDepth );
+    std::vector<unsigned long> spacings ( 1, base.cupSpacing );
+    std::vector<unsigned long> overlaps ( 1, 0 );
+    std::vector<unsigned long> swaps ( 1, base.cupSwapMs );
+    std::vector<unsigned long> arrivals ( 1, base.meanArrivalMs );
+    std::vector<CupSelectionPolicy> policies ( 1, base.policy );
+    unsigned int threads = std::thread::hardware_concurrency ();
+
+    bool valid = true;
+    for ( int i = 1; valid && ( i < argc ); i++ )
+    {
+        const char * option = argv [ i ];
+        if ( i + 1 >= argc )
+        {
+            return usage ( argv [ 0 ] );
+        }
+        const char * value = argv [ ++i ];
+        if ( strcmp ( option, "--cups" ) == 0 )
+        {
+            cups = parseList ( value, valid );
+        }
+        else if ( strcmp ( option, "--depth" ) == 0 )
+        {
+            depths = parseList ( value, valid );
+        }
+        else if ( strcmp ( option, "--spacing" ) == 0 )
+        {
+            spacings = parseList ( value, valid );
+        }
+        else if ( strcmp ( option, "--overlap" ) == 0 )
+        {
+            overlaps = parseList ( value, valid );
+        }
+        else if ( strcmp ( option, "--swap" ) == 0 )
+        {
+            swaps = parseList ( value, valid );
+        }
+        else if ( strcmp ( option, "--arrival" ) == 0 )
+        {
+            arrivals = parseList ( value, valid );
+        }
+        else if ( strcmp ( option, "--policy" ) == 0 )
+        {
+            valid = parsePolicy ( value, policies );
+        }
+        else if ( strcmp ( option, "--recipe" ) == 0 )
+        {
+            const std::vector<unsigned long> durations = parseList ( value, valid );
+            base.recipes.push_back ( std::vector<unsigned int> ( durations.begin (), durations.end () ) );
+        }
+        else if ( strcmp ( option, "--first" ) == 0 )
+        {
+            base.firstCupPosition = parseList ( value, valid ) [ 0 ];
+        }
+        else if ( strcmp ( option, "--pumps" ) == 0 )
+        {
+            base.pumpCount = parseList ( value, valid ) [ 0 ];
+        }
+        else if ( strcmp ( option, "--count" ) == 0 )
+        {
+            base.orderCount = parseList ( value, valid ) [ 0 ];
+        }
+        else if ( strcmp ( option, "--seed" ) == 0 )
+        {
+            base.seed = parseList ( value, valid ) [ 0 ];
+        }
+        else if ( strcmp ( option, "--threads" ) == 0 )
+        {
+            threads = parseList ( value, valid ) [ 0 ];
+        }
+        else if ( strcmp ( option, "--trace" ) == 0 )
+        {
+            valid = CapacityModel::loadTrace ( value, base.trace );
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+    if ( !valid )
+    {
+        return usage ( argv [ 0 ] );
+    }
+    if ( base.recipes.empty () )
+    {
+        base.recipes.push_back ( std::vector<unsigned int> ( 4, 20 ) ); // four pumps, 20 seconds each
+    }
+
+    std::vector<CapacityModelConfig> configs;
+    for ( size_t c = 0; c < cups.size (); c++ )
+    for ( size_t d = 0; d < depths.size (); d++ )
+    for ( size_t s = 0; s < spacings.size (); s++ )
+    for ( size_t p = 0; p < policies.size (); p++ )
+    for ( size_t o = 0; o < overlaps.size (); o++ )
+    for ( size_t w = 0; w < swaps.size (); w++ )
+    for ( size_t a = 0; a < arrivals.size (); a++ )
+    {
+        CapacityModelConfig config = base;
+        config.cupCount = cups [ c ];
+        config.queueDepth = depths [ d ];
+        config.cupSpacing = spacings [ s ];
+        config.policy = policies [ p ];
+        config.overlapMode = ( overlaps [ o ] != 0 );
+        config.cupSwapMs = swaps [ w ];
+        config.meanArrivalMs = arrivals [ a ];
+        configs.push_back ( config );
+    }
+
+    std::vector<CapacityModelResult> results;
+    std::vector<bool> succeeded;
+    CapacityModel::sweep ( configs, results, succeeded, threads );
+
+    printf ( "%4s %5s %7s %-11s %7s %6s %7s | %7s %6s %5s %5s %8s %8s %8s %8s %5s %9s\n", "cups", "depth", "spacing", "policy", "overlap", "swap", "arrival", "drinks/h", "served",
+            "rej", "fail", "wait50", "wait99", "done50", "done99", "pump%", "head" );
+    int result = 0;
+    for ( size_t i = 0; i < configs.size (); i++ )
+    {
+        const CapacityModelConfig & config = configs [ i ];
+        const CapacityModelResult & run = results [ i ];
+        printf ( "%4u %5u %7u %-11s %7s %6lu %7lu | ", config.cupCount, config.queueDepth, config.cupSpacing, policyName ( config.policy ), config.overlapMode ? "on" : "off",
+                (unsigned long) config.cupSwapMs, config.trace.empty () ? (unsigned long) config.meanArrivalMs : 0UL );
+        if ( !succeeded [ i ] )
+        {
+            printf ( "out of range or stalled\n" );
+            result = 1;
+            continue;
+        }
+        printf ( "%8lu %6u %5u %5u %8lu %8lu %8lu %8lu %5u %9u\n", (unsigned long) run.drinksPerHour (), run.served, run.rejected, run.failed,
+                (unsigned long) run.queueWait.percentile ( 50 ) / 1000, (unsigned long) run.queueWait.percentile ( 99 ) / 1000, (unsigned long) run.total.percentile ( 50 ) / 1000,
+                (unsigned long) run.total.percentile ( 99 ) / 1000, run.pumpUtilisation (), run.headTravelSteps );
+    }
+    printf ( "latencies in ms ( bucket upper bounds ), %s\n", base.trace.empty () ? "Poisson arrivals" : "arrivals from the trace" );
+    return result;
+}